@@ -0,0 +1,113 @@
+#
+# MIT License
+#
+# Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+
+# Runs COMMAND twice, with all of the history and with ZS_HISTORY_LIMIT
+# set to LIMIT, and checks that the per-period averages in the CPU
+# summaries agree. The averages are over the whole run, so with the limit
+# they have to come from the downsampled totals of the rows that were
+# dropped. The total_time of a hardware thread is the length of the
+# period in ticks, whatever the application does, so the two runs agree
+# on it. That doesn't tell the rows apart, so the user time of the node is
+# checked too: it changes over the run (the setup and the end of the
+# decomposition are mostly serial), so it only agrees if the dropped rows
+# are counted.
+#
+# Usage: cmake -DCOMMAND="zerosum;--zs:period;0.1;app" -DLIMIT=4
+#     -P check_history.cmake
+
+cmake_minimum_required(VERSION 3.19)
+
+# the averages are printed with two decimals, as hundredths
+function(averages output metric result)
+    string(REGEX MATCHALL "CPU [0-9]+ - [^\n]* ${metric}: *[0-9]+\\.[0-9][0-9]"
+        lines "${output}")
+    set(times "")
+    foreach(line ${lines})
+        string(REGEX REPLACE ".* ${metric}: *([0-9]+)\\.([0-9][0-9])$" "\\1\\2"
+            hundredths "${line}")
+        math(EXPR hundredths "${hundredths}")
+        list(APPEND times ${hundredths})
+    endforeach()
+    set(${result} ${times} PARENT_SCOPE)
+endfunction()
+
+# the sum over the hardware threads, the application's threads can move
+function(node_total output metric result)
+    averages("${output}" ${metric} times)
+    set(total 0)
+    foreach(t ${times})
+        math(EXPR total "${total} + ${t}")
+    endforeach()
+    set(${result} ${total} PARENT_SCOPE)
+endfunction()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E env --unset=ZS_HISTORY_LIMIT ${COMMAND}
+    RESULT_VARIABLE result OUTPUT_VARIABLE unlimited)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${COMMAND} failed: ${result}")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E env ZS_HISTORY_LIMIT=${LIMIT} ${COMMAND}
+    RESULT_VARIABLE result OUTPUT_VARIABLE limited)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "ZS_HISTORY_LIMIT=${LIMIT} ${COMMAND} failed: ${result}")
+endif()
+
+averages("${unlimited}" total_time expected)
+averages("${limited}" total_time actual)
+list(LENGTH expected count)
+list(LENGTH actual limitedCount)
+if(count EQUAL 0 OR NOT count EQUAL limitedCount)
+    message(FATAL_ERROR "expected the same CPU summaries from both runs:\n"
+        "${unlimited}\n${limited}")
+endif()
+
+# within 5%, the two runs don't take the same number of periods
+math(EXPR last "${count} - 1")
+foreach(i RANGE ${last})
+    list(GET expected ${i} e)
+    list(GET actual ${i} a)
+    math(EXPR difference "(${a} - ${e}) * 20")
+    if(difference LESS 0)
+        math(EXPR difference "-${difference}")
+    endif()
+    if(difference GREATER e)
+        message(FATAL_ERROR "CPU summary ${i}: total_time ${a} hundredths "
+            "with ZS_HISTORY_LIMIT=${LIMIT}, ${e} without it")
+    endif()
+endforeach()
+
+# within 10%, it depends on the scheduling as well as the history
+node_total("${unlimited}" user e)
+node_total("${limited}" user a)
+math(EXPR difference "(${a} - ${e}) * 10")
+if(difference LESS 0)
+    math(EXPR difference "-${difference}")
+endif()
+if(e EQUAL 0 OR difference GREATER e)
+    message(FATAL_ERROR "user time: ${a} hundredths per period "
+        "with ZS_HISTORY_LIMIT=${LIMIT}, ${e} without it")
+endif()
+
+message(STATUS "${count} CPU summaries agree with ZS_HISTORY_LIMIT=${LIMIT}")
@@ -0,0 +1,60 @@
+#
+# MIT License
+#
+# Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+# Runs COMMAND with the trace enabled, and checks that the trace of rank 0
+# is a JSON array with counter events for the hardware threads and LWPs.
+#
+# Usage: cmake -DCOMMAND="zerosum;--zs:trace;app" -P check_trace.cmake
+
+cmake_minimum_required(VERSION 3.19)
+
+set(TRACE zs.trace.0.json)
+file(REMOVE ${TRACE})
+
+execute_process(COMMAND ${COMMAND} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${COMMAND} failed: ${result}")
+endif()
+if(NOT EXISTS ${TRACE})
+    message(FATAL_ERROR "${TRACE} was not written")
+endif()
+
+file(READ ${TRACE} json)
+# fails on anything that isn't well-formed JSON
+string(JSON events ERROR_VARIABLE error LENGTH "${json}")
+if(error)
+    message(FATAL_ERROR "${TRACE} is not valid JSON: ${error}")
+endif()
+string(JSON type TYPE "${json}")
+if(NOT type STREQUAL "ARRAY" OR events EQUAL 0)
+    message(FATAL_ERROR "${TRACE} is not an array of trace events")
+endif()
+
+foreach(series "HWT" "LWP")
+    if(NOT json MATCHES "{\"name\":\"${series} [0-9]+\",\"ph\":\"C\"")
+        message(FATAL_ERROR "${TRACE} has no ${series} counter events")
+    endif()
+endforeach()
+
+message(STATUS "${TRACE}: ${events} trace events")
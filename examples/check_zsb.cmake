@@ -0,0 +1,63 @@
+#
+# MIT License
+#
+# Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+
+# Runs COMMAND with both the CSV and the binary output enabled, converts
+# the binary output of rank 0 back with CONVERT, and checks that the
+# result is the same CSV, byte for byte.
+#
+# Usage: cmake -DCOMMAND="zerosum;--zs:csv;--zs:binary;app"
+#     -DCONVERT=zs-convert -P check_zsb.cmake
+
+cmake_minimum_required(VERSION 3.19)
+
+set(CSV zs.data.0.csv)
+set(ZSB zs.data.0.zsb)
+set(CONVERTED zs.convert.0.csv)
+file(REMOVE ${CSV} ${ZSB} ${CONVERTED})
+
+execute_process(COMMAND ${COMMAND} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${COMMAND} failed: ${result}")
+endif()
+foreach(output ${CSV} ${ZSB})
+    if(NOT EXISTS ${output})
+        message(FATAL_ERROR "${output} was not written")
+    endif()
+endforeach()
+
+execute_process(COMMAND ${CONVERT} -o ${CONVERTED} ${ZSB} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${CONVERT} ${ZSB} failed: ${result}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${CSV} ${CONVERTED}
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${CONVERTED} differs from ${CSV}")
+endif()
+
+file(SIZE ${CSV} csvBytes)
+file(SIZE ${ZSB} zsbBytes)
+message(STATUS "${ZSB}: ${zsbBytes} bytes, converts to the ${csvBytes} bytes of ${CSV}")
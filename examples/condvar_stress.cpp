@@ -0,0 +1,149 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Hammers the wrapped wait functions while ZeroSum samples the threads.
+ * Producers and consumers ping-pong through condition variables
+ * (pthread_cond_wait, pthread_cond_timedwait, and the
+ * pthread_cond_clockwait that std::condition_variable uses for
+ * steady_clock timeouts), then every thread meets at a pthread barrier
+ * and passes a token around a ring of semaphores.
+ * If a wrapper deadlocks against the glibc condvar internals or the
+ * sampling thread, the test times out. */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <pthread.h>
+#include <semaphore.h>
+
+static int nthreads{4};
+static int iterations{20000};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+static int queued{0};
+static const int capacity{4};
+static pthread_barrier_t barrier;
+static std::vector<sem_t> ring;
+
+static void deadline(clockid_t clock, struct timespec* ts) {
+    clock_gettime(clock, ts);
+    ts->tv_nsec += 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void* producer(void*) {
+    for (int i = 0 ; i < iterations ; i++) {
+        pthread_mutex_lock(&lock);
+        while (queued == capacity) {
+            pthread_cond_wait(&not_full, &lock);
+        }
+        queued++;
+        pthread_cond_signal(&not_empty);
+        pthread_mutex_unlock(&lock);
+    }
+    return nullptr;
+}
+
+static void* consumer(void*) {
+    for (int i = 0 ; i < iterations ; i++) {
+        pthread_mutex_lock(&lock);
+        while (queued == 0) {
+            // short timeouts, so some waits time out and some are signaled
+            struct timespec ts;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 30)
+            if (i % 2 == 1) {
+                deadline(CLOCK_MONOTONIC, &ts);
+                int rc = pthread_cond_clockwait(&not_empty, &lock, CLOCK_MONOTONIC, &ts);
+                if (rc != 0 && rc != ETIMEDOUT) {
+                    fprintf(stderr, "pthread_cond_clockwait: %d\n", rc);
+                    abort();
+                }
+                continue;
+            }
+#endif
+            deadline(CLOCK_REALTIME, &ts);
+            int rc = pthread_cond_timedwait(&not_empty, &lock, &ts);
+            if (rc != 0 && rc != ETIMEDOUT) {
+                fprintf(stderr, "pthread_cond_timedwait: %d\n", rc);
+                abort();
+            }
+        }
+        queued--;
+        pthread_cond_signal(&not_full);
+        pthread_mutex_unlock(&lock);
+    }
+    return nullptr;
+}
+
+static void* ring_member(void* arg) {
+    int me = (int)(intptr_t)arg;
+    int next = (me + 1) % nthreads;
+    for (int i = 0 ; i < iterations / 10 ; i++) {
+        pthread_barrier_wait(&barrier);
+        while (sem_wait(&ring[me]) != 0 && errno == EINTR) {}
+        sem_post(&ring[next]);
+    }
+    return nullptr;
+}
+
+static void run(void*(*fn)(void*), int count, std::vector<pthread_t>& threads) {
+    for (int i = 0 ; i < count ; i++) {
+        pthread_t t;
+        pthread_create(&t, nullptr, fn, (void*)(intptr_t)threads.size());
+        threads.push_back(t);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    if (argc > 1) { nthreads = std::max(2, atoi(argv[1])); }
+    if (argc > 2) { iterations = std::max(10, atoi(argv[2])); }
+
+    std::vector<pthread_t> threads;
+    run(producer, nthreads / 2, threads);
+    run(consumer, nthreads / 2, threads);
+    for (auto t : threads) { pthread_join(t, nullptr); }
+    printf("condition variables: %d round trips per thread\n", iterations);
+
+    threads.clear();
+    pthread_barrier_init(&barrier, nullptr, nthreads);
+    ring.resize(nthreads);
+    for (int i = 0 ; i < nthreads ; i++) {
+        sem_init(&ring[i], 0, i == 0 ? 1 : 0);
+    }
+    run(ring_member, nthreads, threads);
+    for (auto t : threads) { pthread_join(t, nullptr); }
+    for (auto& s : ring) { sem_destroy(&s); }
+    pthread_barrier_destroy(&barrier);
+    printf("barriers and semaphores: %d rounds\n", iterations / 10);
+    return 0;
+}
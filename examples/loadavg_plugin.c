@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/* An example collector plugin, the load averages from /proc/loadavg.
+ * Build it as a shared library and run with ZS_PLUGINS=<path>. */
+
+#include <stdio.h>
+#include "zerosum_plugin.h"
+
+static const zs_plugin_metric_t metrics[] = {
+    {"loadavg 1min", ZS_PLUGIN_DOUBLE},
+    {"loadavg 5min", ZS_PLUGIN_DOUBLE},
+    {"loadavg 15min", ZS_PLUGIN_DOUBLE},
+    {"loadavg running", ZS_PLUGIN_UNSIGNED},
+    {"loadavg tasks", ZS_PLUGIN_UNSIGNED}
+};
+
+static int loadavg_init(void ** context) {
+    FILE * f = fopen("/proc/loadavg", "r");
+    if (f == NULL) { return -1; }
+    *context = f;
+    return 0;
+}
+
+static size_t loadavg_describe(void * context, const zs_plugin_metric_t ** out) {
+    (void)context;
+    *out = metrics;
+    return sizeof(metrics) / sizeof(metrics[0]);
+}
+
+static int loadavg_sample(void * context, zs_plugin_value_t * values, size_t count) {
+    FILE * f = (FILE *)context;
+    unsigned long running, tasks;
+    if (count < 5) { return -1; }
+    /* /proc files are regenerated when read from the start */
+    rewind(f);
+    fflush(f);
+    if (fscanf(f, "%lf %lf %lf %lu/%lu", &values[0].d, &values[1].d,
+        &values[2].d, &running, &tasks) != 5) {
+        return -1;
+    }
+    values[3].u = running;
+    values[4].u = tasks;
+    return 5;
+}
+
+static void loadavg_finalize(void * context) {
+    fclose((FILE *)context);
+}
+
+static const zs_plugin_t plugin = {
+    ZEROSUM_PLUGIN_ABI_VERSION,
+    "loadavg",
+    ZS_PLUGIN_NODE,
+    0.0,
+    loadavg_init,
+    loadavg_describe,
+    loadavg_sample,
+    loadavg_finalize
+};
+
+const zs_plugin_t * zerosum_plugin(void) {
+    return &plugin;
+}
@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Does some I/O on each kind of descriptor the POSIX I/O wrappers tell
+ * apart: a regular file (write, pwrite, writev, fsync, then read it all
+ * back), a pipe and a socket pair. */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+static void check(bool ok, const char * what) {
+    if (!ok) {
+        perror(what);
+        exit(1);
+    }
+}
+
+static void fileIO(size_t blocks, std::vector<char>& buffer) {
+    char name[64];
+    snprintf(name, sizeof(name), "/tmp/zs-posix-io.%d", getpid());
+    int fd = open(name, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    check(fd >= 0, "open");
+    unlink(name);
+    size_t size = buffer.size();
+    for (size_t i = 0 ; i < blocks ; i++) {
+        ssize_t rc;
+        if (i % 3 == 0) {
+            rc = write(fd, buffer.data(), size);
+        } else if (i % 3 == 1) {
+            rc = pwrite(fd, buffer.data(), size, (off_t)(i * size));
+            lseek(fd, (off_t)((i + 1) * size), SEEK_SET);
+        } else {
+            struct iovec iov[2] = {{buffer.data(), size / 2},
+                {buffer.data() + size / 2, size - size / 2}};
+            rc = writev(fd, iov, 2);
+        }
+        check(rc == (ssize_t)size, "write");
+    }
+    check(fsync(fd) == 0, "fsync");
+    for (size_t i = 0 ; i < blocks ; i++) {
+        ssize_t rc = pread(fd, buffer.data(), size, (off_t)(i * size));
+        check(rc == (ssize_t)size, "pread");
+    }
+    check(close(fd) == 0, "close");
+}
+
+static void pairIO(int fds[2], size_t rounds, std::vector<char>& buffer, const char * what) {
+    for (size_t i = 0 ; i < rounds ; i++) {
+        ssize_t rc = write(fds[1], buffer.data(), 512);
+        check(rc == 512, what);
+        rc = read(fds[0], buffer.data(), 512);
+        check(rc == 512, what);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char * argv[]) {
+    size_t blocks = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    std::vector<char> buffer(1 << 16, 'z');
+    // a few seconds, so the thread is sampled more than once
+    for (int pass = 0 ; pass < 3 ; pass++) {
+        fileIO(blocks, buffer);
+        int fds[2];
+        check(pipe(fds) == 0, "pipe");
+        pairIO(fds, blocks, buffer, "pipe");
+        check(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair");
+        pairIO(fds, blocks, buffer, "socketpair");
+        sleep(1);
+    }
+    printf("Wrote and read %lu MB\n", (3 * blocks * buffer.size()) >> 20);
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include "collector_scheduler.h"
+
+namespace zerosum {
+
+namespace {
+
+uint64_t threadCpuNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/* Minor faults are the pages this thread touched for the first time */
+uint64_t threadFaults(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) { return 0; }
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+} // anonymous namespace
+
+CollectorScheduler::CollectorScheduler(void) : slots(slotCount) {}
+
+size_t CollectorScheduler::add(const std::string& name, uint64_t period,
+    uint64_t phase, collector_t collector, bool optional) {
+    size_t id = collectors.size();
+    entry_t e{};
+    e.name = name;
+    e.period = std::max(period, (uint64_t)1);
+    e.phase = phase;
+    e.collector = collector;
+    e.optional = optional;
+    // a collector added late starts at its next phase
+    e.due = phase;
+    if (e.due < next) {
+        e.due += (((next - e.due) + e.period - 1) / e.period) * e.period;
+    }
+    collectors.push_back(std::move(e));
+    slots[collectors[id].due % slotCount].push_back(id);
+    return id;
+}
+
+void CollectorScheduler::budget(double percent, double tickSeconds,
+    report_t _report) {
+    budgetPercent = percent;
+    // long enough that one slow sweep doesn't count as a trend
+    windowTicks = std::max((uint64_t)5, (uint64_t)std::llround(5.0 / tickSeconds));
+    report = _report;
+}
+
+void CollectorScheduler::tick(uint32_t step, uint64_t deadline) {
+    static const series::metric_id duration{series::Metrics::intern("duration us")};
+    static const series::metric_id cpu{series::Metrics::intern("cpu ns")};
+    static const series::metric_id faulted{series::Metrics::intern("faulted bytes")};
+    static const series::metric_id jitter{series::Metrics::intern("jitter us")};
+    static const uint64_t pageSize{(uint64_t)sysconf(_SC_PAGESIZE)};
+    uint64_t now = next++;
+    if (now == 0) {
+        firstCpuNs = windowCpuNs = threadCpuNs();
+        firstWallNs = windowWallNs = series::now();
+    }
+    auto& slot = slots[now % slotCount];
+    // the collectors in this slot that are due on a later turn stay
+    due.clear();
+    auto keep = slot.begin();
+    for (auto id : slot) {
+        if (collectors[id].due == now) {
+            due.push_back(id);
+        } else {
+            *keep++ = id;
+        }
+    }
+    slot.erase(keep, slot.end());
+    std::sort(due.begin(), due.end());
+    for (auto id : due) {
+        entry_t& e = collectors[id];
+        // a dropped collector leaves the wheel
+        if (!e.enabled) { continue; }
+        uint64_t start = series::now();
+        uint64_t startCpu = threadCpuNs();
+        uint64_t startFaults = threadFaults();
+        e.collector();
+        uint64_t end = series::now();
+        uint64_t us = (end - start) / 1000;
+        uint64_t cpuNs = threadCpuNs() - startCpu;
+        uint64_t bytes = (threadFaults() - startFaults) * pageSize;
+        // the first tick isn't waited for, so it has no deadline
+        uint64_t late = (deadline > 0 && start > deadline) ? (start - deadline) / 1000 : 0;
+        e.last = now;
+        e.runs++;
+        e.totalUs += us;
+        e.maxUs = std::max(e.maxUs, us);
+        e.cpuNs += cpuNs;
+        e.windowCpuNs += cpuNs;
+        e.faultedBytes += bytes;
+        e.jitterUs += late;
+        e.maxJitterUs = std::max(e.maxJitterUs, late);
+        e.data.begin(step, start);
+        e.data.set(duration, us);
+        e.data.set(cpu, cpuNs);
+        e.data.set(faulted, bytes);
+        e.data.set(jitter, late);
+        e.data.end();
+        e.due = now + e.period;
+        slots[e.due % slotCount].push_back(id);
+    }
+    lastCpuNs = threadCpuNs();
+    lastWallNs = series::now();
+    if (budgetPercent > 0.0 && next - windowStart >= windowTicks) {
+        checkBudget();
+    }
+}
+
+void CollectorScheduler::checkBudget(void) {
+    uint64_t wall = lastWallNs - windowWallNs;
+    double percent = wall > 0 ?
+        (100.0 * (double)(lastCpuNs - windowCpuNs)) / (double)wall : 0.0;
+    if (percent > budgetPercent && !exhausted) {
+        // the optional collectors go first
+        entry_t * worst{nullptr};
+        for (auto& e : collectors) {
+            if (!e.enabled || !e.optional) { continue; }
+            if (worst == nullptr || e.windowCpuNs > worst->windowCpuNs) { worst = &e; }
+        }
+        char buffer[256];
+        if (worst != nullptr) {
+            worst->enabled = false;
+            snprintf(buffer, sizeof(buffer),
+                "Overhead %.2f%% is over the budget of %.2f%%, dropping %s\n",
+                percent, budgetPercent, worst->name.c_str());
+        } else {
+            for (auto& e : collectors) {
+                if (!e.enabled) { continue; }
+                if (worst == nullptr || e.windowCpuNs > worst->windowCpuNs) { worst = &e; }
+            }
+            if (worst == nullptr || worst->windowCpuNs == 0) {
+                // it's the writing or the logging, nothing to slow down
+                exhausted = true;
+                snprintf(buffer, sizeof(buffer),
+                    "Overhead %.2f%% is over the budget of %.2f%%, no collector to slow down\n",
+                    percent, budgetPercent);
+            } else {
+                worst->period *= 2;
+                snprintf(buffer, sizeof(buffer),
+                    "Overhead %.2f%% is over the budget of %.2f%%, %s now runs every %lu periods\n",
+                    percent, budgetPercent, worst->name.c_str(), worst->period);
+            }
+        }
+        if (report) { report(buffer); }
+    }
+    for (auto& e : collectors) { e.windowCpuNs = 0; }
+    windowCpuNs = lastCpuNs;
+    windowWallNs = lastWallNs;
+    windowStart = next;
+}
+
+double CollectorScheduler::usage(void) const {
+    uint64_t wall = lastWallNs - firstWallNs;
+    if (wall == 0) { return 0.0; }
+    return (100.0 * (double)(lastCpuNs - firstCpuNs)) / (double)wall;
+}
+
+std::string CollectorScheduler::summary(double tickSeconds) const {
+    if (collectors.empty()) { return ""; }
+    std::string tmpstr{"\nCollectors:\n"};
+    char buffer[512];
+    for (auto& e : collectors) {
+        double runs = (double)std::max(e.runs, (uint64_t)1);
+        snprintf(buffer, sizeof(buffer),
+            "%10s: every %8.3f s (phase %.3f s), %6lu runs, mean %10.1f us, "
+            "max %8lu us, cpu %10.1f us, %8.1f kB faulted, jitter %8.1f us (max %lu us)%s\n",
+            e.name.c_str(), (double)e.period * tickSeconds,
+            (double)e.phase * tickSeconds, e.runs, (double)e.totalUs / runs,
+            e.maxUs, (double)e.cpuNs / runs / 1000.0,
+            (double)e.faultedBytes / 1024.0, (double)e.jitterUs / runs,
+            e.maxJitterUs, e.enabled ? "" : ", dropped");
+        tmpstr += buffer;
+    }
+    snprintf(buffer, sizeof(buffer),
+        "Async thread: %.3f s CPU in %.3f s, %.3f%% of one core",
+        (double)(lastCpuNs - firstCpuNs) / 1.0e9,
+        (double)(lastWallNs - firstWallNs) / 1.0e9, usage());
+    tmpstr += buffer;
+    if (budgetPercent > 0.0) {
+        snprintf(buffer, sizeof(buffer), " (budget %.3f%%)", budgetPercent);
+        tmpstr += buffer;
+    }
+    tmpstr += "\n";
+    return tmpstr;
+}
+
+} // namespace zerosum
@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "timeseries.h"
+
+namespace zerosum {
+
+/* Runs each collector every <period> ticks of the sampling timer, starting
+ * at tick <phase>. The collectors are kept in a hashed timer wheel, one
+ * slot per tick, so a tick only looks at the collectors in its slot, and
+ * the ones whose period is longer than the wheel wait in their slot for
+ * another turn.
+ * Each collector records the step and time of every run in its own
+ * series, with what the run cost: wall time, thread CPU time, the memory
+ * it faulted in, and how late it started after the timer deadline.
+ * With a budget, the CPU time of the async thread is checked every five
+ * seconds or so, and while it is over, the most expensive optional
+ * collector is dropped, or else the most expensive collector's period
+ * is doubled. */
+class CollectorScheduler {
+public:
+    typedef std::function<void(void)> collector_t;
+    typedef std::function<void(const std::string&)> report_t;
+    CollectorScheduler(void);
+    /* Returns the ID of the collector. The period and phase are in ticks.
+     * Optional collectors can be dropped to stay within the budget. */
+    size_t add(const std::string& name, uint64_t period, uint64_t phase,
+        collector_t collector, bool optional = false);
+    /* Keep the async thread under percent of one core, reporting any
+     * changes to the schedule. 0 (the default) for no budget. */
+    void budget(double percent, double tickSeconds, report_t report);
+    /* Advance the wheel one tick and run the collectors that are due,
+     * in the order they were added. The deadline is when the tick was
+     * due, in nanoseconds on the monotonic clock. */
+    void tick(uint32_t step, uint64_t deadline);
+    /* Whether the collector ran during the last tick */
+    bool ran(size_t id) const { return collectors[id].last + 1 == next; }
+    size_t size(void) const { return collectors.size(); }
+    const std::string& name(size_t id) const { return collectors[id].name; }
+    /* The period in ticks, after any doubling to stay within the budget */
+    uint64_t period(size_t id) const { return collectors[id].period; }
+    const series::TimeSeries& data(size_t id) const { return collectors[id].data; }
+    /* The CPU time of the async thread, as a percentage of the wall time,
+     * since the first tick */
+    double usage(void) const;
+    std::string summary(double tickSeconds) const;
+private:
+    static constexpr size_t slotCount{64};
+    struct entry_t {
+        std::string name;
+        uint64_t period;
+        uint64_t phase;
+        collector_t collector;
+        bool optional;
+        bool enabled{true};
+        // the tick this collector is due next, and the tick it last ran
+        uint64_t due;
+        uint64_t last{UINT64_MAX};
+        uint64_t runs{0};
+        uint64_t totalUs{0};
+        uint64_t maxUs{0};
+        uint64_t cpuNs{0};
+        uint64_t faultedBytes{0};
+        uint64_t jitterUs{0};
+        uint64_t maxJitterUs{0};
+        // the CPU time since the last budget check
+        uint64_t windowCpuNs{0};
+        series::TimeSeries data;
+    };
+    void checkBudget(void);
+    std::vector<entry_t> collectors;
+    std::vector<std::vector<size_t>> slots;
+    std::vector<size_t> due;
+    // the tick to process next
+    uint64_t next{0};
+    // the async thread's CPU time and the wall time, at the first tick,
+    // the last tick, and the start of the budget window
+    uint64_t firstCpuNs{0};
+    uint64_t firstWallNs{0};
+    uint64_t lastCpuNs{0};
+    uint64_t lastWallNs{0};
+    uint64_t windowCpuNs{0};
+    uint64_t windowWallNs{0};
+    uint64_t windowStart{0};
+    uint64_t windowTicks{0};
+    double budgetPercent{0.0};
+    bool exhausted{false};
+    report_t report;
+};
+
+} // namespace zerosum
@@ -27,48 +27,39 @@
 #include "cray_pm_counters.h"
 #include <string>
 #include <iostream>
-#include <sstream>
 #include <string.h>
+#include <stdlib.h>
 
 using namespace std;
 
 namespace zerosum {
 
-uint64_t cray_pm_counters::get_unitless(std::string name) {
-    uint64_t tmpint{0};
-    std::string filename = location + name;
-    FILE * fp = fopen(filename.c_str(), "r");
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t nread;
-    while ((nread = getline(&line, &len, fp)) != -1) {
-        if (nread == -1) break;
-        std::istringstream iline{line};
-        while (iline >> tmpint) {
-            return tmpint;
-            break;
-        }
+ProcFile& cray_pm_counters::get_file(const std::string& name) {
+    auto f = files.find(name);
+    if (f == files.end()) {
+        f = files.emplace(name, ProcFile(location + name)).first;
     }
-    fclose(fp);
-    return tmpint;
+    return f->second;
+}
+
+uint64_t cray_pm_counters::get_unitless(const std::string& name) {
+    if (get_file(name).read(buffer) == 0) { return 0; }
+    return strtoull(buffer.data(), nullptr, 10);
 }
 
-std::pair<uint64_t,std::string> cray_pm_counters::get_with_unit(std::string name) {
+/* The files look like "12345 J 1700000000123456 us" */
+std::pair<uint64_t,std::string> cray_pm_counters::get_with_unit(const std::string& name) {
     uint64_t tmpint{0};
     std::string tmpstr;
-    std::string filename = location + name;
-    FILE * fp = fopen(filename.c_str(), "r");
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t nread;
-    while ((nread = getline(&line, &len, fp)) != -1) {
-        if (nread == -1) break;
-        std::istringstream iline{line};
-        while (iline >> tmpint >> tmpstr) {
-            break;
-        }
+    if (get_file(name).read(buffer) == 0) {
+        return std::make_pair(tmpint, tmpstr);
     }
-    fclose(fp);
+    char * end{nullptr};
+    tmpint = strtoull(buffer.data(), &end, 10);
+    while (*end == ' ') { end++; }
+    const char * unit = end;
+    while (*end != '\0' && *end != ' ' && *end != '\n') { end++; }
+    tmpstr.assign(unit, end - unit);
     return std::make_pair(tmpint, tmpstr);
 }
 
@@ -103,40 +94,47 @@ cray_pm_counters::cray_pm_counters() : supported(false),
     previous_generation = get_unitless("generation");
     supported = true;
     closedir(directory_ptr);
+    names.push_back("cray_pm valid");
+    names.push_back("cray_pm power cap changed");
+    for (auto& p : previous) {
+        names.push_back(std::get<0>(p.second));
+    }
+    // the names don't move once they are all added
+    for (auto& n : names) {
+        metrics.push_back(zs_plugin_metric_t{n.c_str(), ZS_PLUGIN_UNSIGNED});
+    }
 }
 
 cray_pm_counters::~cray_pm_counters()
 {
 }
 
-std::map<std::string,std::string> cray_pm_counters::read_counters()
+size_t cray_pm_counters::describe(const zs_plugin_metric_t ** out) {
+    *out = metrics.data();
+    return metrics.size();
+}
+
+int cray_pm_counters::read_counters(zs_plugin_value_t * values, size_t count)
 {
-    std::map<std::string,std::string> fields;
-    if (!supported) return fields;
+    if (!supported || count < metrics.size()) return -1;
 
     // confirm we have good values
     uint64_t new_freshness = get_unitless("freshness");
-    //fields.insert( std::pair<std::string,std::string>(
-        //"freshness", std::to_string(new_freshness)));
-    bool valid{new_freshness > previous_freshness};
-    fields.insert( std::pair<std::string,std::string>(
-        "cray_pm valid", std::to_string(valid)));
+    values[0].u = (new_freshness > previous_freshness) ? 1 : 0;
     previous_freshness = new_freshness;
 
     // confirm we haven't changed power caps
     uint64_t new_generation = get_unitless("generation");
-    bool changed{new_generation > previous_generation};
-    fields.insert( std::pair<std::string,std::string>(
-        "cray_pm power cap changed", std::to_string(changed)));
+    values[1].u = (new_generation > previous_generation) ? 1 : 0;
     previous_generation = new_generation;
 
     // iterate over the tuples, with a reference because we want to update them
+    size_t index{2};
     for (auto& p : previous) {
-        std::string fullname;
         uint64_t prev;
         bool monotonic;
         // tie will give us references to these values...
-        std::tie(fullname, prev, monotonic) = p.second;
+        std::tie(std::ignore, prev, monotonic) = p.second;
         auto data = get_with_unit(p.first);
         auto tmpint = std::get<uint64_t>(data);
         auto current = tmpint;
@@ -144,11 +142,42 @@ std::map<std::string,std::string> cray_pm_counters::read_counters()
             current = current - prev;
             std::get<1>(p.second) = tmpint;
         }
-        fields.insert(
-            std::pair<std::string,std::string>(
-                fullname, std::to_string(current)));
+        values[index++].u = current;
+    }
+    return (int)metrics.size();
+}
+
+namespace {
+
+int cray_pm_init(void ** context) {
+    cray_pm_counters * counters = new cray_pm_counters();
+    if (!counters->is_supported()) {
+        delete counters;
+        return -1;
     }
-    return fields;
+    *context = counters;
+    return 0;
+}
+
+size_t cray_pm_describe(void * context, const zs_plugin_metric_t ** metrics) {
+    return ((cray_pm_counters*)context)->describe(metrics);
+}
+
+int cray_pm_sample(void * context, zs_plugin_value_t * values, size_t count) {
+    return ((cray_pm_counters*)context)->read_counters(values, count);
+}
+
+void cray_pm_finalize(void * context) {
+    delete (cray_pm_counters*)context;
+}
+
+const zs_plugin_t plugin{ZEROSUM_PLUGIN_ABI_VERSION, "cray_pm", ZS_PLUGIN_NODE,
+    0.0, cray_pm_init, cray_pm_describe, cray_pm_sample, cray_pm_finalize};
+
+} // anonymous namespace
+
+const zs_plugin_t * cray_pm_plugin(void) {
+    return &plugin;
 }
 
 }
@@ -29,6 +29,9 @@
 #include <set>
 #include <tuple>
 #include <cstdint>
+#include <vector>
+#include "utils.h"
+#include "zerosum_plugin.h"
 
 namespace zerosum {
 
@@ -37,9 +40,11 @@ class cray_pm_counters {
     public:
         cray_pm_counters(void);
         ~cray_pm_counters(void);
-        std::map<std::string,std::string> read_counters(void);
-        uint64_t get_unitless(std::string name);
-        std::pair<uint64_t,std::string> get_with_unit(std::string name);
+        bool is_supported(void) const { return supported; }
+        size_t describe(const zs_plugin_metric_t ** out);
+        int read_counters(zs_plugin_value_t * values, size_t count);
+        uint64_t get_unitless(const std::string& name);
+        std::pair<uint64_t,std::string> get_with_unit(const std::string& name);
     private:
         bool supported;
         const std::string location{"/sys/cray/pm_counters/"};
@@ -50,7 +55,16 @@ class cray_pm_counters {
         std::map<std::string, cray_tuple> previous;
         uint64_t previous_generation;
         uint64_t previous_freshness;
+        // the counter files stay open, and are re-read every period
+        std::map<std::string, ProcFile> files;
+        std::vector<char> buffer;
+        ProcFile& get_file(const std::string& name);
+        // the valid and power cap flags, then the counters in name order
+        std::vector<std::string> names;
+        std::vector<zs_plugin_metric_t> metrics;
 };
 
-}
+/* The Cray power counters, as a built-in node plugin */
+const zs_plugin_t * cray_pm_plugin(void);
 
+}
@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <string.h>
+#include <charconv>
+#include <algorithm>
+#include "csv_format.h"
+
+namespace zerosum {
+
+namespace output {
+
+CsvFormatter::CsvFormatter(const std::string& hostname, uint32_t rank,
+    uint32_t shmrank) : buffer(64*1024) {
+    prefix = "\"" + hostname + "\"," + std::to_string(rank) + "," +
+        std::to_string(shmrank) + ",";
+}
+
+void CsvFormatter::header(void) {
+    const char h[] = "\"hostname\",\"rank\",\"shmrank\",\"step\",\"resource\",\"type\",\"index\",\"name\",\"value\"\n";
+    append(h, sizeof(h)-1);
+}
+
+void CsvFormatter::reserve(size_t n) {
+    if (buffer.size() - used < n) {
+        buffer.resize(std::max(buffer.size() * 2, used + n));
+    }
+}
+
+void CsvFormatter::append(const char * s, size_t n) {
+    reserve(n);
+    memcpy(buffer.data() + used, s, n);
+    used += n;
+}
+
+void CsvFormatter::number(uint64_t v) {
+    reserve(24);
+    auto result = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), v);
+    used = result.ptr - buffer.data();
+}
+
+/* The same digits as printf("%f") */
+void CsvFormatter::real(double v) {
+    reserve(350);
+    auto result = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(),
+        v, std::chars_format::fixed, 6);
+    used = result.ptr - buffer.data();
+}
+
+/* Metric names are looked up (under a lock) and quoted once */
+const std::string& CsvFormatter::quotedName(series::metric_id id) {
+    if (id >= names.size()) { names.resize(id + 1); }
+    if (names[id].empty()) {
+        names[id] = ",\"" + series::Metrics::name(id) + "\",\"";
+    }
+    return names[id];
+}
+
+void CsvFormatter::operator()(const Record& r) {
+    append(prefix);
+    number(r.step);
+    append(",\"", 2);
+    append(r.resource, strlen(r.resource));
+    append("\",\"", 3);
+    append(r.type, strlen(r.type));
+    append("\",\"", 3);
+    number(r.index);
+    append("\"", 1);
+    append(quotedName(r.metric));
+    if (r.text != nullptr) {
+        append(*(r.text));
+    } else {
+        switch (r.kind) {
+            case series::Kind::State: {
+                char c = (char)(r.value.u);
+                if (c != '\0') { append(&c, 1); }
+                break;
+            }
+            case series::Kind::Double:
+                real(r.value.d);
+                break;
+            case series::Kind::Unsigned:
+            default:
+                number(r.value.u);
+                break;
+        }
+    }
+    append("\"\n", 2);
+}
+
+} // namespace output
+
+} // namespace zerosum
@@ -0,0 +1,66 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "output_record.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* Formats records as the rows of zs.data.<rank>.csv:
+ *   "hostname",rank,shmrank,step,"resource","type","index","name","value"
+ * into a buffer that is reused from one period to the next. */
+class CsvFormatter {
+public:
+    CsvFormatter(const std::string& hostname, uint32_t rank, uint32_t shmrank);
+    void header(void);
+    void operator()(const Record& r);
+    const char * data(void) const { return buffer.data(); }
+    size_t size(void) const { return used; }
+    void clear(void) { used = 0; }
+    void finish(void) {}
+    void close(void) {}
+    std::string str(void) const { return std::string(buffer.data(), used); }
+private:
+    void reserve(size_t n);
+    void append(const char * s, size_t n);
+    void append(const std::string& s) { append(s.data(), s.size()); }
+    void number(uint64_t v);
+    void real(double v);
+    const std::string& quotedName(series::metric_id id);
+    std::string prefix;
+    std::vector<std::string> names;
+    std::vector<char> buffer;
+    size_t used{0};
+};
+
+} // namespace output
+
+} // namespace zerosum
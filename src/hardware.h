@@ -34,6 +34,8 @@
 #include <iostream>
 #include "utils.h"
 #include "perfstubs.h"
+#include "timeseries.h"
+#include "plugins.h"
 #include "zerosum.h"
 
 namespace zerosum {
@@ -49,101 +51,79 @@ public:
     HWT() = default;
     ~HWT() = default;
     uint32_t id;
-    std::map<std::string, std::vector<std::string>> stat_fields;
-    std::vector<uint32_t> steps;
-    void updateFields(std::map<std::string, std::string> fields, uint32_t step) {
-        for (auto f : fields) {
-            if (stat_fields.count(f.first) == 0) {
-                std::vector<std::string> v;
-                stat_fields.insert(std::pair(f.first, v));
-            }
-            // this might be a new thread that wasn't around before, if so
-            // make sure we have enough slots to account for previous steps.
-            while (stat_fields[f.first].size() < steps.size()) {
-                stat_fields[f.first].push_back("0");
-            }
-            stat_fields[f.first].push_back(f.second);
+    series::TimeSeries data;
+    void updateFields(const std::map<std::string, std::string>& fields, uint32_t step) {
+        data.begin(step);
+        for (auto& f : fields) {
+            data.set(f.first, f.second);
+#ifdef PERFSTUBS_USE_TIMERS
             std::string tmpstr{"HWT_" + std::to_string(id) + ":" + f.first};
             PERFSTUBS_SAMPLE_COUNTER_SIMPLE(tmpstr.c_str(), stof(f.second));
+#endif
         }
-        steps.push_back(step);
-    }
-    std::string strPercentage(std::string lhs, std::string rhs, std::string total_lhs, std::string total_rhs) {
-        unsigned a = atol(lhs.c_str());
-        unsigned b = atol(rhs.c_str());
-        unsigned result = a>b ? a-b : 0;
-        unsigned c = atol(total_lhs.c_str());
-        unsigned d = atol(total_rhs.c_str());
-        unsigned total = c>d ? c-d : 0;
-        unsigned percent = total>0 ? (result * 100)/total : 0;
-        std::string tmpstr{std::to_string(percent)};
-        return tmpstr;
+        data.end();
     }
-    std::string fieldsToCSV(std::string hostname, uint32_t rank, uint32_t shmrank, size_t& i) {
-        std::string tmpstr;
-        // iterate over steps
-        for ( ; i < steps.size() ; i++) {
-            for (auto sf : stat_fields) {
-                // did this field have a value for this step?
-                std::string value;
-                std::string prev_value;
-                std::string total;
-                std::string prev_total;
-                try {
-                    value = sf.second.at(i);
-                    total = stat_fields["total_time"].at(i);
-                    prev_value = sf.second.at(i-1);
-                    prev_total = stat_fields["total_time"].at(i-1);
-                } catch (...) {
-                    continue;
-                }
-                tmpstr += "\"" + hostname + "\",";
-                tmpstr += std::to_string(rank) + ",";
-                tmpstr += std::to_string(shmrank) + ",";
-                tmpstr += std::to_string(steps.at(i)) + ",";
-                tmpstr += "\"HWT\",\"Metric\",";
-                tmpstr += "\"" + std::to_string(id) + "\",";
-                tmpstr += "\"" + sf.first + "\",";
-                std::string percent = strPercentage(value, prev_value, total, prev_total);
-                //std::cout << sf.first << " " << value << " " << prev_value << " " << total << " " << prev_total << " " << " " << percent << std::endl;
-                tmpstr += "\"" + percent + "\"\n";
-            }
+    void updateFields(const cpu_stat_t& stat, uint32_t step) {
+        static const std::array<series::metric_id,14> ids{
+            series::Metrics::intern("user"),
+            series::Metrics::intern("nice"),
+            series::Metrics::intern("system"),
+            series::Metrics::intern("system_all"),
+            series::Metrics::intern("idle"),
+            series::Metrics::intern("idle_all"),
+            series::Metrics::intern("iowait"),
+            series::Metrics::intern("irq"),
+            series::Metrics::intern("softirq"),
+            series::Metrics::intern("steal"),
+            series::Metrics::intern("guest"),
+            series::Metrics::intern("virt_all_time"),
+            series::Metrics::intern("guest_nice"),
+            series::Metrics::intern("total_time")};
+        uint64_t idle_all_time = stat.idle + stat.iowait;
+        uint64_t system_all_time = stat.system + stat.irq + stat.softirq;
+        uint64_t virt_all_time = stat.guest + stat.guest_nice;
+        uint64_t total_time = stat.user + stat.nice + system_all_time +
+            idle_all_time + stat.steal + virt_all_time;
+        const std::array<uint64_t,14> values{
+            stat.user, stat.nice, stat.system, system_all_time,
+            stat.idle, idle_all_time, stat.iowait, stat.irq,
+            stat.softirq, stat.steal, stat.guest, virt_all_time,
+            stat.guest_nice, total_time};
+        data.begin(step);
+        for (size_t f = 0 ; f < ids.size() ; f++) {
+            data.set(ids[f], values[f]);
+#ifdef PERFSTUBS_USE_TIMERS
+            std::string tmpstr{"HWT_" + std::to_string(id) + ":" +
+                series::Metrics::name(ids[f])};
+            PERFSTUBS_SAMPLE_COUNTER_SIMPLE(tmpstr.c_str(), (double)values[f]);
+#endif
         }
-        return tmpstr;
-    }
-    std::string strSub(std::string lhs, std::string rhs, double& total) {
-        unsigned a = atol(lhs.c_str());
-        unsigned b = atol(rhs.c_str());
-        //double ticks = sysconf(_SC_CLK_TCK);
-        //std::string tmpstr{std::to_string((a-b)/ticks)};
-        unsigned result = a>b ? a-b : 0;
-        total += result;
-        std::string tmpstr{std::to_string(result)};
-        return tmpstr;
+        data.end();
     }
     std::string getFields() {
         std::string tmpstr;
-        for (auto sf : stat_fields) {
+        for (auto c : data.sorted()) {
             tmpstr += "\t";
-            tmpstr += sf.first;
+            tmpstr += c->name();
             tmpstr += ": ";
-            bool comma = false;
-            double total = 0;
-            if (sf.first.compare("step") != 0) {
-                auto previous = sf.second[0];
-                for (auto v : sf.second) {
+            std::string history{c->historyToString(true)};
+            bool comma = !history.empty();
+            tmpstr += history;
+            if (c->name().compare("step") != 0) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += strSub(v,previous,total);
+                    tmpstr += std::to_string(c->delta(i));
                     comma = true;
-                    previous = v;
                 }
                 tmpstr += " average: ";
-                double average = total/(double)(std::max(size_t(1),sf.second.size()-1));
+                series::Aggregate s{c->summary()};
+                double average = s.deltas.sum/(double)(std::max(size_t(1),c->size()-1));
                 tmpstr += std::to_string(average);
+                tmpstr += " stddev: " + std::to_string(s.deltas.stddev());
             } else {
-                for (auto v : sf.second) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += v;
+                    tmpstr += c->toString(i);
                     comma = true;
                 }
             }
@@ -154,18 +134,13 @@ public:
     std::string getSummary() {
         std::string tmpstr;
         bool comma = false;
-        for (auto sf : stat_fields) {
-            if (sf.first.compare("step") != 0) {
+        for (auto c : data.sorted()) {
+            if (c->name().compare("step") != 0) {
                 if (comma) { tmpstr += ","; }
-                tmpstr += " " + sf.first;
+                tmpstr += " " + c->name();
                 tmpstr += ": ";
-                double total = 0;
-                auto previous = sf.second[0];
-                for (auto v : sf.second) {
-                    strSub(v,previous,total);
-                    previous = v;
-                }
-                double average = total/(double)(std::max(size_t(1),sf.second.size()-1));
+                double total = c->summary().deltas.sum;
+                double average = total/(double)(std::max(size_t(1),c->size()-1));
                 char tmp[256] = {0};
                 snprintf(tmp, 255, "%6.2f", average);
                 tmpstr += tmp;
@@ -188,103 +163,60 @@ public:
     uint32_t id;
     std::string timerPrefix;
     std::map<std::string, std::string> properties;
-    std::map<std::string, std::vector<std::string>> stat_fields;
-    std::vector<uint32_t> steps;
-    void updateFields(std::map<std::string, std::string> fields, uint32_t step) {
-        for (auto f : fields) {
-            if (stat_fields.count(f.first) == 0) {
-                std::vector<std::string> v;
-                stat_fields.insert(std::pair(f.first, v));
-            }
-            stat_fields[f.first].push_back(f.second);
+    series::TimeSeries data;
+    void updateFields(const std::map<std::string, std::string>& fields, uint32_t step) {
+        data.begin(step);
+        for (auto& f : fields) {
+            data.set(f.first, f.second);
+#ifdef PERFSTUBS_USE_TIMERS
             std::string tmpstr{timerPrefix + f.first};
             PERFSTUBS_SAMPLE_COUNTER_SIMPLE(tmpstr.c_str(), stof(f.second));
+#endif
         }
-        steps.push_back(step);
-    }
-    std::string strSub(std::string lhs, std::string rhs, double& total) {
-        unsigned a = atol(lhs.c_str());
-        unsigned b = atol(rhs.c_str());
-        //double ticks = sysconf(_SC_CLK_TCK);
-        //std::string tmpstr{std::to_string((a-b)/ticks)};
-        unsigned result = a>b ? a-b : 0;
-        total += result;
-        std::string tmpstr{std::to_string(result)};
-        return tmpstr;
+        data.end();
     }
-    std::string fieldsToCSV(std::string hostname, uint32_t rank, uint32_t shmrank, size_t& i ) {
-        std::string tmpstr;
-        // get static properties
-        if (i == 0) {
-            for (auto sf : properties) {
-                tmpstr += "\"" + hostname + "\",";
-                tmpstr += std::to_string(rank) + ",";
-                tmpstr += std::to_string(shmrank) + ",";
-                tmpstr += std::to_string(0) + ",";
-                tmpstr += "\"GPU\",\"Property\",";
-                tmpstr += "\"" + std::to_string(id) + "\",";
-                tmpstr += "\"" + sf.first + "\",";
-                tmpstr += "\"" + sf.second + "\"\n";
-            }
-        }
-        // iterate over steps
-        for ( ; i < steps.size() ; i++) {
-            // for each field...
-            for (auto sf : stat_fields) {
-                // did this field have a value for this step?
-                std::string value;
-                try {
-                    value = sf.second.at(i);
-                } catch (...) {
-                    continue;
-                }
-                tmpstr += "\"" + hostname + "\",";
-                tmpstr += std::to_string(rank) + ",";
-                tmpstr += std::to_string(shmrank) + ",";
-                tmpstr += std::to_string(steps.at(i)) + ",";
-                tmpstr += "\"GPU\",\"Metric\",";
-                tmpstr += "\"" + std::to_string(id) + "\",";
-                tmpstr += "\"" + sf.first + "\",";
-                tmpstr += "\"" + value + "\"\n";
-            }
-        }
-        return tmpstr;
+    /* These GPU metrics are monotonic counters, report the deltas */
+    bool isCounter(const std::string& name) {
+        return (name.compare("Energy Average (J)") == 0 ||
+                name.compare("GFX Activity %") == 0 ||
+                name.compare("Memory Activity %") == 0);
     }
     std::string getFields() {
         std::string tmpstr;
-        for (auto p : properties) {
+        for (auto& p : properties) {
                 tmpstr += "\t" + p.first;
                 tmpstr += ": " + p.second + "\n";
         }
-        for (auto sf : stat_fields) {
+        for (auto c : data.sorted()) {
             tmpstr += "\t";
-            tmpstr += sf.first;
+            tmpstr += c->name();
             tmpstr += ": ";
-            bool comma = false;
-            double total = 0;
-            if (sf.first.compare("Energy Average (J)") == 0 ||
-                sf.first.compare("GFX Activity %") == 0 ||
-                sf.first.compare("Memory Activity %") == 0) {
-                auto previous = sf.second[0];
-                for (auto v : sf.second) {
+            bool counter = isCounter(c->name());
+            std::string history{c->historyToString(counter)};
+            bool comma = !history.empty();
+            tmpstr += history;
+            if (counter) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += strSub(v,previous,total);
+                    tmpstr += std::to_string(c->delta(i));
                     comma = true;
-                    previous = v;
                 }
                 tmpstr += " average: ";
-                double average = total/(double)(std::max(size_t(1),sf.second.size()-1));
+                series::Aggregate s{c->summary()};
+                double average = s.deltas.sum/(double)(std::max(size_t(1),c->size()-1));
                 tmpstr += std::to_string(average);
+                tmpstr += " stddev: " + std::to_string(s.deltas.stddev());
             } else {
-                for (auto v : sf.second) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += v;
+                    tmpstr += c->toString(i);
                     comma = true;
-                    total += atof(v.c_str());
                 }
                 tmpstr += " average: ";
-                double average = total/(double)(std::max(size_t(1),sf.second.size()));
+                series::Aggregate s{c->summary()};
+                double average = s.values.sum/(double)(std::max(size_t(1),c->size()));
                 tmpstr += std::to_string(average);
+                tmpstr += " stddev: " + std::to_string(s.values.stddev());
             }
             tmpstr += "\n";
         }
@@ -292,39 +224,23 @@ public:
     }
     std::string getSummary() {
         std::string tmpstr;
-        for (auto sf : stat_fields) {
+        for (auto c : data.sorted()) {
             tmpstr += "\t";
-            tmpstr += sf.first;
+            tmpstr += c->name();
             tmpstr += ": ";
-            double total = 0;
-            double _min = stod(sf.second[0]);
-            double _max = stod(sf.second[0]);
-            if (sf.first.compare("Energy Average (J)") == 0 ||
-                sf.first.compare("GFX Activity %") == 0 ||
-                sf.first.compare("Memory Activity %") == 0) {
-                auto previous = sf.second[0];
-                _min = 0.0;
-                _max = 0.0;
-                for (auto v : sf.second) {
-                    auto tmp = strSub(v,previous,total);
-                    previous = v;
-                    _max = std::max(_max,stod(tmp));
-                    _min = std::min(_min,stod(tmp));
-                }
-                double average = total/(double)(std::max(size_t(1),sf.second.size()-1));
-                tmpstr += std::to_string(_min) + " " +
+            series::Aggregate s{c->summary()};
+            if (isCounter(c->name())) {
+                double average = s.deltas.sum/(double)(std::max(size_t(1),c->size()-1));
+                tmpstr += std::to_string(s.deltas.min) + " " +
                           std::to_string(average) + " " +
-                          std::to_string(_max);
+                          std::to_string(s.deltas.max) + " " +
+                          std::to_string(s.deltas.stddev());
             } else {
-                for (auto v : sf.second) {
-                    total += atof(v.c_str());
-                    _max = std::max(_max,stod(v));
-                    _min = std::min(_min,stod(v));
-                }
-                double average = total/(double)(std::max(size_t(1),sf.second.size()));
-                tmpstr += std::to_string(_min) + " " +
+                double average = s.values.sum/(double)(std::max(size_t(1),c->size()));
+                tmpstr += std::to_string(s.values.min) + " " +
                           std::to_string(average) + " " +
-                          std::to_string(_max);
+                          std::to_string(s.values.max) + " " +
+                          std::to_string(s.values.stddev());
             }
             tmpstr += "\n";
         }
@@ -337,8 +253,8 @@ public:
         std::string mem3{"TotalMem (bytes)"};
         std::string mem4{"FreeMem (bytes)"};
         bool first{true};
-        for (auto sf : stat_fields) {
-            std::string name{sf.first};
+        for (auto c : data.sorted()) {
+            std::string name{c->name()};
             std::string::size_type i = name.find(mem);
             std::string::size_type i2 = name.find(mem2);
             std::string::size_type i3 = name.find(mem3);
@@ -349,7 +265,7 @@ public:
                 if (!first) tmpstr += ", ";
                 tmpstr += name;
                 tmpstr += "= ";
-                double value = std::stod(sf.second.back());
+                double value = c->last();
                 tmpstr += std::to_string(value / giga);
                 first = false;
             }
@@ -359,7 +275,7 @@ public:
                 if (!first) tmpstr += ", ";
                 tmpstr += name;
                 tmpstr += "= ";
-                double value = std::stod(sf.second.back());
+                double value = c->last();
                 tmpstr += std::to_string(value / giga);
                 first = false;
             }
@@ -369,7 +285,7 @@ public:
                 if (!first) tmpstr += ", ";
                 tmpstr += name;
                 tmpstr += "= ";
-                double value = std::stod(sf.second.back());
+                double value = c->last();
                 tmpstr += std::to_string(value / giga);
                 first = false;
             }
@@ -378,6 +294,17 @@ public:
     }
 };
 
+/* A NUMA node, with its meminfo and numastat from
+ * /sys/devices/system/node/node<id> */
+class NUMA {
+public:
+    NUMA(uint32_t _id) : id(_id) {}
+    NUMA() = default;
+    ~NUMA() = default;
+    uint32_t id;
+    series::TimeSeries data;
+};
+
 class ComputeNode {
 public:
     ComputeNode(std::string _name, bool details = false) :
@@ -394,59 +321,106 @@ public:
     unsigned ncpus;
     std::vector<HWT> hwThreads;
     std::vector<GPU> gpus;
+    std::vector<NUMA> numaNodes;
     bool doDetails;
-    std::map<std::string, std::vector<std::string>> stat_fields;
-    std::vector<uint32_t> steps;
-    /* Update the node-level properties */
-    void updateNodeFields(std::map<std::string, std::string> fields, uint32_t step) {
-        for (auto f : fields) {
-            if (stat_fields.count(f.first) == 0) {
-                std::vector<std::string> v;
-                stat_fields.insert(std::pair(f.first, v));
+    /* The NODE collector's samples, a row each time it runs */
+    series::TimeSeries data;
+    /* When each step was sampled, a row every step. Kept apart from the
+     * collectors, so their series only have the rows they sampled. */
+    series::TimeSeries clock;
+    /* The values of the node plugins */
+    void updateNodeFields(const std::vector<plugin_value_t>& values, uint32_t step) {
+        if (values.empty()) { return; }
+        data.begin(step);
+        for (auto& v : values) { setPluginValue(data, v); }
+        data.end();
+    }
+    /* The values of MemoryFiles, with the IDs of its names */
+    void updateMemory(const std::vector<series::metric_id>& ids,
+        const std::vector<uint64_t>& values, uint32_t step) {
+        if (values.size() != ids.size()) { return; }
+        data.begin(step);
+        for (size_t i = 0 ; i < ids.size() ; i++) {
+            data.set(ids[i], values[i]);
+        }
+        data.end();
+    }
+    void updateNUMA(const std::vector<uint32_t>& nodes,
+        const std::vector<series::metric_id>& ids,
+        const std::vector<uint64_t>& values, uint32_t step) {
+        if (values.size() != nodes.size() * ids.size()) { return; }
+        if (numaNodes.size() != nodes.size()) {
+            numaNodes.clear();
+            for (auto id : nodes) { numaNodes.push_back(NUMA(id)); }
+        }
+        const uint64_t * v = values.data();
+        for (auto& numa : numaNodes) {
+            numa.data.begin(step);
+            for (size_t i = 0 ; i < ids.size() ; i++) {
+                numa.data.set(ids[i], *v++);
             }
-            stat_fields[f.first].push_back(f.second);
+            numa.data.end();
         }
-        steps.push_back(step);
+    }
+    /* When each step was actually sampled, in seconds since the start */
+    void updateTime(double seconds, uint32_t step) {
+        static const series::metric_id time{series::Metrics::intern("time")};
+        clock.begin(step);
+        clock.set(time, seconds);
+        clock.end();
     }
     void addGpu(std::vector<std::map<std::string,std::string>> props) {
         gpus.reserve(props.size());
-        for (auto p : props) {
+        for (auto& p : props) {
             gpus.push_back(GPU(p));
         }
     }
-    void updateGPU(std::vector<std::map<std::string,std::string>> fields, uint32_t step) {
+    void updateGPU(const std::vector<std::map<std::string,std::string>>& fields, uint32_t step) {
         for (unsigned index = 0 ; index < gpus.size() ; index++) {
             gpus[index].updateFields(fields[index], step);
         }
     }
     /* Update the hwthread-level properties */
-    void updateFields(std::vector<std::map<std::string,std::string>> fields, uint32_t step) {
+    void updateFields(const std::vector<std::map<std::string,std::string>>& fields, uint32_t step) {
         for (unsigned index = 0 ; index < ncpus ; index++) {
             hwThreads[index].updateFields(fields[index], step);
         }
     }
+    void updateFields(const std::vector<cpu_stat_t>& stats, size_t count, uint32_t step) {
+        for (size_t index = 0 ; index < count ; index++) {
+            const cpu_stat_t& stat = stats[index];
+            if (stat.id < hwThreads.size()) {
+                hwThreads[stat.id].updateFields(stat, step);
+            }
+        }
+    }
     std::string getFields() {
         std::string tmpstr;
-        for (auto sf : stat_fields) {
+        std::vector<const series::Column*> columns{clock.sorted()};
+        for (auto c : data.sorted()) { columns.push_back(c); }
+        for (auto c : columns) {
             tmpstr += "\t";
-            tmpstr += sf.first;
+            tmpstr += c->name();
             tmpstr += ": ";
-            bool comma = false;
-            double total = 0;
-            if (sf.first.compare("step") != 0) {
-                for (auto v : sf.second) {
+            std::string history{c->historyToString(false)};
+            bool comma = !history.empty();
+            tmpstr += history;
+            // the step and time are the x axis, they don't have an average
+            if (c->name().compare("step") != 0 && c->name().compare("time") != 0) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += v;
-                    total += atof(v.c_str());
+                    tmpstr += c->toString(i);
                     comma = true;
                 }
                 tmpstr += " average: ";
-                double average = total/(double)(std::max(size_t(1),sf.second.size()-1));
+                series::Aggregate s{c->summary()};
+                double average = s.values.sum/(double)(std::max(size_t(1),c->size()-1));
                 tmpstr += std::to_string(average);
+                tmpstr += " stddev: " + std::to_string(s.values.stddev());
             } else {
-                for (auto v : sf.second) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += v;
+                    tmpstr += c->toString(i);
                     comma = true;
                 }
             }
@@ -456,60 +430,11 @@ public:
         return tmpstr;
     }
 
-    std::string fieldsToCSV(uint32_t rank, uint32_t shmrank, size_t& i) {
-        std::string tmpstr;
-        // iterate over steps
-        for ( ; i < steps.size() ; i++) {
-            // for each field...
-            for (auto sf : stat_fields) {
-                // did this field have a value for this step?
-                std::string value;
-                try {
-                    value = sf.second.at(i);
-                } catch (...) {
-                    continue;
-                }
-                tmpstr += "\"" + name + "\",";
-                tmpstr += std::to_string(rank) + ",";
-                tmpstr += std::to_string(shmrank) + ",";
-                tmpstr += std::to_string(steps.at(i)) + ",";
-                tmpstr += "\"Node\",\"Property\",";
-                tmpstr += "\"0\",";
-                tmpstr += "\"" + sf.first + "\",";
-                tmpstr += "\"" + value + "\"\n";
-            }
-        }
-        return tmpstr;
-    }
-
-    std::string toCSV(std::set<uint32_t> hwthreads, uint32_t rank, uint32_t shmrank, size_t& lastStepWritten) {
-        std::string outstr{"\"hostname\",\"rank\",\"shmrank\",\"step\",\"resource\",\"type\",\"index\",\"name\",\"value\"\n"};
-        auto saveme = lastStepWritten;
-        outstr += fieldsToCSV(rank, shmrank, lastStepWritten);
-        uint32_t index{0};
-        for (auto hwt : hwThreads) {
-            if (hwthreads.count(index++) > 0) {
-                lastStepWritten = saveme;
-                outstr += hwt.fieldsToCSV(name, rank, shmrank, lastStepWritten);
-            }
-        }
-        for (auto gpu : gpus) {
-            lastStepWritten = saveme;
-            outstr += gpu.fieldsToCSV(name, rank, shmrank, lastStepWritten);
-        }
-        return outstr;
-    }
-    // default value version for writing final data
-    std::string toCSV(std::set<uint32_t> hwthreads, uint32_t rank, uint32_t shmrank) {
-        size_t lastStepWritten{0};
-        return toCSV(hwthreads, rank, shmrank, lastStepWritten);
-    }
-
     std::string toString(std::set<uint32_t> hwthreads) {
         std::string outstr{"\nHardware Summary:\n\n"};
         outstr += getFields();
         uint32_t index{0};
-        for (auto hwt : hwThreads) {
+        for (auto& hwt : hwThreads) {
             if (hwthreads.count(index++) > 0) {
                 outstr += "CPU";
                 outstr += std::to_string(hwt.id);
@@ -517,8 +442,8 @@ public:
                 outstr += hwt.getFields();
             }
         }
-        for (auto gpu : gpus) {
-            outstr += "GPU " + gpu.properties["RT_GPU_ID"] + " - (metric: min  avg  max)\n";
+        for (auto& gpu : gpus) {
+            outstr += "GPU " + gpu.properties["RT_GPU_ID"] + " - (metric: min  avg  max  stddev)\n";
             outstr += gpu.getFields();
             outstr += "\n";
         }
@@ -527,7 +452,7 @@ public:
     std::string getSummary(std::set<uint32_t> hwthreads) {
         std::string outstr{"\nHardware Summary:\n"};
         size_t len = 3;
-        for (auto hwt : hwThreads) {
+        for (auto& hwt : hwThreads) {
             if (hwthreads.count(hwt.id) > 0) {
                 std::string tmp = std::to_string(hwt.id);
                 int precision = len - std::min(len,tmp.size());
@@ -537,14 +462,14 @@ public:
                 outstr += "\n";
             }
         }
-        for (auto gpu : gpus) {
-            outstr += "GPU " + gpu.properties["RT_GPU_ID"] + " - (metric: min  avg  max)\n";
+        for (auto& gpu : gpus) {
+            outstr += "GPU " + gpu.properties["RT_GPU_ID"] + " - (metric: min  avg  max  stddev)\n";
             outstr += gpu.getSummary();
             outstr += "\n";
         }
         if (doDetails) {
             outstr += "\nOther Hardware:\n";
-            for (auto hwt : hwThreads) {
+            for (auto& hwt : hwThreads) {
                 if (hwthreads.count(hwt.id) == 0) {
                     std::string tmp = std::to_string(hwt.id);
                     int precision = len - std::min(len,tmp.size());
@@ -562,22 +487,36 @@ public:
         std::string kB{" kB"};
         std::string tmpstr{"CPU " + mem + " (GB): "};
         bool first{true};
-        for (auto sf : stat_fields) {
-            std::string name{sf.first};
+        for (auto c : data.sorted()) {
+            std::string name{c->name()};
             std::string::size_type i = name.find(mem);
-            if (i != std::string::npos) {
+            std::string::size_type k = name.find(kB);
+            // only the meminfo sizes, a plugin metric can be called "MemBW"
+            if (i != std::string::npos && k != std::string::npos) {
+                name.erase(k, kB.length());
                 name.erase(i, mem.length());
                 if (!first) tmpstr += ", ";
-                i = name.find(kB);
-                name.erase(i, kB.length());
                 tmpstr += name;
                 tmpstr += " = ";
-                double value = std::stod(sf.second.back());
+                double value = c->last();
                 tmpstr += std::to_string(value / mega);
                 first = false;
             }
         }
-        for (auto gpu : gpus) {
+        // a full NUMA node spills to the others, or to swap
+        static const series::metric_id numaFree{series::Metrics::intern("MemFree kB")};
+        if (numaNodes.size() > 1) {
+            tmpstr += "\nNUMA MemFree (GB): ";
+            first = true;
+            for (auto& numa : numaNodes) {
+                const series::Column* c = numa.data.find(numaFree);
+                if (c == nullptr || c->empty()) { continue; }
+                if (!first) tmpstr += ", ";
+                tmpstr += std::to_string(numa.id) + " = " + std::to_string(c->last() / mega);
+                first = false;
+            }
+        }
+        for (auto& gpu : gpus) {
             tmpstr += gpu.reportMemory();
         }
         tmpstr += "\n";
@@ -90,24 +90,7 @@ static const char *sprintf_chip_name(const sensors_chip_name *name)
 
 sensor_data::sensor_data()
 {
-   sensors_init(nullptr);
-}
-
-sensor_data::~sensor_data()
-{
-    sensors_cleanup();
-}
-
-string sensor_data::get_version()
-{
-    ostringstream Converter;
-    Converter<<"Version: "<<libsensors_version;
-    return Converter.str();
-}
-
-std::map<std::string,std::string> sensor_data::read_sensors()
-{
-    std::map<std::string,std::string> fields;
+    if (sensors_init(nullptr) != 0) { return; }
     sensors_chip_name const * cn;
     int c = 0;
     while ((cn = sensors_get_detected_chips(0, &c)) != 0) {
@@ -118,29 +101,87 @@ std::map<std::string,std::string> sensor_data::read_sensors()
             sensors_subfeature const *subf;
             int s = 0;
             while ((subf = sensors_get_all_subfeatures(cn, feat, &s)) != 0) {
-                if (subf->type == feat->type << 8) {  // we only want inputs
+                if (subf->type == feat->type << 8 &&  // we only want inputs
+                    (subf->flags & SENSORS_MODE_R)) {
                     std::stringstream ss;
                     ss << feature_name[feat->type] << ": ";
                     ss << sprintf_chip_name(cn) << ", ";
                     ss << label << " (";
                     ss << feature_units[feat->type] << ")";
-                    double val;
-                    if (subf->flags & SENSORS_MODE_R) {
-                        int rc = sensors_get_value(cn, subf->number, &val);
-                        if (rc < 0) {
-                            // some error
-                        } else {
-                            //apex::sample_value(ss.str(), val);
-                            //printf("%s = %f\n", ss.str().c_str(), val);
-                            fields.insert(std::pair<std::string,std::string>(ss.str(),std::to_string(val)));
-                        }
-                    }
+                    inputs.push_back(std::make_pair(cn, subf->number));
+                    names.push_back(ss.str());
                 }
             }
             free(label);
         }
     }
-    return fields;
+    // the names don't move once they are all added
+    for (auto& n : names) {
+        metrics.push_back(zs_plugin_metric_t{n.c_str(), ZS_PLUGIN_DOUBLE});
+    }
+}
+
+sensor_data::~sensor_data()
+{
+    sensors_cleanup();
+}
+
+string sensor_data::get_version()
+{
+    ostringstream Converter;
+    Converter<<"Version: "<<libsensors_version;
+    return Converter.str();
+}
+
+size_t sensor_data::describe(const zs_plugin_metric_t ** out) {
+    *out = metrics.data();
+    return metrics.size();
+}
+
+int sensor_data::read_sensors(zs_plugin_value_t * values, size_t count)
+{
+    if (count < inputs.size()) return -1;
+    for (size_t i = 0 ; i < inputs.size() ; i++) {
+        double val;
+        // on an error, the previous value is kept
+        if (sensors_get_value(inputs[i].first, inputs[i].second, &val) >= 0) {
+            values[i].d = val;
+        }
+    }
+    return (int)inputs.size();
+}
+
+namespace {
+
+int lm_sensors_init(void ** context) {
+    sensor_data * sensors = new sensor_data();
+    if (!sensors->is_supported()) {
+        delete sensors;
+        return -1;
+    }
+    *context = sensors;
+    return 0;
+}
+
+size_t lm_sensors_describe(void * context, const zs_plugin_metric_t ** metrics) {
+    return ((sensor_data*)context)->describe(metrics);
+}
+
+int lm_sensors_sample(void * context, zs_plugin_value_t * values, size_t count) {
+    return ((sensor_data*)context)->read_sensors(values, count);
+}
+
+void lm_sensors_finalize(void * context) {
+    delete (sensor_data*)context;
+}
+
+const zs_plugin_t plugin{ZEROSUM_PLUGIN_ABI_VERSION, "lm_sensors", ZS_PLUGIN_NODE,
+    0.0, lm_sensors_init, lm_sensors_describe, lm_sensors_sample, lm_sensors_finalize};
+
+} // anonymous namespace
+
+const zs_plugin_t * lm_sensors_plugin(void) {
+    return &plugin;
 }
 
 }
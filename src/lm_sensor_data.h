@@ -25,7 +25,10 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <vector>
+#include "zerosum_plugin.h"
+
+struct sensors_chip_name;
 
 namespace zerosum {
 
@@ -34,8 +37,17 @@ class sensor_data {
         sensor_data(void);
         ~sensor_data(void);
         std::string get_version(void);
-        std::map<std::string,std::string> read_sensors(void);
+        bool is_supported(void) const { return !inputs.empty(); }
+        size_t describe(const zs_plugin_metric_t ** out);
+        int read_sensors(zs_plugin_value_t * values, size_t count);
+    private:
+        // the inputs of the sensors, found once
+        std::vector<std::pair<const sensors_chip_name *, int>> inputs;
+        std::vector<std::string> names;
+        std::vector<zs_plugin_metric_t> metrics;
 };
 
-}
+/* The lm-sensors inputs, as a built-in node plugin */
+const zs_plugin_t * lm_sensors_plugin(void);
 
+}
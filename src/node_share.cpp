@@ -0,0 +1,313 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include "node_share.h"
+
+namespace zerosum {
+
+namespace {
+
+constexpr uint32_t magic{0x7a736e73}; // "zsns"
+constexpr uint32_t version{5};
+// the node plugin values, serialized as "name\0", a kind byte and the
+// eight bytes of the value, because the metric IDs differ between ranks
+constexpr size_t textCapacity{32*1024};
+// the memory values, node then NUMA
+constexpr size_t memoryCapacity{4096};
+constexpr uint32_t notShared{UINT32_MAX};
+constexpr int retries{100};
+
+uint64_t monotonic(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+uint32_t serialize(const std::vector<plugin_value_t>& values, char * out) {
+    size_t used{0};
+    for (auto& v : values) {
+        const std::string& name = series::Metrics::name(v.id);
+        size_t length = name.size() + 1 + 1 + sizeof(v.value);
+        if (used + length > textCapacity) { return notShared; }
+        memcpy(out + used, name.c_str(), name.size() + 1);
+        used += name.size() + 1;
+        out[used++] = (char)v.kind;
+        memcpy(out + used, &(v.value), sizeof(v.value));
+        used += sizeof(v.value);
+    }
+    return (uint32_t)used;
+}
+
+void deserialize(const std::vector<char>& in, size_t length,
+    std::vector<plugin_value_t>& values) {
+    values.clear();
+    const char * p = in.data();
+    const char * end = p + length;
+    while (p < end) {
+        const char * kind = p + strnlen(p, end - p) + 1;
+        if (kind + 1 + sizeof(zs_plugin_value_t) > end) { break; }
+        plugin_value_t v;
+        v.id = series::Metrics::intern(std::string(p, kind - p - 1));
+        v.kind = (zs_plugin_kind_t)(*kind);
+        memcpy(&(v.value), kind + 1, sizeof(v.value));
+        values.push_back(v);
+        p = kind + 1 + sizeof(zs_plugin_value_t);
+    }
+}
+
+} // anonymous namespace
+
+/* The segment starts with this header, followed by capacity cpu_stat_t,
+ * a text area of textCapacity bytes and memoryCapacity memory values.
+ * The sequence is odd while the publisher writes, readers retry if it
+ * was odd or has changed. */
+struct NodeShare::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;
+    uint64_t timestamp;
+    // the publisher's maxAge, for the readers
+    uint64_t maxAge;
+    uint32_t capacity;
+    uint32_t ncpus;
+    uint32_t textLength;
+    uint32_t nmemory;
+    uint32_t nnuma;
+};
+
+NodeShare::NodeShare(const std::string& key, bool _publisher, size_t ncpus,
+    uint64_t _maxAge) : publisher(_publisher), capacity(ncpus), maxAge(_maxAge),
+    lastTimestamp(monotonic()) {
+    // shm names can't contain slashes, and only the owner can read them
+    name = "/zerosum." + std::to_string(getuid()) + "." + key;
+    for (size_t i = 1 ; i < name.size() ; i++) {
+        if (name[i] == '/') { name[i] = '_'; }
+    }
+    size = sizeof(Header) + (capacity * sizeof(cpu_stat_t)) + textCapacity +
+        (memoryCapacity * sizeof(uint64_t));
+    if (publisher) { attach(); }
+}
+
+NodeShare::~NodeShare() {
+    detach();
+    // readers that still have it mapped will see the sample go stale
+    if (publisher) { shm_unlink(name.c_str()); }
+}
+
+char * NodeShare::cpuArea(void) const {
+    return (char *)segment + sizeof(Header);
+}
+
+char * NodeShare::textArea(void) const {
+    return cpuArea() + (header()->capacity * sizeof(cpu_stat_t));
+}
+
+uint64_t * NodeShare::memoryArea(void) const {
+    return (uint64_t *)(textArea() + textCapacity);
+}
+
+bool NodeShare::attach(void) {
+    if (segment != nullptr) { return true; }
+    int fd{-1};
+    if (publisher) {
+        // a segment left behind by a crashed run of the same job is reused
+        fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+        if (fd < 0 || ftruncate(fd, size) != 0) {
+            perror("Error creating the node sample segment");
+            if (fd >= 0) { close(fd); }
+            // don't try again every period
+            publisher = false;
+            return false;
+        }
+    } else {
+        // the publisher may not have started yet, try again next period
+        fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) { return false; }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)) {
+            close(fd);
+            return false;
+        }
+        // the publisher might see more cpus than this rank
+        size = info.st_size;
+    }
+    void * mapped = mmap(nullptr, size, publisher ? PROT_READ | PROT_WRITE : PROT_READ,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        if (publisher) {
+            perror("Error mapping the node sample segment");
+            publisher = false;
+        }
+        return false;
+    }
+    segment = mapped;
+    if (publisher) {
+        Header * h = header();
+        __atomic_store_n(&(h->sequence), 0, __ATOMIC_RELAXED);
+        h->timestamp = 0;
+        h->capacity = capacity;
+        h->version = version;
+        __atomic_store_n(&(h->magic), magic, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+void NodeShare::detach(void) {
+    if (segment != nullptr) { munmap(segment, size); }
+    segment = nullptr;
+}
+
+void NodeShare::publish(const node_sample_t& sample) {
+    if (!publisher || !attach()) { return; }
+    Header * h = header();
+    uint64_t sequence = __atomic_load_n(&(h->sequence), __ATOMIC_RELAXED);
+    __atomic_store_n(&(h->sequence), sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    // with more cpus than there is room for, the readers sample themselves
+    h->ncpus = sample.ncpus <= capacity ? sample.ncpus : notShared;
+    if (h->ncpus != notShared) {
+        memcpy(cpuArea(), sample.cpus.data(), sample.ncpus * sizeof(cpu_stat_t));
+    }
+    // too many NUMA nodes to share, the readers sample the memory themselves
+    if (sample.memory.size() + sample.numa.size() <= memoryCapacity) {
+        h->nmemory = sample.memory.size();
+        h->nnuma = sample.numa.size();
+        memcpy(memoryArea(), sample.memory.data(), h->nmemory * sizeof(uint64_t));
+        memcpy(memoryArea() + h->nmemory, sample.numa.data(), h->nnuma * sizeof(uint64_t));
+    } else {
+        h->nmemory = notShared;
+        h->nnuma = 0;
+    }
+    h->textLength = serialize(sample.plugins, textArea());
+    // when the sampling started, see read()
+    h->timestamp = lastTimestamp;
+    h->maxAge = maxAge;
+    __atomic_store_n(&(h->sequence), sequence + 2, __ATOMIC_RELEASE);
+}
+
+/* A sample is only used if it is newer than the last one this rank used,
+ * the shared one or its own, so the counters never go backwards and the
+ * same sample isn't used twice (which would look like an idle period). */
+bool NodeShare::read(node_sample_t& sample) {
+    uint64_t now = monotonic();
+    if (!publisher && copy(sample, now)) {
+        copied++;
+        return true;
+    }
+    // the caller samples the node itself, starting now
+    lastTimestamp = now;
+    sampled++;
+    return false;
+}
+
+std::string NodeShare::summary(void) const {
+    if (publisher) {
+        return "\nNode samples: " + std::to_string(sampled) +
+            " published for the other local ranks\n";
+    }
+    return "\nNode samples: " + std::to_string(copied) +
+        " copied from local rank 0, " + std::to_string(sampled) +
+        " sampled by this rank\n";
+}
+
+bool NodeShare::copy(node_sample_t& sample, uint64_t now) {
+    if (!attach()) { return false; }
+    Header * h = header();
+    if (__atomic_load_n(&(h->magic), __ATOMIC_ACQUIRE) != magic ||
+        h->version != version ||
+        sizeof(Header) + (h->capacity * sizeof(cpu_stat_t)) +
+        textCapacity + (memoryCapacity * sizeof(uint64_t)) > size) {
+        // not initialized yet, or a different build of zerosum
+        return false;
+    }
+    uint32_t length{0};
+    for (int attempt = 0 ; attempt < retries ; attempt++) {
+        uint64_t before = __atomic_load_n(&(h->sequence), __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        uint64_t timestamp = h->timestamp;
+        uint64_t oldest = std::max(maxAge, h->maxAge);
+        uint32_t ncpus = h->ncpus;
+        if (ncpus > h->capacity) { return false; }
+        if (sample.cpus.size() < ncpus) { sample.cpus.resize(ncpus); }
+        memcpy(sample.cpus.data(), cpuArea(), ncpus * sizeof(cpu_stat_t));
+        uint32_t nmemory = h->nmemory;
+        uint32_t nnuma = h->nnuma;
+        if (nmemory == notShared || nmemory + nnuma > memoryCapacity) { return false; }
+        sample.memory.resize(nmemory);
+        sample.numa.resize(nnuma);
+        memcpy(sample.memory.data(), memoryArea(), nmemory * sizeof(uint64_t));
+        memcpy(sample.numa.data(), memoryArea() + nmemory, nnuma * sizeof(uint64_t));
+        length = h->textLength;
+        // a torn read, or too much text to share
+        if (length > textCapacity) { return false; }
+        text.resize(textCapacity);
+        memcpy(text.data(), textArea(), length);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&(h->sequence), __ATOMIC_RELAXED) != before) {
+            continue;
+        }
+        // nothing new published, or the publisher has stopped
+        if (timestamp <= lastTimestamp ||
+            (now > timestamp && now - timestamp > oldest)) {
+            return false;
+        }
+        lastTimestamp = timestamp;
+        sample.ncpus = ncpus;
+        deserialize(text, length, sample.plugins);
+        return true;
+    }
+    return false;
+}
+
+std::string NodeShare::jobKey(void) {
+    const char * job = getenv("SLURM_JOB_ID");
+    if (job != nullptr) {
+        const char * step = getenv("SLURM_STEP_ID");
+        return std::string(job) + "." + (step == nullptr ? "0" : step);
+    }
+    // PALS, PBS, Flux, LSF, then PMIx (OpenMPI 5, PRRTE)
+    for (const char * var : {"PALS_APID", "PBS_JOBID", "FLUX_JOB_ID",
+        "LSB_JOBID", "PMIX_NAMESPACE", "OMPI_MCA_orte_ess_jobid"}) {
+        job = getenv(var);
+        if (job != nullptr) { return std::string(job); }
+    }
+    return std::string("");
+}
+
+} // namespace zerosum
@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "utils.h"
+#include "plugins.h"
+
+namespace zerosum {
+
+/* The node-wide samples, the same for every rank on the node */
+typedef struct node_sample {
+    std::vector<cpu_stat_t> cpus;
+    size_t ncpus{0};
+    // see MemoryFiles, empty if it couldn't be read
+    std::vector<uint64_t> memory;
+    std::vector<uint64_t> numa;
+    // the values of the node plugins (lm-sensors, Cray counters...)
+    std::vector<plugin_value_t> plugins;
+} node_sample_t;
+
+/* Shares the node-wide samples between the ranks of a job on a node.
+ * Local rank 0 publishes its samples to a POSIX shared memory segment,
+ * guarded by a seqlock, and the other ranks copy them instead of parsing
+ * /proc/stat, the memory files and the node plugins again.
+ * A reader that can't get a new sample (no segment yet, the publisher
+ * is late or gone) samples the node itself. */
+class NodeShare {
+public:
+    /* key identifies the job, see jobKey(). The sample is fresh enough
+     * for the readers if it is less than maxAge nanoseconds old. */
+    NodeShare(const std::string& key, bool publisher, size_t ncpus,
+        uint64_t maxAge);
+    ~NodeShare();
+    NodeShare(const NodeShare&) = delete;
+    NodeShare& operator=(const NodeShare&) = delete;
+    bool isPublisher(void) const { return publisher; }
+    /* false if there is no new sample to copy (or this is the publisher),
+     * and the caller has to sample the node itself */
+    bool read(node_sample_t& sample);
+    /* publish what the caller sampled after read() returned false */
+    void publish(const node_sample_t& sample);
+    /* The budget can stretch the NODE period, and a sample is then older
+     * than the configured period suggests. The readers also accept the
+     * publisher's maxAge, so a slowed-down publisher isn't ignored. */
+    void setMaxAge(uint64_t _maxAge) { maxAge = _maxAge; }
+    std::string summary(void) const;
+    /* The batch job (and step) this process belongs to, from the
+     * resource manager, or an empty string if it isn't known. */
+    static std::string jobKey(void);
+private:
+    struct Header;
+    bool attach(void);
+    bool copy(node_sample_t& sample, uint64_t now);
+    void detach(void);
+    Header * header(void) const { return (Header *)segment; }
+    char * cpuArea(void) const;
+    char * textArea(void) const;
+    uint64_t * memoryArea(void) const;
+    std::string name;
+    bool publisher;
+    size_t capacity;
+    uint64_t maxAge;
+    // when the last sample this rank used was started
+    uint64_t lastTimestamp;
+    size_t copied{0};
+    size_t sampled{0};
+    void * segment{nullptr};
+    size_t size{0};
+    // reused by the readers, so a read doesn't allocate
+    std::vector<char> text;
+};
+
+} // namespace zerosum
@@ -0,0 +1,211 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <unistd.h>
+#include <time.h>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include "output_pipeline.h"
+
+namespace zerosum {
+
+namespace output {
+
+static uint64_t nowNs(void) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Snapshot::operator()(const Record& r) {
+    records.push_back(r);
+    if (r.text != nullptr) {
+        // the deque doesn't move the strings it already has
+        texts.push_back(*r.text);
+        records.back().text = &texts.back();
+    }
+}
+
+void Snapshot::merge(const Snapshot& newer) {
+    records.reserve(records.size() + newer.records.size());
+    for (auto& r : newer.records) { (*this)(r); }
+    log += newer.log;
+    console += newer.console;
+    step = newer.step;
+    periods += newer.periods;
+}
+
+void LogSink::write(const Snapshot& snapshot) {
+    if (snapshot.log.empty()) { return; }
+    log << snapshot.log << std::flush;
+}
+
+void ConsoleSink::write(const Snapshot& snapshot) {
+    if (snapshot.console.empty()) { return; }
+    std::cout << snapshot.console << std::flush;
+}
+
+Pipeline::Pipeline(size_t depth, Policy policy) :
+    depth(std::max(depth, (size_t)1)), policy(policy) {}
+
+Pipeline::Policy Pipeline::parsePolicy(const std::string& name) {
+    if (name == "drop-oldest") { return Policy::DropOldest; }
+    if (name == "block") { return Policy::Block; }
+    return Policy::Coalesce;
+}
+
+const char * Pipeline::policyName(Policy policy) {
+    switch (policy) {
+        case Policy::DropOldest: return "drop-oldest";
+        case Policy::Block: return "block";
+        default: return "coalesce";
+    }
+}
+
+void Pipeline::add(std::unique_ptr<Sink> sink) {
+    needRecords = needRecords || sink->records();
+    sinks.push_back(std::move(sink));
+}
+
+/* The writer inherits the signal mask and affinity of the calling thread,
+ * so when started from the async thread it shares its core and doesn't
+ * get SIGQUIT either. */
+void Pipeline::start(void) {
+    std::unique_lock<std::mutex> lk(mtx);
+    if (running || finished || sinks.empty()) { return; }
+    running = true;
+    writer = std::thread{&Pipeline::run, this};
+}
+
+void Pipeline::publish(std::unique_ptr<Snapshot> snapshot) {
+    std::unique_lock<std::mutex> lk(mtx);
+    published++;
+    if (finished) {
+        late++;
+        return;
+    }
+    if (!running) {
+        lk.unlock();
+        write(*snapshot);
+        return;
+    }
+    if (queue.size() >= depth) {
+        switch (policy) {
+            case Policy::DropOldest:
+                dropped++;
+                droppedRecords += queue.front()->records.size();
+                queue.pop_front();
+                break;
+            case Policy::Block: {
+                uint64_t then = nowNs();
+                space.wait(lk, [this]{ return queue.size() < depth || finished; });
+                blockedNs += nowNs() - then;
+                // stop() finished the sinks while we waited
+                if (finished) {
+                    late++;
+                    return;
+                }
+                break;
+            }
+            case Policy::Coalesce:
+                // the writer takes snapshots off the queue under the lock,
+                // so the queued ones are still ours to change
+                coalesced++;
+                queue.back()->merge(*snapshot);
+                ready.notify_one();
+                return;
+        }
+    }
+    queue.push_back(std::move(snapshot));
+    maxQueued = std::max(maxQueued, queue.size());
+    ready.notify_one();
+}
+
+void Pipeline::run(void) {
+    writerTid = gettid();
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+        ready.wait(lk, [this]{ return !queue.empty() || stopping; });
+        if (queue.empty()) { break; }
+        std::unique_ptr<Snapshot> snapshot{std::move(queue.front())};
+        queue.pop_front();
+        space.notify_one();
+        lk.unlock();
+        write(*snapshot);
+        snapshot.reset();
+        lk.lock();
+    }
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        writerCpuNs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+}
+
+void Pipeline::write(const Snapshot& snapshot) {
+    uint64_t then = nowNs();
+    for (auto& sink : sinks) { sink->write(snapshot); }
+    uint64_t elapsed = nowNs() - then;
+    written++;
+    writeNs += elapsed;
+    maxWriteNs = std::max(maxWriteNs, elapsed);
+}
+
+void Pipeline::stop(void) {
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        if (finished) { return; }
+        stopping = true;
+        ready.notify_all();
+    }
+    // the writer drains the queue before it exits
+    if (writer.joinable()) { writer.join(); }
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        running = false;
+        finished = true;
+        space.notify_all();
+    }
+    for (auto& sink : sinks) { sink->finish(); }
+}
+
+std::string Pipeline::summary(void) const {
+    std::unique_lock<std::mutex> lk(mtx);
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+        "\nOutput: %lu periods published, %lu writes, %lu coalesced, %lu dropped"
+        " (%lu rows), %lu after the end, queue depth %lu (at most %lu queued), policy %s\n"
+        "Output: writes took %.3f ms on average, %.3f ms at most,"
+        " sampling blocked %.3f ms, writer CPU time %.3f ms\n",
+        published, written, coalesced, dropped, droppedRecords, late, depth, maxQueued,
+        policyName(policy), written > 0 ? (double)writeNs / written / 1.0e6 : 0.0,
+        (double)maxWriteNs / 1.0e6, (double)blockedNs / 1.0e6,
+        (double)writerCpuNs / 1.0e6);
+    return std::string(buffer);
+}
+
+} // namespace output
+
+} // namespace zerosum
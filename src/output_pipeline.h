@@ -0,0 +1,164 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+#include "output_record.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* One period of output. The async thread copies the rows that are new
+ * since the last period out of the series, along with what it logged
+ * during the period, so the writer thread never touches the live data.
+ * The records that are strings point into texts. */
+struct Snapshot {
+    explicit Snapshot(uint32_t step) : step(step) {}
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+    /* The sink of RecordSource::extract */
+    void operator()(const Record& r);
+    /* Append a newer snapshot, when the queue is full and coalescing */
+    void merge(const Snapshot& newer);
+    uint32_t step;
+    // how many periods this is, more than one once coalesced
+    uint32_t periods{1};
+    std::vector<Record> records;
+    std::deque<std::string> texts;
+    // appended to zs.<rank>.log
+    std::string log;
+    // the heartbeat, for stdout
+    std::string console;
+};
+
+/* Something the writer thread writes every snapshot to */
+class Sink {
+public:
+    virtual ~Sink() = default;
+    virtual void write(const Snapshot& snapshot) = 0;
+    /* Whether this sink uses the records, or only the text */
+    virtual bool records(void) const { return true; }
+    /* Called once, after the last snapshot */
+    virtual void finish(void) {}
+};
+
+/* zs.<rank>.log, which is opened (and finally closed) by ZeroSum */
+class LogSink : public Sink {
+public:
+    explicit LogSink(std::ostream& log) : log(log) {}
+    void write(const Snapshot& snapshot) override;
+    bool records(void) const override { return false; }
+private:
+    std::ostream& log;
+};
+
+/* The heartbeat on stdout */
+class ConsoleSink : public Sink {
+public:
+    void write(const Snapshot& snapshot) override;
+    bool records(void) const override { return false; }
+};
+
+/* Decouples the sampling from the output. The async thread publishes a
+ * snapshot every period to a bounded queue, and a writer thread writes
+ * them to the sinks, so a slow file system (or aggregator) doesn't delay
+ * the next sample. When the writer falls behind and the queue is full,
+ * the policy decides:
+ *   drop-oldest: the oldest queued snapshot is discarded, and counted
+ *   block:       the async thread waits for room, so nothing is lost but
+ *                the sampling is delayed, like writing inline
+ *   coalesce:    the new snapshot is merged into the newest queued one,
+ *                so nothing is lost, but the queue holds more than
+ *                <depth> periods of data (the default)
+ * Snapshots published before start() are written by the calling thread.
+ * After stop() the sinks are finished (a trace is closed), so later
+ * snapshots are dropped and counted. */
+class Pipeline {
+public:
+    enum class Policy { DropOldest, Block, Coalesce };
+    Pipeline(size_t depth, Policy policy);
+    ~Pipeline() { stop(); }
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+    /* "drop-oldest", "block" or "coalesce", anything else is coalesce */
+    static Policy parsePolicy(const std::string& name);
+    static const char * policyName(Policy policy);
+    /* Only before start() */
+    void add(std::unique_ptr<Sink> sink);
+    /* Whether any sink needs the records */
+    bool records(void) const { return needRecords; }
+    void start(void);
+    void publish(std::unique_ptr<Snapshot> snapshot);
+    /* Writes what is still queued, joins the writer, and finishes the sinks */
+    void stop(void);
+    /* The LWP of the writer thread, 0 until it has started */
+    uint32_t tid(void) const { return writerTid; }
+    std::string summary(void) const;
+private:
+    void run(void);
+    void write(const Snapshot& snapshot);
+    std::vector<std::unique_ptr<Sink>> sinks;
+    bool needRecords{false};
+    const size_t depth;
+    const Policy policy;
+    mutable std::mutex mtx;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::deque<std::unique_ptr<Snapshot>> queue;
+    std::thread writer;
+    std::atomic<uint32_t> writerTid{0};
+    bool running{false};
+    bool stopping{false};
+    bool finished{false};
+    // guarded by mtx
+    uint64_t published{0};
+    uint64_t dropped{0};
+    uint64_t droppedRecords{0};
+    // published after stop()
+    uint64_t late{0};
+    uint64_t coalesced{0};
+    uint64_t blockedNs{0};
+    size_t maxQueued{0};
+    // only updated by the thread that writes
+    uint64_t written{0};
+    uint64_t writeNs{0};
+    uint64_t maxWriteNs{0};
+    uint64_t writerCpuNs{0};
+};
+
+} // namespace output
+
+} // namespace zerosum
@@ -0,0 +1,53 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "timeseries.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* One value of the output, before any formatting. Every output format
+ * (CSV, binary, trace, aggregator) is fed the same records. */
+struct Record {
+    // "Node", "HWT", "NUMA", "GPU", "LWP", "Process", "MPI", "Collector" or "Event"
+    const char * resource;
+    const char * type;       // "Property", "Metric" or, for events, "Instant"
+    uint32_t index;
+    uint32_t step;
+    series::metric_id metric;
+    series::Kind kind;
+    series::Value value;
+    // properties that are strings (environment, GPU properties)
+    const std::string * text;
+};
+
+} // namespace output
+
+} // namespace zerosum
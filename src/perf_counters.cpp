@@ -0,0 +1,254 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "perf_counters.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include "utils.h"
+#include "timeseries.h"
+
+namespace zerosum {
+
+/* The LLC-misses of perf(1) */
+#define ZS_LLC_READ_MISS (PERF_COUNT_HW_CACHE_LL | \
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const std::vector<PerfCounters::event_t>& softwareEvents(void) {
+    static const std::vector<PerfCounters::event_t> tmp{
+        {"perf task clock ns", "perf cpu utilization", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        {"perf context switches", "perf context switches/s", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        {"perf cpu migrations", "perf cpu migrations/s", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+        {"perf page faults", "perf page faults/s", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}};
+    return tmp;
+}
+
+static const std::vector<PerfCounters::event_t>& hardwareEvents(void) {
+    static const std::vector<PerfCounters::event_t> tmp{
+        {"perf instructions", "perf instructions/s", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"perf cycles", "perf cycles/s", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"perf llc misses", "perf llc misses/s", PERF_TYPE_HW_CACHE, ZS_LLC_READ_MISS}};
+    return tmp;
+}
+
+/* The group is read in one go: nr, time enabled, time running, values */
+typedef struct group_read {
+    uint64_t nr;
+    uint64_t enabled;
+    uint64_t running;
+    uint64_t values[PerfCounters::maxEvents];
+} group_read_t;
+
+/* With perf_event_paranoid at 2, the default, only user space can be
+ * counted without CAP_PERFMON, and then the context switches and
+ * migrations, which happen in the kernel, read zero. So the kernel is
+ * only excluded when it has to be. */
+PerfCounters::PerfCounters() {
+    int leader = -1;
+    for (auto& e : softwareEvents()) {
+        int fd = open(0, e, leader);
+        if (fd < 0 && leader < 0 && (errno == EACCES || errno == EPERM)) {
+            excludeKernel = true;
+            fd = open(0, e, leader);
+        }
+        // without the leader, perf events aren't available at all
+        if (fd < 0 && leader < 0) {
+            hardware = strerror(errno);
+            return;
+        }
+        if (fd < 0) { continue; }
+        if (leader < 0) { leader = fd; } else { ::close(fd); }
+        events.push_back(e);
+    }
+    /* A hardware event joins the software group, which moves the group to
+     * the PMU. Without one, in most VMs, there is nothing to open. */
+    int err{0};
+    for (auto& e : hardwareEvents()) {
+        int fd = open(0, e, leader);
+        if (fd < 0) {
+            err = errno;
+            continue;
+        }
+        ::close(fd);
+        events.push_back(e);
+    }
+    ::close(leader);
+    if (events.size() > softwareEvents().size()) {
+        hardware = "counted";
+    } else {
+        hardware = std::string("unavailable (") + strerror(err) + ")";
+    }
+    // like the TaskFileCache, leave most of the descriptor table to the application
+    struct rlimit rl;
+    size_t fds{256};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        fds = rl.rlim_cur / 4;
+    }
+    maxThreads = parseInt("ZS_PERF_MAX_THREADS", fds / events.size());
+}
+
+PerfCounters::~PerfCounters() {
+    stop();
+}
+
+int PerfCounters::open(pid_t tid, const event_t& event, int leader) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, tid, -1, leader,
+        PERF_FLAG_FD_CLOEXEC);
+}
+
+bool PerfCounters::attach(uint32_t tid, group_t& group) {
+    group.fds.clear();
+    for (auto& e : events) {
+        int fd = open((pid_t)tid, e, group.fds.empty() ? -1 : group.fds[0]);
+        if (fd < 0) {
+            // the thread exited, or we are out of descriptors
+            close(group);
+            failed++;
+            return false;
+        }
+        group.fds.push_back(fd);
+    }
+    group.values.assign(events.size(), 0);
+    group.timestamp = 0;
+    attached++;
+    return true;
+}
+
+void PerfCounters::close(group_t& group) {
+    // the siblings first, then the leader
+    for (size_t i = group.fds.size() ; i > 0 ; i--) { ::close(group.fds[i-1]); }
+    group.fds.clear();
+}
+
+/* A group that was multiplexed with others only counted while it was
+ * running, so the counts are scaled up to the time it was enabled */
+bool PerfCounters::readGroup(group_t& group, std::vector<uint64_t>& values) {
+    group_read_t r;
+    ssize_t bytes = ::read(group.fds[0], &r, sizeof(r));
+    reads++;
+    if (bytes < (ssize_t)(3 * sizeof(uint64_t)) || r.nr != events.size()) { return false; }
+    double scale = (r.running > 0 && r.running < r.enabled) ?
+        (double)r.enabled / (double)r.running : 1.0;
+    values.resize(events.size());
+    for (size_t i = 0 ; i < events.size() ; i++) {
+        values[i] = (uint64_t)((double)r.values[i] * scale);
+    }
+    return true;
+}
+
+/* Once its thread exits, a group stops counting and polls as hung up */
+bool PerfCounters::exited(const group_t& group) {
+    struct pollfd p;
+    p.fd = group.fds[0];
+    p.events = POLLIN;
+    p.revents = 0;
+    return poll(&p, 1, 0) > 0 && (p.revents & POLLHUP) != 0;
+}
+
+void PerfCounters::beginSweep(void) {
+    generation++;
+}
+
+bool PerfCounters::read(uint32_t tid, std::vector<uint64_t>& values,
+    std::vector<uint64_t>& deltas, uint64_t& elapsed_ns) {
+    auto g = groups.find(tid);
+    if (g == groups.end()) {
+        if (groups.size() >= maxThreads) { return false; }
+        group_t group;
+        if (!attach(tid, group)) { return false; }
+        g = groups.emplace(tid, std::move(group)).first;
+    }
+    group_t& group = g->second;
+    group.generation = generation;
+    if (!readGroup(group, values)) { return false; }
+    /* A task clock that didn't move is a sleeping thread, or the group of
+     * a thread that exited since the last sweep, and whose ID is reused */
+    if (group.timestamp > 0 && values[0] == group.values[0] && exited(group)) {
+        close(group);
+        reused++;
+        if (!attach(tid, group) || !readGroup(group, values)) {
+            groups.erase(g);
+            return false;
+        }
+    }
+    uint64_t now = series::now();
+    deltas.resize(values.size());
+    for (size_t i = 0 ; i < values.size() ; i++) {
+        deltas[i] = values[i] >= group.values[i] ? values[i] - group.values[i] : 0;
+    }
+    taskClock += deltas[0];
+    elapsed_ns = group.timestamp > 0 ? now - group.timestamp : 0;
+    group.values = values;
+    group.timestamp = now;
+    return true;
+}
+
+void PerfCounters::endSweep(void) {
+    for (auto g = groups.begin() ; g != groups.end() ; ) {
+        if (g->second.generation != generation) {
+            close(g->second);
+            g = groups.erase(g);
+        } else {
+            ++g;
+        }
+    }
+}
+
+void PerfCounters::stop(void) {
+    for (auto& g : groups) { close(g.second); }
+    groups.clear();
+}
+
+std::string PerfCounters::summary(void) {
+    std::string names;
+    for (auto& e : events) {
+        if (!names.empty()) { names += ", "; }
+        names += e.name + 5;
+    }
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+        "\nPerf counters: %lu threads counted, %.3f s of task clock, %lu could not be, "
+        "%lu reused IDs, %lu group reads, %s; events: %s; hardware events %s\n",
+        attached, (double)taskClock * 1.0e-9, failed, reused, reads,
+        excludeKernel ? "user space only" : "user and kernel space",
+        names.c_str(), hardware.c_str());
+    return std::string(buffer);
+}
+
+} // namespace zerosum
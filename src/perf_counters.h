@@ -0,0 +1,97 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace zerosum {
+
+/* Per-thread counters from perf_event_open(2). Every thread gets one
+ * group: the software events always, and instructions, cycles and LLC
+ * misses when the PMU and perf_event_paranoid allow them, which the
+ * constructor finds out by opening the group on itself. A sweep reads each
+ * group with one PERF_FORMAT_GROUP read(). Like StackSampler, a thread
+ * that isn't read during a sweep has exited, and its group is closed at
+ * the end of the sweep. */
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    bool valid(void) const { return !events.empty(); }
+    /* Why nothing can be counted, or whether the hardware events are */
+    const std::string& status(void) const { return hardware; }
+    typedef struct event {
+        const char * name;  // the cumulative count
+        const char * rate;  // the count per second of the period
+        uint32_t type;
+        uint64_t config;
+    } event_t;
+    /* The events in every group, in the order of the values read() returns */
+    const std::vector<event_t>& counted(void) const { return events; }
+    void beginSweep(void);
+    /* The counts since the thread was first read, scaled if the group was
+     * multiplexed, and the change since the last read over elapsed_ns.
+     * A new thread's group is opened, and the first read has no change. */
+    bool read(uint32_t tid, std::vector<uint64_t>& values,
+        std::vector<uint64_t>& deltas, uint64_t& elapsed_ns);
+    void endSweep(void);
+    void stop(void);
+    std::string summary(void);
+    static constexpr size_t maxEvents{8};
+private:
+    typedef struct group {
+        std::vector<int> fds;  // the leader first
+        std::vector<uint64_t> values;
+        uint64_t timestamp{0};
+        uint32_t generation{0};
+    } group_t;
+    int open(pid_t tid, const event_t& event, int leader);
+    bool attach(uint32_t tid, group_t& group);
+    bool readGroup(group_t& group, std::vector<uint64_t>& values);
+    bool exited(const group_t& group);
+    void close(group_t& group);
+    std::vector<event_t> events;
+    std::unordered_map<uint32_t, group_t> groups;
+    size_t maxThreads{0};
+    uint32_t generation{0};
+    bool excludeKernel{false};
+    size_t attached{0};
+    size_t failed{0};
+    size_t reused{0};
+    uint64_t reads{0};
+    // of every thread, the first event of every group
+    uint64_t taskClock{0};
+    std::string hardware;
+};
+
+} // namespace zerosum
@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <algorithm>
+#include "periodic_timer.h"
+
+namespace zerosum {
+
+namespace {
+
+constexpr uint64_t nanoseconds{1000000000ULL};
+
+uint64_t monotonic(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * nanoseconds) + ts.tv_nsec;
+}
+
+struct timespec toTimespec(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / nanoseconds;
+    ts.tv_nsec = ns % nanoseconds;
+    return ts;
+}
+
+} // anonymous namespace
+
+PeriodicTimer::PeriodicTimer(double seconds) :
+    periodNs(std::max((uint64_t)1, (uint64_t)(seconds * nanoseconds))) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+PeriodicTimer::~PeriodicTimer() {
+    if (timer_fd >= 0) { close(timer_fd); }
+    if (event_fd >= 0) { close(event_fd); }
+}
+
+void PeriodicTimer::start(void) {
+    startNs = monotonic();
+    if (timer_fd < 0) { return; }
+    // the kernel keeps the deadlines, and counts the ones we miss
+    struct itimerspec spec;
+    spec.it_value = toTimespec(startNs + periodNs);
+    spec.it_interval = toTimespec(periodNs);
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+}
+
+void PeriodicTimer::stop(void) {
+    stopped = true;
+    if (event_fd >= 0) {
+        uint64_t one{1};
+        ssize_t rc = write(event_fd, &one, sizeof(one));
+        (void)rc;
+    }
+}
+
+bool PeriodicTimer::wait(void) {
+    uint64_t expirations{0};
+    while (!stopped && expirations == 0) {
+        if (timer_fd < 0) {
+            expirations = waitFallback();
+            continue;
+        }
+        struct pollfd fds[2];
+        fds[0].fd = timer_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = event_fd;
+        fds[1].events = POLLIN;
+        int rc = poll(fds, event_fd >= 0 ? 2 : 1, -1);
+        if (rc < 0 && errno != EINTR) { break; }
+        if (rc > 0 && (fds[0].revents & POLLIN)) {
+            if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                expirations = 0;
+            }
+        }
+    }
+    if (stopped) { return false; }
+    expired += expirations;
+    if (expirations > 1) {
+        skipped += expirations - 1;
+        maxSkipped = std::max(maxSkipped, expirations - 1);
+    }
+    return true;
+}
+
+/* Sleep until the next deadline after now, in the eventfd if we have one */
+uint64_t PeriodicTimer::waitFallback(void) {
+    uint64_t now = monotonic();
+    uint64_t passed = (now - startNs) / periodNs;
+    if (passed > expired) { return passed - expired; }
+    uint64_t next = startNs + ((expired + 1) * periodNs);
+    struct timespec timeout = toTimespec(next - now);
+    struct pollfd fd;
+    fd.fd = event_fd;
+    fd.events = POLLIN;
+    ppoll(&fd, event_fd >= 0 ? 1 : 0, &timeout, nullptr);
+    now = monotonic();
+    passed = (now - startNs) / periodNs;
+    return passed > expired ? passed - expired : 0;
+}
+
+} // namespace zerosum
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace zerosum {
+
+/* Wakes the async thread at absolute deadlines, start + k * period on
+ * CLOCK_MONOTONIC, with a timerfd. The time spent sampling doesn't
+ * accumulate as drift, and deadlines that pass while sampling are counted
+ * as missed and skipped, instead of being caught up back to back.
+ * stop() wakes the thread immediately through an eventfd. Without timerfd
+ * (or eventfd) support it falls back to ppoll() with a timeout. */
+class PeriodicTimer {
+public:
+    explicit PeriodicTimer(double seconds);
+    ~PeriodicTimer();
+    PeriodicTimer(const PeriodicTimer&) = delete;
+    PeriodicTimer& operator=(const PeriodicTimer&) = delete;
+    /* The first deadline is one period from now */
+    void start(void);
+    /* Wait for the next deadline, false if stopped */
+    bool wait(void);
+    /* Can be called from any thread, also before start() */
+    void stop(void);
+    uint64_t period(void) const { return periodNs; }
+    /* The last deadline that has passed, in ns on CLOCK_MONOTONIC */
+    uint64_t deadline(void) const { return startNs + (expired * periodNs); }
+    /* The deadlines that have passed, including the missed ones */
+    uint64_t deadlines(void) const { return expired; }
+    uint64_t missed(void) const { return skipped; }
+    /* The most periods missed in a row */
+    uint64_t worst(void) const { return maxSkipped; }
+private:
+    uint64_t waitFallback(void);
+    int timer_fd{-1};
+    int event_fd{-1};
+    uint64_t periodNs;
+    uint64_t startNs{0};
+    uint64_t expired{0};
+    uint64_t skipped{0};
+    uint64_t maxSkipped{0};
+    std::atomic<bool> stopped{false};
+};
+
+} // namespace zerosum
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlfcn.h>
+#include <iostream>
+#include <sstream>
+#include "plugins.h"
+#include "utils.h"
+#include "cray_pm_counters.h"
+#ifdef ZEROSUM_USE_LM_SENSORS
+#include "lm_sensor_data.h"
+#endif // ZEROSUM_USE_LM_SENSORS
+
+namespace zerosum {
+
+Plugin::Plugin(const zs_plugin_t * plugin, void * _handle) :
+    desc(plugin), handle(_handle) {
+    if (desc == nullptr || desc->abi_version != ZEROSUM_PLUGIN_ABI_VERSION ||
+        desc->name == nullptr || desc->init == nullptr ||
+        desc->describe == nullptr || desc->sample == nullptr) {
+        return;
+    }
+    id = desc->name;
+    if (desc->init(&context) != 0) { return; }
+    initialized = true;
+    values.resize(desc->describe(context, &metrics));
+    for (size_t i = 0 ; i < values.size() ; i++) {
+        ids.push_back(series::Metrics::intern(metrics[i].name));
+    }
+}
+
+Plugin::~Plugin() {
+    if (initialized && desc->finalize != nullptr) {
+        desc->finalize(context);
+    }
+    if (handle != nullptr) { dlclose(handle); }
+}
+
+bool Plugin::sample(std::vector<plugin_value_t>& sampled) {
+    if (!initialized || values.empty()) { return false; }
+    int count = desc->sample(context, values.data(), values.size());
+    if (count <= 0) { return false; }
+    // only the first count values were written
+    size_t n = std::min(values.size(), (size_t)count);
+    for (size_t i = 0 ; i < n ; i++) {
+        sampled.push_back(plugin_value_t{ids[i], metrics[i].kind, values[i]});
+    }
+    return true;
+}
+
+std::vector<std::unique_ptr<Plugin>> Plugin::load(void) {
+    std::vector<std::unique_ptr<Plugin>> plugins;
+    auto add = [&](const zs_plugin_t * plugin, void * handle) {
+        auto p = std::make_unique<Plugin>(plugin, handle);
+        if (p->valid()) {
+            if (getVerbose()) {
+                std::cerr << "ZeroSum: plugin " << p->name() << " samples "
+                          << p->size() << " metrics" << std::endl;
+            }
+            plugins.push_back(std::move(p));
+        } else if (getVerbose()) {
+            std::cerr << "ZeroSum: plugin " << p->name()
+                      << " can't sample on this system" << std::endl;
+        }
+    };
+    add(cray_pm_plugin(), nullptr);
+#ifdef ZEROSUM_USE_LM_SENSORS
+    add(lm_sensors_plugin(), nullptr);
+#endif // ZEROSUM_USE_LM_SENSORS
+    // a list of shared libraries, separated by commas or colons
+    std::string list{parseString("ZS_PLUGINS", "")};
+    for (char& c : list) { if (c == ':') { c = ','; } }
+    std::stringstream ss(list);
+    std::string path;
+    while (std::getline(ss, path, ',')) {
+        if (path.empty()) { continue; }
+        void * handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == nullptr) {
+            std::cerr << "ZeroSum: can't load plugin " << dlerror() << std::endl;
+            continue;
+        }
+        zs_plugin_entry_t entry =
+            (zs_plugin_entry_t)dlsym(handle, ZEROSUM_PLUGIN_ENTRY);
+        const zs_plugin_t * plugin = (entry == nullptr) ? nullptr : entry();
+        if (plugin == nullptr || plugin->abi_version != ZEROSUM_PLUGIN_ABI_VERSION) {
+            std::cerr << "ZeroSum: " << path << " is not a plugin for this "
+                      << "version of ZeroSum" << std::endl;
+            dlclose(handle);
+            continue;
+        }
+        add(plugin, handle);
+    }
+    return plugins;
+}
+
+} // namespace zerosum
@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "zerosum_plugin.h"
+#include "timeseries.h"
+
+namespace zerosum {
+
+/* One sampled value, with the type the plugin described it with */
+typedef struct plugin_value {
+    series::metric_id id;
+    zs_plugin_kind_t kind;
+    zs_plugin_value_t value;
+} plugin_value_t;
+
+/* Sets the value in the current row, keeping its type */
+inline void setPluginValue(series::TimeSeries& data, const plugin_value_t& v) {
+    if (v.kind == ZS_PLUGIN_DOUBLE) {
+        data.set(v.id, v.value.d);
+    } else {
+        data.set(v.id, v.value.u);
+    }
+}
+
+/* A collector behind the C plugin interface, either built in or loaded
+ * from a shared library. */
+class Plugin {
+public:
+    /* handle is the dlopen() handle, null for the built in plugins */
+    Plugin(const zs_plugin_t * plugin, void * handle);
+    ~Plugin();
+    Plugin(const Plugin&) = delete;
+    Plugin& operator=(const Plugin&) = delete;
+    /* false if the plugin can't sample on this system */
+    bool valid(void) const { return initialized; }
+    const std::string& name(void) const { return id; }
+    bool node(void) const { return desc->scope == ZS_PLUGIN_NODE; }
+    size_t size(void) const { return values.size(); }
+    /* The default period in seconds, 0 for the sampling period */
+    double period(void) const { return desc->period > 0.0 ? desc->period : 0.0; }
+    /* Appends the sampled values, false if nothing is new */
+    bool sample(std::vector<plugin_value_t>& sampled);
+    /* The built in plugins, then the ones listed in ZS_PLUGINS, without
+     * the ones that can't sample on this system */
+    static std::vector<std::unique_ptr<Plugin>> load(void);
+private:
+    const zs_plugin_t * desc;
+    void * handle;
+    void * context{nullptr};
+    bool initialized{false};
+    std::string id;
+    const zs_plugin_metric_t * metrics{nullptr};
+    // interned once, in the order of describe()
+    std::vector<series::metric_id> ids;
+    std::vector<zs_plugin_value_t> values;
+};
+
+} // namespace zerosum
@@ -58,7 +58,7 @@ def parseFile(f, rank):
         if len(line) == 0:
             continue
         # don't do anything until we reach the GPU section
-        if re.match(r'GPU \d+ - \(metric: min  avg  max\)', line):
+        if re.match(r'GPU \d+ - \(metric: min  avg  max', line):
             inlwp = False
             inhwt = False
             ingpu = True
@@ -0,0 +1,168 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+   Utility to expand the binary zs.data.<rank>.zsb files written with
+   ZS_BINARY=1 into the zs.data.<rank>.csv files that the post-processing
+   scripts read. Usage:
+       zs-convert [-o output.csv] zs.data.<rank>.zsb [...]
+   Without -o, each file is written next to the input, as .csv.
+   */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "zsb_format.h"
+#include "csv_format.h"
+
+using namespace zerosum::output;
+
+namespace {
+
+bool writeAll(int fd, const char * data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+std::string csvName(const std::string& input) {
+    const std::string suffix{".zsb"};
+    if (input.size() > suffix.size() &&
+        input.compare(input.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        return input.substr(0, input.size() - suffix.size()) + ".csv";
+    }
+    return input + ".csv";
+}
+
+int convert(const std::string& input, const std::string& output) {
+    int in = open(input.c_str(), O_RDONLY);
+    if (in < 0) {
+        perror(input.c_str());
+        return 1;
+    }
+    struct stat info;
+    if (fstat(in, &info) != 0) {
+        perror(input.c_str());
+        close(in);
+        return 1;
+    }
+    const char * data{nullptr};
+    if (info.st_size > 0) {
+        void * mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+        if (mapped == MAP_FAILED) {
+            perror(input.c_str());
+            close(in);
+            return 1;
+        }
+        data = (const char *)mapped;
+        madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+    }
+    close(in);
+    int status{0};
+    ZsbDecoder decoder(data, info.st_size);
+    if (!decoder.header()) {
+        std::cerr << input << ": not a zerosum binary file" << std::endl;
+        status = 1;
+    } else {
+        int out = (output == "-") ? STDOUT_FILENO :
+            open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0) {
+            perror(output.c_str());
+            status = 1;
+        } else {
+            CsvFormatter csv(decoder.hostname(), decoder.rank(), decoder.shmrank());
+            csv.header();
+            bool ok{true};
+            auto sink = [&](const Record& r) {
+                csv(r);
+                if (csv.size() >= (1024*1024)) {
+                    ok = writeAll(out, csv.data(), csv.size()) && ok;
+                    csv.clear();
+                }
+            };
+            // a file that was cut short is converted up to the damage
+            if (!decoder.records(sink)) {
+                std::cerr << input << ": truncated or corrupt, "
+                    << "converted up to the last complete block" << std::endl;
+                status = 1;
+            }
+            ok = writeAll(out, csv.data(), csv.size()) && ok;
+            if (!ok) {
+                perror(output.c_str());
+                status = 1;
+            }
+            if (out != STDOUT_FILENO) { close(out); }
+        }
+    }
+    if (data != nullptr) { munmap((void *)data, info.st_size); }
+    return status;
+}
+
+void usage(const char * name) {
+    std::cerr << "Usage: " << name << " [-o output.csv] zs.data.<rank>.zsb [...]\n"
+        << "Expands the binary zerosum data files to CSV. Without -o, each\n"
+        << "input is written next to it with the .csv suffix, -o - writes\n"
+        << "to stdout." << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    std::string output;
+    std::vector<std::string> inputs;
+    for (int i = 1 ; i < argc ; i++) {
+        std::string arg{argv[i]};
+        if (arg == "-o" && i+1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] == '-') {
+            usage(argv[0]);
+            return (arg == "-h" || arg == "--help") ? 0 : 1;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty() || (!output.empty() && inputs.size() > 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+    int status{0};
+    for (auto& input : inputs) {
+        status |= convert(input, output.empty() ? csvName(input) : output);
+    }
+    return status;
+}
@@ -0,0 +1,116 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <utility>
+#include "output_pipeline.h"
+#include "csv_format.h"
+#include "zsb_format.h"
+#include "trace_format.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* An output file that is only ever appended to */
+class OutputFile {
+public:
+    explicit OutputFile(const std::string& filename);
+    ~OutputFile();
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    bool valid(void) const { return fd >= 0; }
+    void write(const char * data, size_t size);
+private:
+    int fd{-1};
+};
+
+/* Appends the rows of every snapshot to a file in one of the output
+ * formats, with one write() per snapshot, so the file is complete up to
+ * the last snapshot written even if the process dies. */
+template<typename Format>
+class RecordWriter : public Sink {
+public:
+    template<typename... Args>
+    RecordWriter(const std::string& filename, Args&&... args) : file(filename),
+        format(std::forward<Args>(args)...) {
+        if (file.valid()) { format.header(); }
+    }
+    ~RecordWriter() { flush(); }
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+    bool valid(void) const { return file.valid(); }
+    void write(const Snapshot& snapshot) override {
+        if (!file.valid()) { return; }
+        // a long first (or last) snapshot is written out in pieces
+        for (auto& r : snapshot.records) {
+            format(r);
+            if (format.size() >= flushSize) { drain(); }
+        }
+        flush();
+    }
+    void finish(void) override {
+        if (!file.valid()) { return; }
+        format.close();
+        flush();
+    }
+private:
+    void drain(void) {
+        file.write(format.data(), format.size());
+        format.clear();
+    }
+    void flush(void) {
+        format.finish();
+        drain();
+    }
+    static constexpr size_t flushSize{1024*1024};
+    OutputFile file;
+    Format format;
+};
+
+/* zs.data.<rank>.csv */
+class CsvWriter : public RecordWriter<CsvFormatter> {
+public:
+    using RecordWriter<CsvFormatter>::RecordWriter;
+};
+
+/* zs.data.<rank>.zsb, see zsb_format.h */
+class ZsbWriter : public RecordWriter<ZsbEncoder> {
+public:
+    using RecordWriter<ZsbEncoder>::RecordWriter;
+};
+
+/* zs.trace.<rank>.json, see trace_format.h */
+class TraceWriter : public RecordWriter<TraceFormatter> {
+public:
+    using RecordWriter<TraceFormatter>::RecordWriter;
+};
+
+} // namespace output
+
+} // namespace zerosum
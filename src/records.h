@@ -0,0 +1,193 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "output_record.h"
+// zerosum.h has to come first, it declares the node and process types
+#include "zerosum.h"
+#include "topology.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* Walks the node, hardware threads, NUMA nodes, GPUs, threads, process
+ * and MPI totals of the process, and the costs of the collectors, and
+ * hands every row that hasn't been extracted before to the sink. Each
+ * series has its own cursor, the next step to extract, so series that
+ * start late or end early (threads) don't affect each other, and rows
+ * are extracted before ZS_HISTORY_LIMIT can drop them.
+ * The caller must hold Process::thread_mtx, the async thread adds threads. */
+class RecordSource {
+public:
+    template<typename Sink>
+    void extract(hardware::ComputeNode& node, software::Process& process,
+        const std::set<uint32_t>& hwthreads, const CollectorScheduler& collectors,
+        Sink& sink) {
+        Record r{};
+        r.resource = "Node";
+        r.type = "Property";
+        r.index = 0;
+        rows(key(Clock, 0), node.clock, r, sink);
+        rows(key(Node, 0), node.data, r, sink);
+        for (auto& hwt : node.hwThreads) {
+            if (hwthreads.count(hwt.id) == 0) { continue; }
+            extractHWT(hwt, sink);
+        }
+        r.resource = "NUMA";
+        r.type = "Metric";
+        for (auto& numa : node.numaNodes) {
+            r.index = numa.id;
+            rows(key(NUMA, numa.id), numa.data, r, sink);
+        }
+        for (auto& gpu : node.gpus) {
+            r.resource = "GPU";
+            r.index = gpu.id;
+            if (first(key(GPUProperties, gpu.id))) {
+                r.type = "Property";
+                properties(gpu.properties, r, sink);
+            }
+            r.type = "Metric";
+            rows(key(GPU, gpu.id), gpu.data, r, sink);
+        }
+        if (first(key(Environment, 0))) {
+            r.resource = "Node";
+            r.type = "Property";
+            r.index = 0;
+            properties(process.environment, r, sink);
+        }
+        r.resource = "LWP";
+        r.type = "Metric";
+        for (auto& t : process.threads) {
+            r.index = t.second.id;
+            rows(key(LWP, t.second.id), t.second.data, r, sink);
+        }
+        r.resource = "Process";
+        r.index = process.id;
+        rows(key(ProcessData, 0), process.data, r, sink);
+        rows(key(ProcessNumaMaps, 0), process.numaMaps, r, sink);
+        size_t plugin{0};
+        for (auto& p : process.pluginData) {
+            rows(key(ProcessPlugin, plugin++), p.second, r, sink);
+        }
+        r.resource = "MPI";
+        r.index = 0;
+        rows(key(MPI, 0), process.mpiData, r, sink);
+        r.resource = "Collector";
+        for (size_t i = 0 ; i < collectors.size() ; i++) {
+            r.index = (uint32_t)i;
+            if (first(key(CollectorProperties, i))) {
+                r.type = "Property";
+                properties({{"name", collectors.name(i)}}, r, sink);
+            }
+            r.type = "Metric";
+            rows(key(Collector, i), collectors.data(i), r, sink);
+        }
+    }
+private:
+    enum Source : uint64_t { Node = 0, HWT, GPU, GPUProperties, Environment, LWP,
+        Collector, CollectorProperties, MPI, NUMA, ProcessData, Clock,
+        ProcessNumaMaps, ProcessPlugin };
+    struct Cursor {
+        size_t next{0};
+        // the columns in name order, refreshed when the series gains one
+        std::vector<const series::Column*> columns;
+        bool done{false};
+    };
+    std::unordered_map<uint64_t, Cursor> cursors;
+
+    static uint64_t key(Source source, uint32_t index) { return (source << 32) | index; }
+    bool first(uint64_t k) {
+        Cursor& c = cursors[k];
+        bool result = !c.done;
+        c.done = true;
+        return result;
+    }
+    Cursor& cursor(uint64_t k, const series::TimeSeries& data) {
+        Cursor& c = cursors[k];
+        if (c.columns.size() != data.width()) { c.columns = data.sorted(); }
+        return c;
+    }
+    template<typename Sink>
+    void rows(uint64_t k, const series::TimeSeries& data, Record& r, Sink& sink) {
+        Cursor& c = cursor(k, data);
+        for (size_t i = data.seek(c.next) ; i < data.size() ; i++) {
+            r.step = data.step(i);
+            for (auto col : c.columns) {
+                r.metric = col->id;
+                r.kind = col->kind;
+                r.value = col->values[i];
+                sink(r);
+            }
+        }
+        c.next = std::max(c.next, data.nextStep());
+    }
+    /* The hardware threads report the share of each counter's delta */
+    template<typename Sink>
+    void extractHWT(hardware::HWT& hwt, Sink& sink) {
+        static const series::metric_id totalTime{series::Metrics::intern("total_time")};
+        Cursor& c = cursor(key(HWT, hwt.id), hwt.data);
+        const series::Column* total = hwt.data.find(totalTime);
+        Record r{};
+        r.resource = "HWT";
+        r.type = "Metric";
+        r.index = hwt.id;
+        r.kind = series::Kind::Unsigned;
+        for (size_t i = hwt.data.seek(c.next) ; i < hwt.data.size() ; i++) {
+            // the percentages need a previous value
+            if (i == 0 || total == nullptr) { continue; }
+            uint64_t total_delta = total->delta(i);
+            r.step = hwt.data.step(i);
+            for (auto col : c.columns) {
+                r.metric = col->id;
+                r.value.u = total_delta>0 ? (col->delta(i) * 100)/total_delta : 0;
+                sink(r);
+            }
+        }
+        c.next = std::max(c.next, hwt.data.nextStep());
+    }
+    template<typename Sink>
+    void properties(const std::map<std::string, std::string>& props,
+        Record& r, Sink& sink) {
+        r.step = 0;
+        r.kind = series::Kind::State;
+        r.value.u = 0;
+        for (auto& p : props) {
+            r.metric = series::Metrics::intern(p.first);
+            r.text = &(p.second);
+            sink(r);
+        }
+        r.text = nullptr;
+    }
+};
+
+} // namespace output
+
+} // namespace zerosum
@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace zerosum {
+
+typedef struct thread_registration {
+    uint32_t tid;
+    uint32_t type;
+    // when the thread registered, in ns on the monotonic clock
+    uint64_t timestamp;
+} thread_registration_t;
+
+/* New threads (from the OMPT thread_begin callback) are only pushed here,
+ * and the async thread drains the queue before its next sweep of
+ * /proc/self/task, which reads their state. So registering a thread never
+ * blocks or allocates, and doesn't read /proc while the OpenMP runtime
+ * starts its threads.
+ * This is Vyukov's bounded queue with a single consumer: each cell has a
+ * sequence number that tells producers and the consumer whose turn it is.
+ * A full queue drops the registration, and the sweep still finds the
+ * thread, just without its type. */
+class RegistrationQueue {
+public:
+    RegistrationQueue(void) {
+        for (size_t i = 0 ; i < capacity ; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    RegistrationQueue(const RegistrationQueue&) = delete;
+    RegistrationQueue& operator=(const RegistrationQueue&) = delete;
+    /* Any thread */
+    bool push(const thread_registration_t& r) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell * cell;
+        while (true) {
+            cell = &(cells[pos & mask]);
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                    std::memory_order_relaxed)) { break; }
+            } else if (diff < 0) {
+                // the consumer hasn't freed this cell yet, we're full
+                drops.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = r;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    /* The async thread only */
+    bool pop(thread_registration_t& r) {
+        Cell& cell = cells[head & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(head + 1) < 0) { return false; }
+        r = cell.data;
+        cell.sequence.store(head + capacity, std::memory_order_release);
+        head++;
+        return true;
+    }
+    size_t dropped(void) const { return drops.load(std::memory_order_relaxed); }
+private:
+    static constexpr size_t capacity{1024};
+    static constexpr size_t mask{capacity - 1};
+    struct Cell {
+        std::atomic<size_t> sequence;
+        thread_registration_t data;
+    };
+    std::array<Cell, capacity> cells;
+    // the producers and the consumer are on different cache lines
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head{0};
+    std::atomic<size_t> drops{0};
+};
+
+} // namespace zerosum
@@ -31,7 +31,9 @@
 #include <algorithm>
 #include <array>
 #include <mutex>
+#include <unordered_map>
 #include "utils.h"
+#include "timeseries.h"
 #ifdef USE_HWLOC
 #include "hwloc_zs.h"
 #endif
@@ -45,16 +47,31 @@ enum ThreadType { Main = 0x1,
                   OpenMP = 0x4,
                   Other = 0x8 };
 
+/* One reading of a thread's /proc state, plus any counters from our own
+ * wrappers. Callers reuse one sample across threads and periods. */
+class LWPSample {
+public:
+    thread_stat_t stat{};
+    thread_status_t status{};
+    std::vector<std::pair<series::metric_id, uint64_t>> counters;
+    // derived values, like rates and delays, which are not cumulative
+    std::vector<std::pair<series::metric_id, double>> gauges;
+    bool read(const char * statfile, const char * statusfile) {
+        counters.clear();
+        gauges.clear();
+        if (!getThreadStat(statfile, stat)) { return false; }
+        if (!getThreadStatus(statusfile, status)) { return false; }
+        return true;
+    }
+};
+
 class LWP {
 public:
-    LWP(uint32_t _id, std::vector<uint32_t> allowed_hwt,
-        std::map<std::string, std::string> fields, uint32_t step,
+    LWP(uint32_t _id, const LWPSample& sample, uint32_t step,
         ThreadType _type = Other) : id(_id), type(_type) {
-        for (auto t : allowed_hwt) {
-            hwthreads.insert(t);
-        }
-        extractFields(fields);
-        steps.push_back(step);
+        CPU_ZERO(&cpus);
+        setAffinity(sample.status);
+        extractFields(sample, step);
     }
     //LWP(uint32_t _id, ThreadType _type) : id(_id), type(_type) { }
     LWP() = default;
@@ -66,7 +83,7 @@ public:
         type = lwp.type;
         type_id = lwp.type_id;
         hwthreads = lwp.hwthreads;
-        stat_fields = lwp.stat_fields;
+        data = lwp.data;
     }
     */
     uint32_t id;
@@ -74,67 +91,90 @@ public:
     uint32_t type_id;
     // The cores this lwp can run on
     std::set<uint32_t> hwthreads;
+    cpu_set_t cpus{};
     // The relevant /proc/self/task/tid/stat fields
-    std::map<std::string, std::vector<std::string>> stat_fields;
-    std::vector<uint32_t> steps;
-    void update(std::vector<uint32_t> allowed_hwt, std::map<std::string, std::string> fields,
-        ThreadType _type, uint32_t step) {
-        hwthreads.clear();
-        for (auto t : allowed_hwt) {
-            hwthreads.insert(t);
-        }
+    series::TimeSeries data;
+    void update(const LWPSample& sample, ThreadType _type, uint32_t step) {
+        setAffinity(sample.status);
         if (_type != Other) {
             type |= _type;
         }
-        extractFields(fields);
-        steps.push_back(step);
+        extractFields(sample, step);
     }
-    void extractFields(std::map<std::string, std::string> fields) {
-        for (auto f : fields) {
-            if (stat_fields.count(f.first) == 0) {
-                std::vector<std::string> v;
-                stat_fields.insert(std::pair(f.first, v));
-            }
-            // this might be a new thread that wasn't around before, if so
-            // make sure we have enough slots to account for previous steps.
-            while (stat_fields[f.first].size() < steps.size()) {
-                stat_fields[f.first].push_back("0");
-            }
-            stat_fields[f.first].push_back(f.second);
-            std::string tmpstr{"LWP_" + std::to_string(id) + ":" + f.first};
-	    // this can be a mix of metadata and measurements...
-	    // if it's not a number, handle the exception
-	    try{
-            PERFSTUBS_SAMPLE_COUNTER_SIMPLE(tmpstr.c_str(), stof(f.second));
-	    } catch (...) {}
+    /* The affinity rarely changes, so only rebuild the set when it does */
+    void setAffinity(const thread_status_t& status) {
+        if (!status.has_cpus_allowed ||
+            CPU_EQUAL(&cpus, &status.cpus_allowed)) { return; }
+        cpus = status.cpus_allowed;
+        hwthreads.clear();
+        for (auto t : toList(cpus)) {
+            hwthreads.insert(t);
         }
     }
-    std::string strSub(std::string lhs, std::string rhs) {
-        unsigned a = atol(lhs.c_str());
-        unsigned b = atol(rhs.c_str());
-        unsigned result = a>b ? a-b : 0;
-        std::string tmpstr{std::to_string(result)};
-        return tmpstr;
+    void extractFields(const LWPSample& sample, uint32_t step) {
+        static const series::metric_id state{series::Metrics::intern("state")};
+        static const std::array<series::metric_id,8> ids{
+            series::Metrics::intern("minflt"),
+            series::Metrics::intern("majflt"),
+            series::Metrics::intern("utime"),
+            series::Metrics::intern("stime"),
+            series::Metrics::intern("nswap"),
+            series::Metrics::intern("processor"),
+            series::Metrics::intern("voluntary_ctxt_switches"),
+            series::Metrics::intern("nonvoluntary_ctxt_switches")};
+        const std::array<uint64_t,8> values{
+            sample.stat.minflt, sample.stat.majflt,
+            sample.stat.utime, sample.stat.stime,
+            sample.stat.nswap, sample.stat.processor,
+            sample.status.voluntary_ctxt_switches,
+            sample.status.nonvoluntary_ctxt_switches};
+        data.begin(step);
+        data.setState(state, sample.stat.state);
+        for (size_t f = 0 ; f < ids.size() ; f++) {
+            data.set(ids[f], values[f]);
+            sampleCounter(ids[f], values[f]);
+        }
+        for (auto& c : sample.counters) {
+            data.set(c.first, c.second);
+            sampleCounter(c.first, c.second);
+        }
+        for (auto& g : sample.gauges) {
+            data.set(g.first, g.second);
+        }
+        data.end();
+    }
+    void sampleCounter(series::metric_id metric, uint64_t value) {
+#ifdef PERFSTUBS_USE_TIMERS
+        std::string tmpstr{"LWP_" + std::to_string(id) + ":" +
+            series::Metrics::name(metric)};
+        PERFSTUBS_SAMPLE_COUNTER_SIMPLE(tmpstr.c_str(), (double)value);
+#else
+        UNUSED(metric);
+        UNUSED(value);
+#endif
     }
     std::string getFields() {
         std::string tmpstr;
-        for (auto sf : stat_fields) {
-            tmpstr += sf.first;
+        for (auto c : data.sorted()) {
+            tmpstr += c->name();
             tmpstr += ": ";
-            bool comma = false;
-            if (sf.first.compare("state") != 0 &&
-                sf.first.compare("processor") != 0) {
-                auto previous = sf.second[0];
-                for (auto v : sf.second) {
+            // the counters are printed as deltas, the gauges (which are
+            // doubles), the state and the processor as they were recorded
+            bool deltas = (c->kind == series::Kind::Unsigned &&
+                c->name().compare("processor") != 0);
+            std::string history{c->historyToString(deltas)};
+            bool comma = !history.empty();
+            tmpstr += history;
+            if (deltas) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += strSub(v,previous);
+                    tmpstr += std::to_string(c->delta(i));
                     comma = true;
-                    previous = v;
                 }
             } else {
-                for (auto v : sf.second) {
+                for (size_t i = c->first() ; i < c->size() ; i++) {
                     if (comma) { tmpstr += ","; }
-                    tmpstr += v;
+                    tmpstr += c->toString(i);
                     comma = true;
                 }
             }
@@ -142,33 +182,6 @@ public:
         }
         return tmpstr;
     }
-    std::string fieldsToCSV(std::string name, uint32_t rank, uint32_t shmrank,
-        size_t& i) {
-        std::string tmpstr;
-        // iterate over steps
-        for ( ; i < steps.size() ; i++) {
-            // for each field...
-            for (auto f : stat_fields) {
-                // did this field have a value for this step?
-                std::string value;
-                try {
-                    value = f.second.at(i);
-                } catch (...) {
-                    continue;
-                }
-                tmpstr += "\"" + name + "\",";
-                tmpstr += std::to_string(rank) + ",";
-                tmpstr += std::to_string(shmrank) + ",";
-                tmpstr += std::to_string(steps.at(i)) + ",";
-                tmpstr += "\"LWP\",\"Metric\",";
-                tmpstr += "\"" + std::to_string(id) + "\",";
-                tmpstr += "\"" + f.first + "\",";
-                tmpstr += "\"" + value + "\"\n";
-            }
-        }
-        return tmpstr;
-    }
-
     std::string typeToString(void) {
         std::string sType;
         if (type & Main) {
@@ -207,39 +220,109 @@ public:
     std::string getSummary(void) {
         std::string tmpstr;
         tmpstr += "LWP " + std::to_string(id) + ": " + typeToString() + " -";
-        for (auto sf : stat_fields) {
-            if (sf.first.compare("utime") == 0 ||
-                sf.first.compare("stime") == 0) {
-                tmpstr += " " + sf.first;
-                tmpstr += ": ";
-                double total = std::stod(sf.second.back());
-                double average = total/(double)(std::max(size_t(1),sf.second.size()-1));
-                char tmp[256] = {0};
-                snprintf(tmp, 255, "%6.2f", average);
-                tmpstr += tmp;
-                tmpstr += ",";
-            }
-        }
-        for (auto sf : stat_fields) {
-            if (sf.first.compare("nonvoluntary_ctxt_switches") == 0) {
-                tmpstr += " nv_ctx";
-                tmpstr += ": ";
-                size_t total = std::stol(sf.second.back());
-                char tmp[256] = {0};
-                snprintf(tmp, 255, "%5lu", total);
-                tmpstr += tmp;
-                tmpstr += ",";
+        static const series::metric_id stime{series::Metrics::intern("stime")};
+        static const series::metric_id utime{series::Metrics::intern("utime")};
+        static const series::metric_id nvctx{series::Metrics::intern("nonvoluntary_ctxt_switches")};
+        static const series::metric_id ctx{series::Metrics::intern("voluntary_ctxt_switches")};
+        // the counters are cumulative, so the last value is the total
+        for (auto m : {stime, utime}) {
+            const series::Column* c = data.find(m);
+            if (c == nullptr || c->empty()) { continue; }
+            tmpstr += " " + c->name();
+            tmpstr += ": ";
+            double total = c->last();
+            // ticks per second, over the measured sampling interval, which
+            // the overhead budget can stretch beyond the THREADS period
+            double average = total/(double)(std::max(size_t(1),c->size()-1))/
+                data.interval(getPeriod("THREADS"));
+            char tmp[256] = {0};
+            snprintf(tmp, 255, "%6.2f", average);
+            tmpstr += tmp;
+            tmpstr += ",";
+        }
+        const std::array<std::pair<series::metric_id, const char*>,2> switches{
+            std::pair(nvctx, " nv_ctx"), std::pair(ctx, " ctx")};
+        for (auto& m : switches) {
+            const series::Column* c = data.find(m.first);
+            if (c == nullptr || c->empty()) { continue; }
+            tmpstr += m.second;
+            tmpstr += ": ";
+            size_t total = c->asUnsigned(c->size()-1);
+            char tmp[256] = {0};
+            snprintf(tmp, 255, "%5lu", total);
+            tmpstr += tmp;
+            tmpstr += ",";
+        }
+        // only sampled with ZS_MUTEX_CONTENTION
+        static const series::metric_id contended{series::Metrics::intern("pthread contended locks")};
+        static const series::metric_id blocked{series::Metrics::intern("pthread blocked ns")};
+        const series::Column* cc = data.find(contended);
+        const series::Column* bc = data.find(blocked);
+        if (cc != nullptr && !cc->empty() && bc != nullptr && !bc->empty()) {
+            char tmp[256] = {0};
+            snprintf(tmp, 255, " contended: %5lu, blocked: %9.3f ms,",
+                cc->asUnsigned(cc->size()-1), bc->asUnsigned(bc->size()-1) * 1.0e-6);
+            tmpstr += tmp;
+        }
+        // only with schedstat support in the kernel
+        static const series::metric_id schedWait{series::Metrics::intern("sched wait ns")};
+        const series::Column* wc = data.find(schedWait);
+        if (wc != nullptr && !wc->empty()) {
+            char tmp[256] = {0};
+            snprintf(tmp, 255, " run delay: %9.3f ms,", wc->asUnsigned(wc->size()-1) * 1.0e-6);
+            tmpstr += tmp;
+        }
+        // only with ZS_PERF_COUNTERS and a PMU
+        static const series::metric_id instructions{series::Metrics::intern("perf instructions")};
+        static const series::metric_id cycles{series::Metrics::intern("perf cycles")};
+        const series::Column* ic = data.find(instructions);
+        const series::Column* yc = data.find(cycles);
+        if (ic != nullptr && !ic->empty() && yc != nullptr && !yc->empty() &&
+            yc->asUnsigned(yc->size()-1) > 0) {
+            char tmp[256] = {0};
+            snprintf(tmp, 255, " IPC: %5.2f,", (double)ic->asUnsigned(ic->size()-1) /
+                (double)yc->asUnsigned(yc->size()-1));
+            tmpstr += tmp;
+        }
+        // only sampled with ZS_POSIX_IO, summed over the descriptor classes
+        static const std::array<std::array<series::metric_id, 3>, 4> io = [] {
+            std::array<std::array<series::metric_id, 3>, 4> tmp;
+            const std::array<const char*, 4> classes{"file", "socket", "pipe", "other"};
+            for (size_t i = 0 ; i < classes.size() ; i++) {
+                std::string prefix{std::string("io ") + classes[i]};
+                tmp[i][0] = series::Metrics::intern(prefix + " read bytes");
+                tmp[i][1] = series::Metrics::intern(prefix + " write bytes");
+                tmp[i][2] = series::Metrics::intern(prefix + " ns");
             }
-            if (sf.first.compare("voluntary_ctxt_switches") == 0) {
-                tmpstr += " ctx";
-                tmpstr += ": ";
-                size_t total = std::stol(sf.second.back());
-                char tmp[256] = {0};
-                snprintf(tmp, 255, "%5lu", total);
-                tmpstr += tmp;
-                tmpstr += ",";
+            return tmp;
+        }();
+        std::array<uint64_t, 3> ioTotals{0, 0, 0};
+        bool didIO{false};
+        for (auto& ids : io) {
+            for (size_t i = 0 ; i < ids.size() ; i++) {
+                const series::Column* c = data.find(ids[i]);
+                if (c == nullptr || c->empty()) { continue; }
+                ioTotals[i] += c->asUnsigned(c->size()-1);
+                didIO = true;
             }
         }
+        if (didIO) {
+            char tmp[256] = {0};
+            snprintf(tmp, 255, " io read: %9.3f MB, write: %9.3f MB, time: %9.3f ms,",
+                ioTotals[0] * 1.0e-6, ioTotals[1] * 1.0e-6, ioTotals[2] * 1.0e-6);
+            tmpstr += tmp;
+        }
+        // only sampled with ZS_ALLOCATIONS
+        static const series::metric_id mallocBytes{series::Metrics::intern("malloc bytes")};
+        static const series::metric_id liveBytes{series::Metrics::intern("live bytes")};
+        const series::Column* mc = data.find(mallocBytes);
+        const series::Column* lc = data.find(liveBytes);
+        if (mc != nullptr && !mc->empty() && lc != nullptr && !lc->empty()) {
+            char tmp[256] = {0};
+            snprintf(tmp, 255, " malloc: %9.3f MB, live: %9.3f MB,",
+                mc->asUnsigned(mc->size()-1) * 1.0e-6, lc->asUnsigned(lc->size()-1) * 1.0e-6);
+            tmpstr += tmp;
+        }
         tmpstr += " CPUs allowed: [" + ::zerosum::toString(hwthreads) + "]";
         return tmpstr;
     }
@@ -253,35 +336,32 @@ inline bool operator<(const LWP& lhs, const LWP& rhs) {
 class Process {
 public:
     Process(uint32_t _id, uint32_t _rank, uint32_t _size,
-        std::map<std::string, std::string> _fields,
-        std::vector<uint32_t> allowed_hwt) : id(_id), rank(_rank), size(_size), shmrank(_rank) {
-        /* We need a lock because the async thread and OMPT callback can report threads */
+        const LWPSample& sample) : id(_id), rank(_rank), size(_size), shmrank(_rank) {
+        /* Only the async thread adds threads, but the main thread reads them at exit */
         std::unique_lock<std::mutex> lk(thread_mtx);
-        for (auto t : allowed_hwt) {
-            hwthreads.insert(t);
+        if (sample.status.has_cpus_allowed) {
+            for (auto t : toList(sample.status.cpus_allowed)) {
+                hwthreads.insert(t);
+            }
         }
         // pid should be the same as tid, but just in case...
-        threads.insert(std::pair(id, LWP(gettid(), allowed_hwt, _fields, ThreadType::Main)));
-        if (_fields.count("executable") > 0) {
-            executable = _fields["executable"];
-        }
-        fields = _fields;
+        threads.insert(std::pair(id, LWP(gettid(), sample, 0, ThreadType::Main)));
     }
     Process() = default;
     ~Process() = default;
-    void add(uint32_t tid, std::vector<uint32_t> allowed_hwt,
-        std::map<std::string, std::string> fields, uint32_t step, ThreadType type = Other) {
-        /* We need a lock because the async thread and OMPT callback can report threads */
+    void add(uint32_t tid, const LWPSample& sample, uint32_t step, ThreadType type = Other) {
+        /* Only the async thread adds threads, but the main thread reads them at exit */
         std::unique_lock<std::mutex> lk(thread_mtx);
-        if (threads.count(tid) == 0) {
-            threads.insert(std::pair(tid, LWP(tid, allowed_hwt, fields, type)));
+        auto lwp = threads.find(tid);
+        if (lwp == threads.end()) {
+            threads.insert(std::pair(tid, LWP(tid, sample, step, type)));
         } else {
-            threads[tid].update(allowed_hwt, fields, type, step);
+            lwp->second.update(sample, type, step);
         }
         /* In case we have added to our set of HWT, add them */
         static bool addNew = parseBool("ZS_ADD_NEW_HWT", false);
-        if (addNew) {
-            for (auto t : allowed_hwt) {
+        if (addNew && sample.status.has_cpus_allowed) {
+            for (auto t : toList(sample.status.cpus_allowed)) {
                 hwthreads.insert(t);
             }
         }
@@ -300,10 +380,23 @@ public:
     hardware::ComputeNode* computeNode;
     std::map<std::string,std::string> environment;
     std::string executable;
-    std::map<std::string, std::string> fields;
-    std::vector<uint32_t> steps;
     std::map<int, std::pair<size_t, size_t>> sentBytes;
     std::map<int, std::pair<size_t, size_t>> recvBytes;
+    // the totals of the above, sampled periodically
+    series::TimeSeries mpiData;
+    // the memory and I/O of the process, see sampleProcess()
+    series::TimeSeries data;
+    // the NUMA placement of its pages, see sampleNumaMaps(), sampled less often
+    series::TimeSeries numaMaps;
+    // one series per process plugin, by plugin name, each sampled on its own
+    std::map<std::string, series::TimeSeries> pluginData;
+    // the last schedstat of each thread, and its worst period, see schedDelay
+    struct sched_t {
+        uint64_t run_ns{0};
+        uint64_t wait_ns{0};
+        double worst{0.0};
+    };
+    std::unordered_map<uint32_t, sched_t> schedStats;
 
     uint32_t getMaxHWT(void) {
         // this is an iterator, so return the element
@@ -314,6 +407,59 @@ public:
         return (threads.count(hwt) > 0);
     }
 
+    /* The time the thread spent waiting on a run queue since the last sweep.
+     * The worst ratio of waiting to running in a period is kept for the
+     * summary, from the periods where the thread wanted a cpu for at least
+     * a millisecond, so threads that mostly sleep don't trip it. */
+    uint64_t schedDelay(uint32_t lwp, const thread_schedstat_t& schedstat) {
+        sched_t& s = schedStats[lwp];
+        // a new thread, or a reused ID
+        if (schedstat.run_ns < s.run_ns || schedstat.wait_ns < s.wait_ns) { s = sched_t(); }
+        uint64_t ran = schedstat.run_ns - s.run_ns;
+        uint64_t waited = schedstat.wait_ns - s.wait_ns;
+        if (ran + waited >= 1000000) {
+            double ratio = (double)waited / (double)std::max(ran, (uint64_t)1000);
+            s.worst = std::max(s.worst, ratio);
+        }
+        s.run_ns = schedstat.run_ns;
+        s.wait_ns = schedstat.wait_ns;
+        return waited;
+    }
+
+    /* The threads that waited to run for more than ZS_SCHED_WAIT_RATIO of
+     * the time they ran, which on a busy node means they share a cpu. Less
+     * than ZS_SCHED_WAIT_MIN seconds of waiting over the run, by default
+     * one THREADS period, isn't worth a warning. */
+    std::string schedSummary(void) {
+        static double threshold{parseDouble("ZS_SCHED_WAIT_RATIO", 0.2)};
+        static double minimum{parseDouble("ZS_SCHED_WAIT_MIN", getPeriod("THREADS")) * 1.0e9};
+        static const series::metric_id schedRun{series::Metrics::intern("sched run ns")};
+        static const series::metric_id schedWait{series::Metrics::intern("sched wait ns")};
+        std::string result;
+        std::unique_lock<std::mutex> lk(thread_mtx);
+        for (auto& t : threads) {
+            const series::Column* rc = t.second.data.find(schedRun);
+            const series::Column* wc = t.second.data.find(schedWait);
+            if (rc == nullptr || rc->empty() || wc == nullptr || wc->empty()) { continue; }
+            double ran = (double)rc->asUnsigned(rc->size()-1);
+            double waited = (double)wc->asUnsigned(wc->size()-1);
+            if (ran <= 0.0 || waited < minimum || waited / ran <= threshold) { continue; }
+            auto s = schedStats.find(t.first);
+            char buffer[256];
+            snprintf(buffer, sizeof(buffer),
+                "  LWP %u: [%s] ran %.3f s, waited %.3f s to run (%.0f%%), worst period %.0f%%\n",
+                t.first, t.second.typeToString().c_str(), ran * 1.0e-9, waited * 1.0e-9,
+                100.0 * waited / ran, s == schedStats.end() ? 0.0 : 100.0 * s->second.worst);
+            result += buffer;
+        }
+        if (result.empty()) { return result; }
+        char header[128];
+        snprintf(header, sizeof(header),
+            "\nThreads that waited to run more than %.0f%% of their run time (oversubscribed):\n",
+            100.0 * threshold);
+        return header + result;
+    }
+
     std::string toLog(void) {
         char buffer[1025];
         snprintf(buffer, 1024,
@@ -414,7 +560,7 @@ public:
         /* TODO: Need to convert utime and stime by dividing by sysconf(_SC_CLK_TCK) */
         if (nthreads < threads.size()) {
             size_t index{0};
-            for (auto t : threads) {
+            for (auto& t : threads) {
                 if (index++ >= nthreads) {
                     tmpstr += t.second.toString(shutdown);
                 }
@@ -423,6 +569,44 @@ public:
         nthreads = threads.size();
         return tmpstr;
     }
+    /* The last value of a process metric, or -1 if it wasn't sampled */
+    double last(series::metric_id id) {
+        const series::Column* c = data.find(id);
+        if (c == nullptr) { c = numaMaps.find(id); }
+        return (c == nullptr || c->empty()) ? -1.0 : c->last();
+    }
+    std::string getMemorySummary(void) {
+        static const series::metric_id hwm{series::Metrics::intern("VmHWM kB")};
+        static const series::metric_id rss{series::Metrics::intern("Rss kB")};
+        static const series::metric_id pss{series::Metrics::intern("Pss kB")};
+        static const series::metric_id swap{series::Metrics::intern("VmSwap kB")};
+        static const series::metric_id rchar{series::Metrics::intern("rchar")};
+        static const series::metric_id wchar{series::Metrics::intern("wchar")};
+        static const series::metric_id mapped{series::Metrics::intern("numa mapped kB")};
+        static const series::metric_id remote{series::Metrics::intern("numa remote kB")};
+        std::string tmpstr;
+        char buffer[256];
+        if (last(hwm) >= 0.0) {
+            snprintf(buffer, sizeof(buffer),
+                "Memory (MB): peak RSS = %.1f, RSS = %.1f, PSS = %.1f, swap = %.1f\n",
+                last(hwm) / 1024.0, std::max(0.0, last(rss)) / 1024.0,
+                std::max(0.0, last(pss)) / 1024.0, std::max(0.0, last(swap)) / 1024.0);
+            tmpstr += buffer;
+        }
+        if (last(rchar) >= 0.0) {
+            snprintf(buffer, sizeof(buffer), "I/O (MB): read = %.1f, written = %.1f\n",
+                last(rchar) / 1048576.0, std::max(0.0, last(wchar)) / 1048576.0);
+            tmpstr += buffer;
+        }
+        // pages that first touch put on a node none of our cpus are on
+        if (last(mapped) > 0.0) {
+            snprintf(buffer, sizeof(buffer),
+                "NUMA: %.1f MB mapped, %.1f%% on remote nodes\n", last(mapped) / 1024.0,
+                100.0 * std::max(0.0, last(remote)) / last(mapped));
+            tmpstr += buffer;
+        }
+        return tmpstr;
+    }
     std::string getSummary(bool details = true) {
         std::string tmpstr;
         if (details) {
@@ -448,11 +632,14 @@ public:
                 id, executable.c_str(), discrete.c_str());
         }
         tmpstr += buffer;
+        if (details) {
+            tmpstr += getMemorySummary();
+        }
 
         if (details) {
             // print total threads
             tmpstr += "\nLWP (thread) Summary:\n";
-            for (auto t : threads) {
+            for (auto& t : threads) {
                 tmpstr += t.second.getSummary();
                 tmpstr += "\n";
             }
@@ -499,59 +686,6 @@ public:
         return tmpstr;
     }
 
-    std::string fieldsToCSV(uint32_t rank, uint32_t shmrank,
-        size_t& i) {
-        std::string tmpstr;
-        // write the environment
-        for (auto env : environment) {
-            tmpstr += "\"" + computeNode->name + "\",";
-            tmpstr += std::to_string(rank) + ",";
-            tmpstr += std::to_string(shmrank) + ",";
-            tmpstr += "0,";
-            tmpstr += "\"Node\",\"Property\",";
-            tmpstr += "\"0\",";
-            tmpstr += "\"" + env.first + "\",";
-            tmpstr += "\"" + env.second + "\"\n";
-        }
-        // iterate over steps
-        for ( ; i < steps.size() ; i++) {
-            // for each field...
-            for (auto f : fields) {
-                // did this field have a value for this step?
-                std::string value;
-                try {
-                    value = f.second.at(i);
-                } catch (...) {
-                    continue;
-                }
-                tmpstr += "\"" + computeNode->name + "\",";
-                tmpstr += std::to_string(rank) + ",";
-                tmpstr += std::to_string(shmrank) + ",";
-                tmpstr += std::to_string(steps.at(i)) + ",";
-                tmpstr += "\"Node\",\"Metric\",";
-                tmpstr += "\"0\",";
-                tmpstr += "\"" + f.first + "\",";
-                tmpstr += "\"" + value + "\"\n";
-            }
-        }
-        return tmpstr;
-    }
-
-    std::string toCSV(size_t& lastValueWritten) {
-        std::string outstr;
-        auto saveme = lastValueWritten;
-        outstr += fieldsToCSV(rank, shmrank, lastValueWritten);
-        for (auto lwp : threads) {
-            lastValueWritten = saveme;
-            outstr += lwp.second.fieldsToCSV(computeNode->name, rank, shmrank, lastValueWritten);
-        }
-        return outstr;
-    }
-    std::string toCSV(void) {
-        size_t lastValueWritten{0};
-        return toCSV(lastValueWritten);
-    }
-
     void recordSentBytes(int rank, size_t bytes) {
         if (sentBytes.count(rank) == 0) {
             sentBytes.insert(std::pair(rank, std::pair(0, 0)));
@@ -0,0 +1,241 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stack_sampler.h"
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <fstream>
+#include <algorithm>
+#include "utils.h"
+
+namespace zerosum {
+
+/* The handler's own frame and the signal trampoline */
+#define ZS_STACK_SKIP 2
+
+/* The CPU time clock of any thread in the process, as glibc's
+ * pthread_getcpuclockid() makes it, but from the thread ID */
+static clockid_t threadClock(uint32_t tid) {
+    return (clockid_t)((~(clockid_t)tid) << 3) | 2 /* CPUCLOCK_SCHED */
+        | 4 /* CPUCLOCK_PERTHREAD_MASK */;
+}
+
+/* Only touches the ring of the interrupted thread, which the timer passes
+ * in the signal value. backtrace() doesn't allocate once it has been
+ * called, so the constructor calls it first. */
+static void stackHandler(int sig, siginfo_t * info, void * context) {
+    UNUSED(sig);
+    UNUSED(context);
+    if (info->si_code != SI_TIMER || info->si_value.sival_ptr == nullptr) { return; }
+    int err = errno;
+    auto ring = (StackSampler::ring_t*)info->si_value.sival_ptr;
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) > ring->mask) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        auto& s = ring->stacks[head & ring->mask];
+        s.depth = (uint32_t)backtrace(s.frames, (int)StackSampler::depth);
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+    errno = err;
+}
+
+static struct sigaction previousAction;
+
+/* The rings hold two periods of samples, so the sweeps can keep up */
+StackSampler::StackSampler(double hz, double period) :
+    interval_ns((uint64_t)(1.0e9 / std::max(hz, 1.0))), capacity(64) {
+    while ((double)capacity < 2.0 * hz * period) { capacity *= 2; }
+    void * dummy = nullptr;
+    backtrace(&dummy, 1);
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = stackHandler;
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    installed = (sigaction(SIGPROF, &act, &previousAction) == 0);
+}
+
+StackSampler::~StackSampler() {
+    stop();
+}
+
+size_t StackSampler::frames_hash::operator()(const std::vector<void*>& frames) const {
+    size_t h = frames.size();
+    for (auto f : frames) {
+        h ^= std::hash<void*>()(f) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+void StackSampler::beginSweep(void) {
+    generation++;
+    // two sweeps after its timer was deleted, no signal can still be pending
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+        [this](const auto& r) { return generation - r.first > 2; }), retired.end());
+}
+
+void StackSampler::track(uint32_t tid) {
+    if (!installed) { return; }
+    auto t = threads.find(tid);
+    if (t != threads.end()) {
+        t->second.generation = generation;
+        drain(*(t->second.ring));
+        return;
+    }
+    sampled_thread_t thread;
+    thread.generation = generation;
+    thread.ring = std::make_unique<ring_t>();
+    thread.ring->mask = capacity - 1;
+    thread.ring->stacks = std::make_unique<stack_t[]>(capacity);
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev._sigev_un._tid = (pid_t)tid;
+    sev.sigev_value.sival_ptr = thread.ring.get();
+    if (timer_create(threadClock(tid), &sev, &thread.timer) != 0) {
+        // the thread has already exited
+        failed++;
+        return;
+    }
+    struct itimerspec its;
+    its.it_interval.tv_sec = (time_t)(interval_ns / 1000000000ULL);
+    its.it_interval.tv_nsec = (long)(interval_ns % 1000000000ULL);
+    its.it_value = its.it_interval;
+    timer_settime(thread.timer, 0, &its, nullptr);
+    threads.emplace(tid, std::move(thread));
+    sampledThreads++;
+}
+
+void StackSampler::retire(sampled_thread_t& thread) {
+    timer_delete(thread.timer);
+    drain(*(thread.ring));
+    retired.emplace_back(generation, std::move(thread.ring));
+}
+
+void StackSampler::endSweep(void) {
+    for (auto t = threads.begin() ; t != threads.end() ; ) {
+        if (t->second.generation != generation) {
+            retire(t->second);
+            t = threads.erase(t);
+        } else {
+            ++t;
+        }
+    }
+}
+
+void StackSampler::stop(void) {
+    if (!installed) { return; }
+    for (auto& t : threads) { retire(t.second); }
+    threads.clear();
+    for (auto& r : retired) { drain(*(r.second)); }
+    /* A signal may still be pending, and SIGPROF's default action is to
+     * terminate, so only restore a handler the application installed */
+    if (previousAction.sa_handler == SIG_DFL) {
+        signal(SIGPROF, SIG_IGN);
+    } else {
+        sigaction(SIGPROF, &previousAction, nullptr);
+    }
+    installed = false;
+}
+
+void StackSampler::drain(ring_t& ring) {
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    std::vector<void*> frames;
+    for ( ; tail != head ; tail++) {
+        auto& s = ring.stacks[tail & ring.mask];
+        if (s.depth > ZS_STACK_SKIP) {
+            frames.assign(s.frames + ZS_STACK_SKIP, s.frames + s.depth);
+            stacks[frames]++;
+        }
+        samples++;
+    }
+    ring.tail.store(tail, std::memory_order_release);
+    dropped += ring.dropped.exchange(0);
+}
+
+/* The function name, demangled, or the library and offset if it has none */
+std::string StackSampler::symbol(void * address) {
+    auto cached = symbols.find(address);
+    if (cached != symbols.end()) { return cached->second; }
+    std::string name;
+    Dl_info info;
+    if (dladdr(address, &info) != 0 && info.dli_sname != nullptr) {
+        int status = 0;
+        char * demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        name = (status == 0 && demangled != nullptr) ? demangled : info.dli_sname;
+        free(demangled);
+    } else if (dladdr(address, &info) != 0 && info.dli_fname != nullptr) {
+        const char * base = strrchr(info.dli_fname, '/');
+        char offset[32];
+        snprintf(offset, sizeof(offset), "+0x%lx",
+            (unsigned long)((char*)address - (char*)info.dli_fbase));
+        name = std::string(base == nullptr ? info.dli_fname : base + 1) + offset;
+    } else {
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "%p", address);
+        name = tmp;
+    }
+    // the folded format separates frames with ';'
+    std::replace(name.begin(), name.end(), ';', ':');
+    symbols[address] = name;
+    return name;
+}
+
+/* Root first. The leaf is the interrupted instruction, the other frames
+ * are return addresses, so look up the call instruction before them. */
+bool StackSampler::write(const std::string& filename) {
+    if (stacks.empty()) { return false; }
+    std::ofstream out(filename);
+    if (!out.is_open()) { return false; }
+    std::string line;
+    for (auto& s : stacks) {
+        line.clear();
+        for (size_t i = s.first.size() ; i > 0 ; i--) {
+            char * address = (char*)s.first[i-1];
+            if (i > 1) { address--; }
+            if (!line.empty()) { line += ';'; }
+            line += symbol(address);
+        }
+        out << line << ' ' << s.second << '\n';
+    }
+    return true;
+}
+
+std::string StackSampler::summary(void) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+        "\nStack sampling: %lu stack samples from %lu threads, %lu distinct, "
+        "%lu dropped, every %.3f ms of thread CPU time\n",
+        samples, sampledThreads, stacks.size(), dropped, interval_ns * 1.0e-6);
+    return std::string(buffer);
+}
+
+} // namespace zerosum
@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <time.h>
+
+namespace zerosum {
+
+/* Statistical call stack sampling. Every application thread gets a timer
+ * on its own CPU time clock, which sends it SIGPROF at ZS_STACK_HZ. The
+ * handler unwinds the thread's stack with backtrace() into a ring that
+ * only that thread writes and only the async thread reads. Each sweep
+ * over the threads drains the rings and counts the distinct stacks, and
+ * write() symbolizes them as folded stacks, one "frame;frame;frame count"
+ * line per stack, for flamegraph.pl and friends. */
+class StackSampler {
+public:
+    explicit StackSampler(double hz, double period);
+    ~StackSampler();
+    StackSampler(const StackSampler&) = delete;
+    StackSampler& operator=(const StackSampler&) = delete;
+    bool valid(void) const { return installed; }
+    /* Like TaskFileCache, a thread that isn't tracked during a sweep has
+     * exited, and its timer is deleted at the end of the sweep */
+    void beginSweep(void);
+    void track(uint32_t tid);
+    void endSweep(void);
+    /* Stop all the timers and drain what is left */
+    void stop(void);
+    bool write(const std::string& filename);
+    std::string summary(void);
+    static constexpr size_t depth{48};
+    typedef struct stack {
+        uint32_t depth;
+        void * frames[StackSampler::depth];
+    } stack_t;
+    typedef struct ring {
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        uint64_t mask{0};
+        std::unique_ptr<stack_t[]> stacks;
+    } ring_t;
+private:
+    typedef struct sampled_thread {
+        timer_t timer;
+        std::unique_ptr<ring_t> ring;
+        uint32_t generation;
+    } sampled_thread_t;
+    struct frames_hash {
+        size_t operator()(const std::vector<void*>& frames) const;
+    };
+    void drain(ring_t& ring);
+    void retire(sampled_thread_t& thread);
+    std::string symbol(void * address);
+    std::unordered_map<uint32_t, sampled_thread_t> threads;
+    // rings of deleted timers, whose signal may still be pending
+    std::vector<std::pair<uint32_t, std::unique_ptr<ring_t>>> retired;
+    std::unordered_map<std::vector<void*>, uint64_t, frames_hash> stacks;
+    std::unordered_map<void*, std::string> symbols;
+    uint64_t interval_ns;
+    uint64_t capacity;
+    uint32_t generation{0};
+    uint64_t samples{0};
+    uint64_t dropped{0};
+    uint64_t failed{0};
+    size_t sampledThreads{0};
+    bool installed{false};
+};
+
+} // namespace zerosum
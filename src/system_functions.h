@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Finding the real functions behind the LD_PRELOAD wrappers. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define RESET_DLERROR() dlerror()
+#define CHECK_DLERROR() { \
+  char const * err = dlerror(); \
+  if (err) { \
+    printf("Error getting %s handle: %s\n", name, err); \
+    fflush(stdout); \
+    exit(1); \
+  } \
+}
+
+static inline void * get_system_function_handle(char const * name, void * caller) {
+    void * handle;
+    // Reset error pointer
+    RESET_DLERROR();
+    // Attempt to get the function handle
+    handle = dlsym(RTLD_NEXT, name);
+    // Detect errors
+    CHECK_DLERROR();
+    // Prevent recursion if more than one wrapping approach has been loaded.
+    // This happens because we support wrapping pthreads three ways at once:
+    // #defines in Profiler.h, -Wl,-wrap on the link line, and LD_PRELOAD.
+    if (handle == caller) {
+        RESET_DLERROR();
+        void * syms = dlopen(NULL, RTLD_NOW);
+        CHECK_DLERROR();
+        do {
+            RESET_DLERROR();
+            handle = dlsym(syms, name);
+            CHECK_DLERROR();
+        } while (handle == caller);
+    }
+    return handle;
+}
+
+/* glibc has two pthread_cond_* implementations, and on some systems an
+ * unversioned dlsym() finds the old one, which can't wait on a condition
+ * variable that the new one initialized. Ask for the new one by version. */
+static inline void * get_versioned_function_handle(char const * name,
+    char const * version, void * caller) {
+    void * handle = dlvsym(RTLD_NEXT, name, version);
+    if (handle == nullptr || handle == caller) {
+        return get_system_function_handle(name, caller);
+    }
+    return handle;
+}
+
+/* For timing the wrapped calls */
+static inline uint64_t monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,556 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include "utils.h"
+
+namespace zerosum {
+
+namespace series {
+
+/* Every metric name is interned once, and the series only store the ID. */
+typedef uint32_t metric_id;
+
+/* The type of the values in a column. Most /proc and sysfs values are
+ * unsigned counters, some derived and GPU values are doubles, and the
+ * thread state is a single character. */
+enum class Kind : uint8_t { Unsigned = 0, Double = 1, State = 2 };
+
+union Value {
+    uint64_t u;
+    double d;
+};
+
+/* Nanoseconds on the monotonic clock, used as the sample timestamp. */
+inline uint64_t now(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* The process-wide dictionary of metric names. The async thread and the
+ * OMPT callbacks can both add metrics, so it is protected with a lock.
+ * The names are stored in a deque so references to them remain valid. */
+class Metrics {
+public:
+    static metric_id intern(const std::string& name) {
+        std::lock_guard<std::mutex> l{instance().mtx};
+        auto& ids = instance().ids;
+        auto found = ids.find(name);
+        if (found != ids.end()) { return found->second; }
+        metric_id id = instance().names.size();
+        instance().names.push_back(name);
+        ids.insert(std::pair(name, id));
+        return id;
+    }
+    /* Like intern(), but a name that was never added isn't, it's unknown */
+    static constexpr metric_id unknown{std::numeric_limits<metric_id>::max()};
+    static metric_id lookup(const std::string& name) {
+        std::lock_guard<std::mutex> l{instance().mtx};
+        auto& ids = instance().ids;
+        auto found = ids.find(name);
+        return found == ids.end() ? unknown : found->second;
+    }
+    static const std::string& name(metric_id id) {
+        std::lock_guard<std::mutex> l{instance().mtx};
+        return instance().names[id];
+    }
+private:
+    static Metrics& instance(void) {
+        static Metrics theMetrics;
+        return theMetrics;
+    }
+    std::mutex mtx;
+    std::deque<std::string> names;
+    std::unordered_map<std::string, metric_id> ids;
+};
+
+/* A vector addressed by the absolute row index. With a capacity, only the
+ * most recent rows are retained and the slot of the oldest one is reused,
+ * so indices (and cursors into the series) stay valid as rows age out. */
+template<typename T>
+class Ring {
+public:
+    explicit Ring(size_t _capacity = 0) : capacity(_capacity) {}
+    size_t first(void) const { return head; }
+    size_t size(void) const { return tail; }
+    bool empty(void) const { return head == tail; }
+    bool full(void) const { return capacity > 0 && (tail - head) >= capacity; }
+    T& operator[](size_t i) { return items[slot(i)]; }
+    const T& operator[](size_t i) const { return items[slot(i)]; }
+    T& back(void) { return items[slot(tail-1)]; }
+    const T& back(void) const { return items[slot(tail-1)]; }
+    void push_back(const T& v) {
+        if (capacity == 0 || items.size() < capacity) {
+            items.push_back(v);
+        } else {
+            items[slot(tail)] = v;
+        }
+        tail++;
+    }
+    void pop_front(void) { if (head < tail) { head++; } }
+    /* Start out as if rows [_head,_tail) had all been set to v */
+    void fill(size_t _head, size_t _tail, const T& v) {
+        head = _head;
+        tail = _tail;
+        items.assign((capacity > 0) ? std::min(tail, capacity) : tail, v);
+    }
+    template<typename F> void forEach(F f) { for (auto& i : items) { f(i); } }
+private:
+    size_t slot(size_t i) const { return capacity > 0 ? i % capacity : i; }
+    size_t capacity;
+    std::vector<T> items;
+    size_t head{0};
+    size_t tail{0};
+};
+
+/* Streaming count, sum, min and max, with Welford's running variance.
+ * Two sets can be merged (Chan et al.), which is how the downsampled
+ * buckets roll up into coarser ones. */
+struct Moments {
+    uint64_t count{0};
+    double sum{0.0};
+    double min{0.0};
+    double max{0.0};
+    double mu{0.0};
+    double m2{0.0};
+    void add(double value) {
+        if (count == 0) { min = max = value; }
+        count++;
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        double d = value - mu;
+        mu += d / (double)count;
+        m2 += d * (value - mu);
+    }
+    void merge(const Moments& other) {
+        if (other.count == 0) { return; }
+        if (count == 0) { *this = other; return; }
+        double n = (double)(count + other.count);
+        double d = other.mu - mu;
+        mu += d * ((double)other.count / n);
+        m2 += other.m2 + (d * d * ((double)count * (double)other.count / n));
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+    double mean(void) const { return count > 0 ? sum / (double)count : 0.0; }
+    double variance(void) const { return count > 1 ? m2 / (double)(count - 1) : 0.0; }
+    double stddev(void) const { return std::sqrt(variance()); }
+};
+
+/* The statistics of the values over a run of rows, and of their deltas.
+ * Used for the downsampled history and the whole-run totals, so summaries
+ * don't depend on how many rows are still retained. */
+struct Aggregate {
+    uint32_t firstStep{0};
+    uint32_t lastStep{0};
+    double last{0.0};
+    Moments values;
+    // the first row of a series has no delta
+    Moments deltas;
+    void add(uint32_t step, double value) {
+        if (values.count == 0) { firstStep = step; }
+        lastStep = step;
+        last = value;
+        values.add(value);
+    }
+    void addDelta(double delta) { deltas.add(delta); }
+    void merge(const Aggregate& other) {
+        if (other.values.count > 0) {
+            if (values.count == 0) { firstStep = other.firstStep; }
+            lastStep = other.lastStep;
+            last = other.last;
+        }
+        values.merge(other.values);
+        deltas.merge(other.deltas);
+    }
+};
+
+/* Rows that age out of the ring are folded into buckets of
+ * historyFactor rows, those into buckets of historyFactor^2 rows, and so on.
+ * Each level keeps capacity/historyFactor buckets, so the history costs a
+ * fraction of the ring; whatever falls off the last level is only kept in
+ * the whole-run total. */
+constexpr size_t historyFactor{10};
+constexpr size_t historyLevels{2};
+
+/* A downsampled run of rows: only the means are reported from it, the
+ * whole-run statistics come from Column::summary() */
+struct Bucket {
+    uint32_t count{0};
+    uint32_t deltaCount{0};
+    double sum{0.0};
+    double deltaSum{0.0};
+    void merge(const Bucket& other) {
+        count += other.count;
+        deltaCount += other.deltaCount;
+        sum += other.sum;
+        deltaSum += other.deltaSum;
+    }
+    double mean(void) const { return count > 0 ? sum / count : 0.0; }
+    double deltaMean(void) const {
+        return deltaCount > 0 ? deltaSum / deltaCount : 0.0;
+    }
+};
+
+struct Level {
+    size_t span;            // rows per bucket
+    std::deque<Bucket> buckets;
+    Bucket partial;         // the bucket being filled
+};
+
+/* One metric, one value per row of the owning series. */
+class Column {
+public:
+    Column(metric_id _id, Kind _kind, size_t _capacity = 0) :
+        id(_id), kind(_kind), values(_capacity), capacity(_capacity) {
+        evicted.u = 0;
+    }
+    metric_id id;
+    Kind kind;
+    Ring<Value> values;
+    const std::string& name(void) const { return Metrics::name(id); }
+    /* The number of rows ever stored, and the oldest one still retained */
+    size_t size(void) const { return values.size(); }
+    size_t first(void) const { return values.first(); }
+    bool empty(void) const { return values.size() == 0; }
+    double asDouble(size_t i) const {
+        return kind == Kind::Double ? values[i].d : (double)(values[i].u);
+    }
+    uint64_t asUnsigned(size_t i) const {
+        return kind == Kind::Double ? (uint64_t)(values[i].d) : values[i].u;
+    }
+    double last(void) const { return asDouble(values.size()-1); }
+    /* The positive difference from the previous row, or zero for the
+     * first row and for counters that went backwards. */
+    uint64_t delta(size_t i) const {
+        if (i == 0) { return 0; }
+        uint64_t a = asUnsigned(i);
+        uint64_t b = (i == first()) ? unsignedOf(evicted) : asUnsigned(i-1);
+        return a>b ? a-b : 0;
+    }
+    /* Format the value the same way the sampled strings used to look */
+    std::string toString(size_t i) const {
+        char tmp[64] = {0};
+        switch (kind) {
+            case Kind::State:
+                tmp[0] = (char)(values[i].u);
+                break;
+            case Kind::Double:
+                snprintf(tmp, 63, "%f", values[i].d);
+                break;
+            case Kind::Unsigned:
+            default:
+                snprintf(tmp, 63, "%lu", values[i].u);
+                break;
+        }
+        return std::string(tmp);
+    }
+    /* A column that has only seen integers can later see a fraction */
+    void promote(void) {
+        if (kind != Kind::Unsigned) { return; }
+        values.forEach([](Value& v) { v.d = (double)(v.u); });
+        evicted.d = (double)(evicted.u);
+        kind = Kind::Double;
+    }
+    /* The whole run, including the rows that are no longer retained */
+    Aggregate summary(void) const {
+        Aggregate result{total};
+        for (size_t i = accounted ; i < size() ; i++) {
+            result.merge(row(i, 0));
+        }
+        return result;
+    }
+    const std::vector<Level>& levels(void) const { return history; }
+    /* The downsampled rows that are no longer retained, oldest first, as
+     * the bucket mean of the values or of the deltas. Formatted like the
+     * retained values, so the log parsers see one (coarser) list. */
+    std::string historyToString(bool deltas) const {
+        std::string tmpstr;
+        char tmp[64] = {0};
+        auto add = [&](const Bucket& b) {
+            if (b.count == 0) { return; }
+            snprintf(tmp, 63, "%.2f", deltas ? b.deltaMean() : b.mean());
+            if (!tmpstr.empty()) { tmpstr += ","; }
+            tmpstr += tmp;
+        };
+        for (size_t l = history.size() ; l > 0 ; l--) {
+            for (auto& b : history[l-1].buckets) { add(b); }
+            add(history[l-1].partial);
+        }
+        return tmpstr;
+    }
+private:
+    friend class TimeSeries;
+    size_t capacity;
+    // the last row that aged out, so the oldest retained row has a delta
+    Value evicted;
+    // all completed rows, retained or not
+    Aggregate total;
+    size_t accounted{0};
+    std::vector<Level> history;
+    size_t buckets{0};      // per level
+
+    uint64_t unsignedOf(const Value& v) const {
+        return kind == Kind::Double ? (uint64_t)(v.d) : v.u;
+    }
+    Aggregate row(size_t i, uint32_t step) const {
+        Aggregate a;
+        a.add(step, asDouble(i));
+        if (i > 0) { a.addDelta((double)delta(i)); }
+        return a;
+    }
+    /* The row is complete, add it to the whole-run total */
+    void account(uint32_t step) {
+        while (accounted < size()) {
+            total.merge(row(accounted++, step));
+        }
+    }
+    /* A column that shows up late gets zeros for the earlier rows */
+    void pad(size_t head, size_t tail) {
+        Value zero;
+        zero.u = 0;
+        values.fill(head, tail, zero);
+        if (tail > 0) {
+            total.values.count = tail;
+            total.deltas.count = tail - 1;
+        }
+        accounted = tail;
+    }
+    /* Fold the oldest retained row into the downsampled history */
+    void evict(void) {
+        size_t i = first();
+        Bucket carry;
+        carry.count = 1;
+        carry.sum = asDouble(i);
+        if (i > 0) {
+            carry.deltaCount = 1;
+            carry.deltaSum = (double)delta(i);
+        }
+        evicted = values[i];
+        values.pop_front();
+        if (history.empty()) {
+            size_t span{1};
+            history.resize(historyLevels);
+            buckets = std::max<size_t>(1, capacity / historyFactor);
+            for (auto& l : history) {
+                span *= historyFactor;
+                l.span = span;
+            }
+        }
+        for (auto& l : history) {
+            l.partial.merge(carry);
+            if (l.partial.count < l.span) { return; }
+            l.buckets.push_back(l.partial);
+            l.partial = Bucket{};
+            if (l.buckets.size() <= buckets) { return; }
+            carry = l.buckets.front();
+            l.buckets.pop_front();
+        }
+    }
+};
+
+/* A typed, columnar time series. All columns share the step and
+ * timestamp columns of the entity (HWT, GPU, node, LWP) that owns it.
+ * Samples are added one row at a time:
+ *     series.begin(step);
+ *     series.set(id, value); ...
+ *     series.end();
+ * With ZS_HISTORY_LIMIT=N, only the last N rows are retained and older
+ * rows are downsampled, so memory stays flat however long the run is.
+ * Row indices are absolute: size() counts every row, first() is the
+ * oldest one still retained.
+ */
+class TimeSeries {
+public:
+    TimeSeries() : capacity(historyLimit()), steps(capacity), timestamps(capacity) {}
+    ~TimeSeries() = default;
+    /* 0 means unbounded; a delta needs at least two rows */
+    static size_t historyLimit(void) {
+        static size_t limit{(size_t)std::max(0, parseInt("ZS_HISTORY_LIMIT", 0))};
+        return (limit == 1) ? 2 : limit;
+    }
+    size_t size(void) const { return steps.size(); }
+    size_t first(void) const { return steps.first(); }
+    bool empty(void) const { return steps.size() == 0; }
+    uint32_t step(size_t i) const { return steps[i]; }
+    uint64_t timestamp(size_t i) const { return timestamps[i]; }
+    /* The mean seconds between the retained rows, which is the period
+     * the owner was actually sampled at, or fallback with fewer than two */
+    double interval(double fallback) const {
+        if (size() - first() < 2) { return fallback; }
+        return (double)(timestamps.back() - timestamps[first()]) * 1.0e-9 /
+            (double)(size() - first() - 1);
+    }
+    /* CSV cursors count steps rather than rows, so they stay valid for
+     * series that started late or have dropped their oldest rows */
+    size_t nextStep(void) const { return empty() ? 0 : (size_t)steps.back() + 1; }
+    /* The first retained row at or after the step */
+    size_t seek(size_t step) const {
+        size_t lo = first();
+        size_t hi = size();
+        while (lo < hi) {
+            size_t mid = lo + ((hi - lo) / 2);
+            if (steps[mid] < step) { lo = mid + 1; } else { hi = mid; }
+        }
+        return lo;
+    }
+
+    /* Several collectors can contribute to the same row, so a repeated
+     * step continues the current row instead of starting a new one. */
+    void begin(uint32_t step, uint64_t timestamp = now()) {
+        if (!empty() && steps.back() == step) { return; }
+        if (!empty()) {
+            uint32_t previous = steps.back();
+            for (auto& c : columns) { c.account(previous); }
+        }
+        if (steps.full()) {
+            for (auto& c : columns) { c.evict(); }
+            steps.pop_front();
+            timestamps.pop_front();
+        }
+        steps.push_back(step);
+        timestamps.push_back(timestamp);
+    }
+    void set(metric_id id, uint64_t value) {
+        Column& c = getColumn(id, Kind::Unsigned);
+        Value v;
+        if (c.kind == Kind::Double) { v.d = (double)value; } else { v.u = value; }
+        put(c, v);
+    }
+    void set(metric_id id, double value) {
+        Column& c = getColumn(id, Kind::Double);
+        c.promote();
+        Value v;
+        v.d = value;
+        put(c, v);
+    }
+    void setState(metric_id id, char value) {
+        Column& c = getColumn(id, Kind::State);
+        Value v;
+        v.u = (uint64_t)value;
+        put(c, v);
+    }
+    /* Convert a sampled string once, when it is stored. */
+    void set(const std::string& name, const std::string& value) {
+        metric_id id = Metrics::intern(name);
+        const char * str = value.c_str();
+        char * end = nullptr;
+        if (*str != '-') {
+            uint64_t u = strtoull(str, &end, 10);
+            if (end != str && *end == '\0') {
+                set(id, u);
+                return;
+            }
+        }
+        double d = strtod(str, &end);
+        if (end != str && *end == '\0') {
+            set(id, d);
+            return;
+        }
+        setState(id, value.size() > 0 ? value[0] : ' ');
+    }
+    /* Rows are only added when the owner is sampled, but a sample can
+     * miss a column (a file that couldn't be read this time), and such a
+     * column keeps its previous value */
+    void end(void) {
+        for (auto& c : columns) {
+            while (c.values.size() < steps.size()) {
+                Value v;
+                if (c.values.empty()) { v.u = 0; } else { v = c.values.back(); }
+                c.values.push_back(v);
+            }
+        }
+    }
+    size_t width(void) const { return columns.size(); }
+    const Column* find(metric_id id) const {
+        if (id >= slots.size() || slots[id] < 0) { return nullptr; }
+        return &(columns[slots[id]]);
+    }
+    /* Doesn't add the name to the dictionary, a reader shouldn't */
+    const Column* find(const std::string& name) const {
+        return find(Metrics::lookup(name));
+    }
+    /* The columns, in name order, for reporting */
+    std::vector<const Column*> sorted(void) const {
+        std::vector<std::pair<std::string, const Column*>> tmp;
+        tmp.reserve(columns.size());
+        for (auto& c : columns) {
+            tmp.push_back(std::pair(c.name(), &c));
+        }
+        std::sort(tmp.begin(), tmp.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::vector<const Column*> result;
+        result.reserve(tmp.size());
+        for (auto& t : tmp) { result.push_back(t.second); }
+        return result;
+    }
+private:
+    size_t capacity;
+    Ring<uint32_t> steps;
+    Ring<uint64_t> timestamps;
+    std::vector<Column> columns;
+    // metric_id -> index into columns, -1 if this series doesn't have it
+    std::vector<int32_t> slots;
+
+    Column& getColumn(metric_id id, Kind kind) {
+        if (id >= slots.size()) { slots.resize(id+1, -1); }
+        if (slots[id] < 0) {
+            slots[id] = columns.size();
+            columns.push_back(Column(id, kind, capacity));
+            // this might be a new metric that wasn't around before, if so
+            // make sure we have enough slots to account for previous steps.
+            columns.back().pad(first(), size() > 0 ? size()-1 : 0);
+        }
+        return columns[slots[id]];
+    }
+    void put(Column& c, Value v) {
+        // overwrite if this metric was already set in this row
+        if (c.values.size() >= steps.size() && !c.values.empty()) {
+            c.values.back() = v;
+        } else {
+            c.values.push_back(v);
+        }
+    }
+};
+
+} // namespace series
+
+} // namespace zerosum
@@ -0,0 +1,331 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "trace_format.h"
+
+namespace zerosum {
+
+namespace output {
+
+TraceFormatter::TraceFormatter(const std::string& hostname, uint32_t rank,
+    uint32_t shmrank, uint32_t pid, uint64_t origin, double period) :
+    hostname(hostname), rank(rank), pid(std::to_string(pid)), origin(origin),
+    period(period) {
+    (void)shmrank;
+    buffer.reserve(64*1024);
+}
+
+void TraceFormatter::header(void) {
+    buffer += "[\n";
+    begin("M", "process_name", 0, 0);
+    buffer += ",\"args\":{\"name\":";
+    quoted(buffer, "Rank " + std::to_string(rank) + " on " + hostname);
+    buffer += "}";
+    end();
+    begin("M", "process_sort_index", 0, 0);
+    buffer += ",\"args\":{\"sort_index\":" + std::to_string(rank) + "}";
+    end();
+}
+
+static bool resourceIs(const Record& r, const char * name) {
+    return strcmp(r.resource, name) == 0;
+}
+
+static const char * stateName(char state) {
+    switch (state) {
+        case 'R': return "Running";
+        case 'S': return "Sleeping";
+        case 'D': return "Disk sleep";
+        case 'T': return "Stopped";
+        case 't': return "Tracing stop";
+        case 'Z': return "Zombie";
+        case 'X': return "Dead";
+        case 'I': return "Idle";
+        case 'P': return "Parked";
+        case 'W': return "Waking";
+        default: return nullptr;
+    }
+}
+
+/* What to do with each metric of each resource, decided once per name */
+TraceFormatter::Role TraceFormatter::role(const Record& r) {
+    size_t resource;
+    switch (r.resource[0]) {
+        case 'N': resource = resourceIs(r, "NUMA") ? 5 : 0; break;
+        case 'H': resource = 1; break;
+        case 'G': resource = 2; break;
+        case 'L': resource = 3; break;
+        case 'M': resource = 4; break;
+        case 'P': resource = 6; break;
+        default: return Role::Skip;
+    }
+    if (roles.size() <= resource) { roles.resize(resource + 1); }
+    auto& known = roles[resource];
+    if (known.size() <= r.metric) { known.resize(r.metric + 1, Role::Unknown); }
+    Role& result = known[r.metric];
+    if (result != Role::Unknown) { return result; }
+    const std::string& name = series::Metrics::name(r.metric);
+    result = Role::Skip;
+    switch (resource) {
+        case 0:
+            result = name == "time" ? Role::Time : Role::Value;
+            break;
+        case 1:
+            // the shares that add up to 100%, not the totals
+            for (auto share : {"user", "nice", "system", "idle", "iowait", "irq",
+                "softirq", "steal", "guest", "guest_nice"}) {
+                if (name == share) { result = Role::Share; }
+            }
+            break;
+        case 3:
+            if (name == "state") { result = Role::State; }
+            if (name == "processor") { result = Role::Processor; }
+            break;
+        default:
+            result = Role::Value;
+            break;
+    }
+    return result;
+}
+
+/* The node's time of the step, or else a period after the last one */
+uint64_t TraceFormatter::timestamp(uint32_t step) {
+    uint64_t ts;
+    auto found = times.find(step);
+    if (found != times.end()) {
+        ts = found->second;
+    } else if (!times.empty() && step > times.rbegin()->first) {
+        ts = times.rbegin()->second +
+            (uint64_t)((step - times.rbegin()->first) * period * 1.0e6);
+    } else {
+        ts = (uint64_t)(step * period * 1.0e6);
+    }
+    ts += origin;
+    lastTs = std::max(lastTs, ts);
+    return ts;
+}
+
+void TraceFormatter::operator()(const Record& r) {
+    if (closed) { return; }
+    if (r.resource[0] == 'E') {
+        event(r);
+        return;
+    }
+    if (r.text != nullptr) { return; }
+    switch (role(r)) {
+        case Role::Time: {
+            double seconds = r.kind == series::Kind::Double ?
+                r.value.d : (double)r.value.u;
+            times[r.step] = (uint64_t)std::llround(seconds * 1.0e6);
+            // only the steps still being extracted are needed
+            while (times.size() > 256) { times.erase(times.begin()); }
+            break;
+        }
+        case Role::Share:
+            if (!shares.empty() && (r.index != sharesIndex || r.step != sharesStep)) {
+                finish();
+            }
+            if (shares.empty()) {
+                sharesIndex = r.index;
+                sharesStep = r.step;
+            } else {
+                shares += ",";
+            }
+            shares += name(r.metric);
+            shares += ":";
+            value(shares, r);
+            break;
+        case Role::State:
+        case Role::Processor:
+            lwp(r);
+            break;
+        case Role::Value:
+            counter(r);
+            break;
+        default:
+            break;
+    }
+}
+
+void TraceFormatter::finish(void) {
+    if (shares.empty()) { return; }
+    begin("C", "HWT " + std::to_string(sharesIndex), timestamp(sharesStep), 0);
+    buffer += ",\"args\":{";
+    buffer += shares;
+    buffer += "}";
+    end();
+    shares.clear();
+}
+
+/* Only written when the value changes */
+void TraceFormatter::counter(const Record& r) {
+    if (r.kind == series::Kind::State) { return; }
+    auto key = std::make_tuple(r.resource, r.index, r.metric);
+    auto found = last.find(key);
+    if (found != last.end() && found->second == r.value.u) { return; }
+    last[key] = r.value.u;
+    std::string track{r.resource};
+    // one track per GPU and NUMA node
+    if (r.resource[0] == 'G' || resourceIs(r, "NUMA")) { track += " " + std::to_string(r.index); }
+    begin("C", track, timestamp(r.step), 0);
+    buffer += ",\"args\":{";
+    buffer += name(r.metric);
+    buffer += ":";
+    value(buffer, r);
+    buffer += "}";
+    end();
+}
+
+void TraceFormatter::lwp(const Record& r) {
+    auto found = threads.find(r.index);
+    if (found == threads.end()) {
+        found = threads.emplace(r.index, Thread()).first;
+        begin("M", "thread_name", 0, r.index);
+        buffer += ",\"args\":{\"name\":\"LWP " + std::to_string(r.index) + "\"}";
+        end();
+    }
+    Thread& t = found->second;
+    uint64_t ts = timestamp(r.step);
+    if (r.kind == series::Kind::State) {
+        char state = (char)(r.value.u);
+        if (state == t.state) { return; }
+        if (t.state != 0) {
+            begin("E", "", ts, r.index);
+            end();
+        }
+        const char * known = stateName(state);
+        begin("B", known == nullptr ? std::string(1, state) : known, ts, r.index);
+        end();
+        t.state = state;
+        return;
+    }
+    uint64_t processor = r.kind == series::Kind::Double ?
+        (uint64_t)r.value.d : r.value.u;
+    if (processor == t.processor) { return; }
+    if (t.processor != UINT64_MAX) {
+        begin("i", "migration", ts, r.index);
+        buffer += ",\"s\":\"t\",\"args\":{\"from\":" + std::to_string(t.processor) +
+            ",\"to\":" + std::to_string(processor) + "}";
+        end();
+    }
+    t.processor = processor;
+    begin("C", "LWP " + std::to_string(r.index), ts, 0);
+    buffer += ",\"args\":{\"processor\":" + std::to_string(processor) + "}";
+    end();
+}
+
+/* Events of the process have index 0, the others are on their thread */
+void TraceFormatter::event(const Record& r) {
+    begin("i", series::Metrics::name(r.metric), timestamp(r.step), r.index);
+    buffer += r.index == 0 ? ",\"s\":\"p\"" : ",\"s\":\"t\"";
+    if (r.text != nullptr && !r.text->empty()) {
+        buffer += ",\"args\":{\"detail\":";
+        quoted(buffer, *(r.text));
+        buffer += "}";
+    }
+    end();
+}
+
+void TraceFormatter::close(void) {
+    if (closed) { return; }
+    finish();
+    for (auto& t : threads) {
+        if (t.second.state == 0) { continue; }
+        begin("E", "", lastTs, t.first);
+        end();
+    }
+    // the last event has no comma after it
+    begin("M", "process_labels", 0, 0);
+    buffer += ",\"args\":{\"labels\":";
+    quoted(buffer, hostname);
+    buffer += "}}\n]\n";
+    closed = true;
+}
+
+void TraceFormatter::begin(const char * ph, const std::string& name,
+    uint64_t ts, uint32_t tid) {
+    buffer += "{\"name\":";
+    quoted(buffer, name);
+    buffer += ",\"ph\":\"";
+    buffer += ph;
+    buffer += "\",\"ts\":";
+    buffer += std::to_string(ts);
+    buffer += ",\"pid\":";
+    buffer += pid;
+    if (tid != 0) {
+        buffer += ",\"tid\":";
+        buffer += std::to_string(tid);
+    }
+}
+
+const std::string& TraceFormatter::name(series::metric_id id) {
+    if (id >= names.size()) { names.resize(id + 1); }
+    if (names[id].empty()) { quoted(names[id], series::Metrics::name(id)); }
+    return names[id];
+}
+
+void TraceFormatter::quoted(std::string& out, const std::string& s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char tmp[8];
+                    snprintf(tmp, sizeof(tmp), "\\u%04x", (unsigned char)c);
+                    out += tmp;
+                } else {
+                    out += c;
+                }
+                break;
+        }
+    }
+    out += '"';
+}
+
+void TraceFormatter::value(std::string& out, const Record& r) {
+    char tmp[64];
+    if (r.kind == series::Kind::Double) {
+        // JSON has no NaN or infinity
+        double d = std::isfinite(r.value.d) ? r.value.d : 0.0;
+        auto result = std::to_chars(tmp, tmp + sizeof(tmp), d);
+        out.append(tmp, result.ptr - tmp);
+    } else {
+        auto result = std::to_chars(tmp, tmp + sizeof(tmp), r.value.u);
+        out.append(tmp, result.ptr - tmp);
+    }
+}
+
+} // namespace output
+
+} // namespace zerosum
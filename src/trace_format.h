@@ -0,0 +1,116 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <cstdint>
+#include "output_record.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* Formats records as Chrome trace events (the JSON array format), which
+ * ui.perfetto.dev and chrome://tracing load directly. Each rank is a
+ * process, sorted by rank, and each LWP a thread of it:
+ *   HWT <n>               a counter track of the user, system, idle...
+ *                         shares of the hardware thread, in percent
+ *   LWP state             slices on the thread track, one per state change
+ *   LWP <n> processor     a counter track, with a "migration" instant event
+ *                         on the thread track when it changes
+ *   GPU <n> <metric>, Node <metric>, MPI <metric>
+ *                         counter tracks
+ *   Event records         instant events, on the thread track of their
+ *                         index, or the process when it is 0
+ * Counters are only written when they change, the viewers hold the last
+ * value. The timestamps are microseconds since the epoch, from the node's
+ * "time" of each step, so ranks and other traces line up. The array is
+ * closed at the end of the run, but the viewers also accept a file that
+ * was cut short, so it is usable up to the last period written. */
+class TraceFormatter {
+public:
+    /* origin is when step 0 was sampled, in microseconds since the epoch,
+     * period is the sampling period in seconds, for the steps without a
+     * time */
+    TraceFormatter(const std::string& hostname, uint32_t rank, uint32_t shmrank,
+        uint32_t pid, uint64_t origin, double period);
+    void header(void);
+    void operator()(const Record& r);
+    /* Writes the pending hardware thread counter */
+    void finish(void);
+    /* Ends the open state slices, and the array */
+    void close(void);
+    const char * data(void) const { return buffer.data(); }
+    size_t size(void) const { return buffer.size(); }
+    void clear(void) { buffer.clear(); }
+    std::string str(void) const { return buffer; }
+private:
+    enum class Role : uint8_t { Unknown, Skip, Time, Share, State, Processor, Value };
+    Role role(const Record& r);
+    uint64_t timestamp(uint32_t step);
+    void counter(const Record& r);
+    void lwp(const Record& r);
+    void event(const Record& r);
+    void begin(const char * ph, const std::string& name, uint64_t ts, uint32_t tid);
+    void end(void) { buffer += "},\n"; }
+    const std::string& name(series::metric_id id);
+    static void quoted(std::string& out, const std::string& s);
+    static void value(std::string& out, const Record& r);
+    std::string hostname;
+    uint32_t rank;
+    std::string pid;
+    uint64_t origin;
+    double period;
+    std::string buffer;
+    // the node's time of the recent steps, in microseconds since the origin
+    std::map<uint32_t, uint64_t> times;
+    std::vector<std::vector<Role>> roles;
+    // the metric names, quoted, looked up (under a lock) once
+    std::vector<std::string> names;
+    // the last value written to each counter track, by resource, index, metric
+    // (the resource names are literals)
+    std::map<std::tuple<const char *, uint32_t, series::metric_id>, uint64_t> last;
+    // the hardware thread counter being collected
+    std::string shares;
+    uint32_t sharesIndex{0};
+    uint32_t sharesStep{0};
+    // the current state and processor of each LWP
+    struct Thread {
+        char state{0};
+        uint64_t processor{UINT64_MAX};
+    };
+    std::unordered_map<uint32_t, Thread> threads;
+    uint64_t lastTs{0};
+    bool closed{false};
+};
+
+} // namespace output
+
+} // namespace zerosum
@@ -0,0 +1,236 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include "uring_reader.h"
+
+namespace zerosum {
+
+namespace {
+
+int io_uring_setup(unsigned entries, struct io_uring_params * params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+        flags, nullptr, 0);
+}
+
+} // anonymous namespace
+
+UringReader::UringReader(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = io_uring_setup(entries, &params);
+    // not supported by the kernel, disabled by sysctl or blocked by seccomp
+    if (ring_fd < 0) { return; }
+    sq_entries = params.sq_entries;
+    sq_size = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+    cq_size = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) { sq_ptr = nullptr; teardown(); return; }
+    if (single) {
+        cq_ptr = sq_ptr;
+    } else {
+        cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) { cq_ptr = nullptr; teardown(); return; }
+    }
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void * tmp = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (tmp == MAP_FAILED) { teardown(); return; }
+    sqes = (struct io_uring_sqe *)tmp;
+    char * sq = (char *)sq_ptr;
+    sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + params.sq_off.array);
+    char * cq = (char *)cq_ptr;
+    cq_head = (unsigned *)(cq + params.cq_off.head);
+    cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    if (!probe()) { teardown(); }
+}
+
+UringReader::~UringReader() {
+    teardown();
+}
+
+void UringReader::teardown(void) {
+    if (sqes != nullptr) { munmap(sqes, sqes_size); }
+    if (cq_ptr != nullptr && cq_ptr != sq_ptr) { munmap(cq_ptr, cq_size); }
+    if (sq_ptr != nullptr) { munmap(sq_ptr, sq_size); }
+    if (ring_fd >= 0) { close(ring_fd); }
+    sqes = nullptr;
+    cq_ptr = sq_ptr = nullptr;
+    ring_fd = -1;
+}
+
+/* IORING_OP_READ needs Linux 5.6, older kernels complete it with -EINVAL */
+bool UringReader::probe(void) {
+    int fd = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return false; }
+    char buffer[1024];
+    std::vector<int> results(1, -EINVAL);
+    bool ok = queue(fd, buffer, sizeof(buffer), 0) && wait(results);
+    close(fd);
+    return ok && results[0] > 0;
+}
+
+bool UringReader::queue(int fd, char * buffer, unsigned length, uint64_t tag) {
+    if (pending >= sq_entries) { return false; }
+    // we are the only producer, so the tail is ours to read without a barrier
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    struct io_uring_sqe * sqe = &(sqes[index]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)buffer;
+    sqe->len = length;
+    sqe->off = 0;
+    sqe->user_data = tag;
+    sq_array[index] = index;
+    // make the entry visible to the kernel before the tail moves
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    pending++;
+    return true;
+}
+
+unsigned UringReader::reap(std::vector<int>& results) {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    unsigned reaped{0};
+    while (head != tail) {
+        struct io_uring_cqe * cqe = &(cqes[head & *cq_mask]);
+        if (cqe->user_data < results.size()) {
+            results[cqe->user_data] = cqe->res;
+        }
+        head++;
+        reaped++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+bool UringReader::wait(std::vector<int>& results) {
+    unsigned submit = pending;
+    unsigned remaining = pending;
+    while (remaining > 0) {
+        int rc = io_uring_enter(ring_fd, submit, remaining, IORING_ENTER_GETEVENTS);
+        if (rc < 0) {
+            if (errno == EINTR) { continue; }
+            /* The reads that were submitted still write into the caller's
+             * buffers, so wait for them before giving up on the ring */
+            remaining -= std::min(remaining, submit);
+            while (remaining > 0) {
+                rc = io_uring_enter(ring_fd, 0, remaining, IORING_ENTER_GETEVENTS);
+                if (rc < 0 && errno != EINTR) { break; }
+                remaining -= std::min(remaining, reap(results));
+            }
+            pending = 0;
+            teardown();
+            return false;
+        }
+        submit -= std::min(submit, (unsigned)rc);
+        remaining -= std::min(remaining, reap(results));
+    }
+    pending = 0;
+    return true;
+}
+
+BatchedTaskReader::BatchedTaskReader(unsigned depth) : ring(depth) {
+    if (!ring.valid()) { return; }
+    // up to three reads per thread
+    size_t tasks = ring.capacity() / 3;
+    buffers.resize(tasks * taskLength);
+    results.resize(tasks * 3);
+    entries.resize(tasks);
+}
+
+void BatchedTaskReader::read(TaskFileCache& cache, std::vector<task_sample_t>& samples) {
+    size_t tasks = entries.size();
+    for (size_t start = 0 ; start < samples.size() ; start += tasks) {
+        size_t end = std::min(samples.size(), start + tasks);
+        for (size_t i = start ; i < end ; i++) {
+            size_t k = i - start;
+            results[k*3] = results[(k*3)+1] = results[(k*3)+2] = -EAGAIN;
+            entries[k] = ring.valid() ? cache.acquire(samples[i].tid) : nullptr;
+            if (entries[k] == nullptr) { continue; }
+            // a read that isn't queued leaves -EAGAIN, and the thread is read with pread
+            if (!ring.queue(entries[k]->stat.descriptor(), statBuffer(k),
+                    statLength - 1, k*3) ||
+                !ring.queue(entries[k]->status.descriptor(), statusBuffer(k),
+                    statusLength - 1, (k*3)+1)) { continue; }
+            if (entries[k]->schedstat.isOpen()) {
+                ring.queue(entries[k]->schedstat.descriptor(), schedstatBuffer(k),
+                    schedstatLength - 1, (k*3)+2);
+            }
+        }
+        if (ring.valid() && !ring.wait(results)) {
+            // the ring is gone, what it did read may be incomplete
+            std::fill(entries.begin(), entries.end(), nullptr);
+        }
+        for (size_t i = start ; i < end ; i++) {
+            size_t k = i - start;
+            task_sample_t& sample = samples[i];
+            int statRead = results[k*3];
+            int statusRead = results[(k*3)+1];
+            int schedstatRead = results[(k*3)+2];
+            // a full buffer may have been truncated
+            if (entries[k] != nullptr &&
+                statRead > 0 && statRead < (int)(statLength - 1) &&
+                statusRead > 0 && statusRead < (int)(statusLength - 1)) {
+                statBuffer(k)[statRead] = '\0';
+                statusBuffer(k)[statusRead] = '\0';
+                sample.valid = parseThreadStat(statBuffer(k), sample.stat);
+                parseThreadStatus(statusBuffer(k), sample.status);
+                sample.has_schedstat = false;
+                if (schedstatRead > 0 && schedstatRead < (int)(schedstatLength - 1)) {
+                    schedstatBuffer(k)[schedstatRead] = '\0';
+                    sample.has_schedstat = parseThreadSchedstat(schedstatBuffer(k),
+                        sample.schedstat);
+                }
+            } else {
+                sample.valid = cache.read(sample);
+            }
+        }
+    }
+}
+
+} // namespace zerosum
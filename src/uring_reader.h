@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "utils.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace zerosum {
+
+/* A minimal io_uring, set up with the raw system calls (no liburing),
+ * that only knows how to read whole files from offset 0. */
+class UringReader {
+public:
+    explicit UringReader(unsigned entries);
+    ~UringReader();
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+    bool valid(void) const { return ring_fd >= 0; }
+    unsigned capacity(void) const { return sq_entries; }
+    /* Queue a read, returns false if the ring is full */
+    bool queue(int fd, char * buffer, unsigned length, uint64_t tag);
+    /* Submit everything queued, wait for all of it to complete, and store
+     * each result (bytes read, or -errno) at results[tag]. If the ring
+     * fails, it waits for the reads already submitted, and tears the ring
+     * down, so valid() is false from then on. */
+    bool wait(std::vector<int>& results);
+private:
+    void teardown(void);
+    unsigned reap(std::vector<int>& results);
+    bool probe(void);
+    int ring_fd{-1};
+    void * sq_ptr{nullptr};
+    void * cq_ptr{nullptr};
+    size_t sq_size{0};
+    size_t cq_size{0};
+    struct io_uring_sqe * sqes{nullptr};
+    size_t sqes_size{0};
+    unsigned * sq_tail{nullptr};
+    unsigned * sq_mask{nullptr};
+    unsigned * sq_array{nullptr};
+    unsigned * cq_head{nullptr};
+    unsigned * cq_tail{nullptr};
+    unsigned * cq_mask{nullptr};
+    struct io_uring_cqe * cqes{nullptr};
+    unsigned sq_entries{0};
+    unsigned pending{0};
+};
+
+/* Reads the stat, status and schedstat files of many threads with one
+ * io_uring_enter() per ring-full of reads, instead of a pread() call per
+ * file per thread. Anything the batch can't handle (uncached, truncated
+ * or exited threads) is read through the TaskFileCache instead, and so is
+ * everything once the ring has failed. */
+class BatchedTaskReader {
+public:
+    explicit BatchedTaskReader(unsigned depth = 256);
+    bool valid(void) const { return ring.valid(); }
+    void read(TaskFileCache& cache, std::vector<task_sample_t>& samples);
+private:
+    static constexpr size_t statLength{1024};
+    static constexpr size_t statusLength{4096};
+    static constexpr size_t schedstatLength{128};
+    static constexpr size_t taskLength{statLength + statusLength + schedstatLength};
+    char * statBuffer(size_t index) {
+        return buffers.data() + (index * taskLength);
+    }
+    char * statusBuffer(size_t index) {
+        return statBuffer(index) + statLength;
+    }
+    char * schedstatBuffer(size_t index) {
+        return statusBuffer(index) + statusLength;
+    }
+    UringReader ring;
+    std::vector<char> buffers;
+    std::vector<int> results;
+    std::vector<TaskFileCache::task_files_t*> entries;
+};
+
+} // namespace zerosum
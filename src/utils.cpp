@@ -29,7 +29,12 @@
 #include <sched.h>
 #include "utils.h"
 #include "perfstubs.h"
-#include <regex>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <fstream>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <iostream>
@@ -81,69 +86,311 @@ std::vector<uint32_t> parseDiscreteValues(std::string inputString) {
     return result;
 }
 
-std::string getCpusAllowed(const char * filename) {
-    //std::cout << std::endl << filename << std::endl;
-    FILE *f = fopen(filename, "r");
-    std::string allowed_string{""};
-    if (!f) { return(allowed_string); }
-    const std::string allowed("Cpus_allowed_list");
-    char line[4097] = {0};
-    while ( fgets( line, 4096, f)) {
-        std::string tmp(line);
-        //std::cout << tmp << std::flush;
-        if (!tmp.compare(0,allowed.size(),allowed)) {
-            const std::regex separator(":");
-            std::sregex_token_iterator token(tmp.begin(),
-                    tmp.end(), separator, -1);
-            std::sregex_token_iterator end;
-            std::string name = *token++;
-            if (token != end) {
-                allowed_string = *token;
-                allowed_string.erase(
-                    std::remove_if(
-                        allowed_string.begin(), allowed_string.end(),
-                        ::isspace),
-                    allowed_string.end());
-            }
+/* The /proc files are read whole into a reusable per-thread buffer and
+ * scanned once, converting numbers in place rather than tokenizing. */
+
+namespace {
+
+inline const char * skipSpaces(const char * p) {
+    while (*p == ' ' || *p == '\t') { p++; }
+    return p;
+}
+
+inline const char * nextLine(const char * p) {
+    while (*p != '\0' && *p != '\n') { p++; }
+    return (*p == '\n') ? p+1 : p;
+}
+
+inline const char * nextField(const char * p) {
+    while (*p != '\0' && *p != ' ' && *p != '\n') { p++; }
+    return skipSpaces(p);
+}
+
+inline uint64_t parseU64(const char *& p) {
+    p = skipSpaces(p);
+    uint64_t value{0};
+    while (*p >= '0' && *p <= '9') {
+        value = (value * 10) + (*p - '0');
+        p++;
+    }
+    return value;
+}
+
+inline bool startsWith(const char * p, const char * prefix, size_t len) {
+    return strncmp(p, prefix, len) == 0;
+}
+
+/* Each thread that samples /proc gets its own buffer, which only grows */
+std::vector<char>& scratchBuffer(void) {
+    thread_local static std::vector<char> buffer(4096);
+    return buffer;
+}
+
+} // anonymous namespace
+
+/* Read the whole file into the buffer and null-terminate it.
+ * Returns the number of bytes read, or 0 on failure. */
+size_t readFile(const char * filename, std::vector<char>& buffer) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return 0; }
+    if (buffer.size() < 4096) { buffer.resize(4096); }
+    size_t total{0};
+    while (true) {
+        if (buffer.size() - total < 1024) {
+            buffer.resize(buffer.size() * 2);
         }
+        ssize_t n = read(fd, buffer.data() + total, buffer.size() - total - 1);
+        if (n <= 0) { break; }
+        total += n;
     }
-    fclose(f);
-    return(allowed_string);
+    close(fd);
+    buffer[total] = '\0';
+    return total;
 }
 
-std::map<std::string, std::string> getThreadStat(const char * filename) {
-    std::map<std::string, std::string> fields;
-    //std::cout << std::endl << filename << std::endl;
-    FILE *f = fopen(filename, "r");
+bool ProcFile::open(void) {
+    if (fd < 0) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    return fd >= 0;
+}
+
+void ProcFile::close(void) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+/* Same contract as readFile(). A read that fills the buffer is continued
+ * at the advancing offset, and a sequential file is read until the kernel
+ * reports the end of the file. Anything else is done after one pread(). */
+size_t ProcFile::read(std::vector<char>& buffer) {
+    if (!open()) { return 0; }
+    if (buffer.size() < 4096) { buffer.resize(4096); }
+    size_t total{0};
+    while (true) {
+        if (buffer.size() - total < 1024) {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = pread(fd, buffer.data() + total,
+            buffer.size() - total - 1, total);
+        if (n < 0) {
+            // the thread has exited, or the device went away
+            close();
+            return 0;
+        }
+        total += n;
+        if (n == 0 || (!sequential && total < buffer.size() - 1)) { break; }
+    }
+    buffer[total] = '\0';
+    return total;
+}
+
+TaskFileCache::TaskFileCache() {
+    /* Leave most of the descriptor table to the application */
+    struct rlimit rl;
+    size_t fds{256};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        fds = rl.rlim_cur / 4;
+    }
+    fds = parseInt("ZS_FD_CACHE_LIMIT", fds);
+    // without CONFIG_SCHED_INFO no task has a schedstat file
+    withSchedstat = parseBool("ZS_SCHEDSTAT", true) &&
+        access("/proc/self/schedstat", R_OK) == 0;
+    // two or three files per thread
+    limit = fds / (withSchedstat ? 3 : 2);
+}
+
+bool TaskFileCache::readCached(task_files_t& entry, task_sample_t& sample) {
+    entry.generation = generation;
+    if (!getThreadStat(entry.stat, sample.stat)) { return false; }
+    if (!getThreadStatus(entry.status, sample.status)) { return false; }
+    sample.has_schedstat = withSchedstat &&
+        getThreadSchedstat(entry.schedstat, sample.schedstat);
+    return true;
+}
+
+bool TaskFileCache::read(task_sample_t& sample) {
+    uint32_t tid{sample.tid};
+    sample.has_schedstat = false;
+    auto entry = files.find(tid);
+    if (entry != files.end()) {
+        if (readCached(entry->second, sample)) { return true; }
+        /* The thread exited, and the tid may have been reused
+         * by a new thread since, so reopen the files once. */
+        files.erase(entry);
+    }
+    task_files_t* added = acquire(tid);
+    if (added == nullptr) {
+        char statfile[64];
+        char statusfile[64];
+        snprintf(statfile, sizeof(statfile), "/proc/self/task/%u/stat", tid);
+        snprintf(statusfile, sizeof(statusfile), "/proc/self/task/%u/status", tid);
+        if (!getThreadStat(statfile, sample.stat) ||
+            !getThreadStatus(statusfile, sample.status)) { return false; }
+        if (withSchedstat) {
+            char schedstatfile[64];
+            snprintf(schedstatfile, sizeof(schedstatfile), "/proc/self/task/%u/schedstat", tid);
+            sample.has_schedstat = getThreadSchedstat(schedstatfile, sample.schedstat);
+        }
+        return true;
+    }
+    if (readCached(*added, sample)) { return true; }
+    files.erase(tid);
+    return false;
+}
+
+TaskFileCache::task_files_t* TaskFileCache::acquire(uint32_t tid) {
+    auto entry = files.find(tid);
+    if (entry != files.end()) {
+        entry->second.generation = generation;
+        return &(entry->second);
+    }
+    if (files.size() >= limit) { return nullptr; }
+    char statfile[64];
+    char statusfile[64];
+    snprintf(statfile, sizeof(statfile), "/proc/self/task/%u/stat", tid);
+    snprintf(statusfile, sizeof(statusfile), "/proc/self/task/%u/status", tid);
+    auto& added = files[tid];
+    added.generation = generation;
+    added.stat.path = statfile;
+    added.status.path = statusfile;
+    if (withSchedstat) {
+        char schedstatfile[64];
+        snprintf(schedstatfile, sizeof(schedstatfile), "/proc/self/task/%u/schedstat", tid);
+        added.schedstat.path = schedstatfile;
+        // not fatal, the reads just won't have it
+        added.schedstat.open();
+    }
+    if (added.stat.open() && added.status.open()) { return &added; }
+    files.erase(tid);
+    return nullptr;
+}
+
+void TaskFileCache::endSweep(void) {
+    for (auto entry = files.begin() ; entry != files.end() ; ) {
+        if (entry->second.generation != generation) {
+            entry = files.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+}
+
+/* Parse a list like "0-3,8,10-11" into a cpu set */
+bool parseCpuList(const char * p, cpu_set_t& cpus) {
+    CPU_ZERO(&cpus);
+    bool found{false};
+    p = skipSpaces(p);
+    while (*p >= '0' && *p <= '9') {
+        uint64_t start = parseU64(p);
+        uint64_t end = start;
+        if (*p == '-') {
+            p++;
+            end = parseU64(p);
+        }
+        for (uint64_t i = start ; i <= end && i < CPU_SETSIZE ; i++) {
+            CPU_SET(i, &cpus);
+        }
+        found = true;
+        if (*p != ',') { break; }
+        p++;
+    }
+    return found;
+}
+
+std::vector<uint32_t> toList(const cpu_set_t& cpus) {
+    std::vector<uint32_t> allowed_list;
+    size_t count = CPU_COUNT(&cpus);
+    allowed_list.reserve(count);
+    for (int i = 0 ; i < CPU_SETSIZE && allowed_list.size() < count ; i++) {
+        if (CPU_ISSET(i, &cpus)) {
+            allowed_list.push_back(i);
+        }
+    }
+    return allowed_list;
+}
+
+std::string getCpusAllowed(const char * filename) {
     std::string allowed_string{""};
-    if (!f) { return fields; }
-    char line[4097] = {0};
-    std::vector<std::string> v;
-    // insert a dummy so our indexing matches the documentation for the /proc/self/stat values.
-    v.push_back("");
-    while ( fgets( line, 4096, f)) {
-        std::string tmp;
-        std::stringstream ss(line);
-        //std::cout << filename << " : " << line << std::endl;
-        while (getline(ss, tmp, ' ')) {
-            // store token string in the vector
-            v.push_back(tmp);
+    auto& buffer = scratchBuffer();
+    if (readFile(filename, buffer) == 0) { return(allowed_string); }
+    const char allowed[] = "Cpus_allowed_list:";
+    for (const char * p = buffer.data() ; *p != '\0' ; p = nextLine(p)) {
+        if (startsWith(p, allowed, sizeof(allowed)-1)) {
+            p = skipSpaces(p + sizeof(allowed) - 1);
+            const char * end = p;
+            while (*end != '\0' && *end != '\n' && *end != ' ') { end++; }
+            allowed_string.assign(p, end - p);
+            break;
         }
     }
-    // parsing the fields as defined by https://man7.org/linux/man-pages/man5/proc.5.html
-    // fields.insert(std::pair("executable", v[2])); // always 0
-    fields.insert(std::pair("state", v[3]));
-    fields.insert(std::pair("minflt", v[10]));
-    fields.insert(std::pair("majflt", v[12]));
-    fields.insert(std::pair("utime", v[14]));
-    fields.insert(std::pair("stime", v[15]));
-    // fields.insert(std::pair("startstack", v[28])); // probably not available without ptrace, always 0
-    // fields.insert(std::pair("kstkesp", v[29])); // probably not available without ptrace, always 0
-    // fields.insert(std::pair("kstkeip", v[30])); // probably not available without ptrace, always 0
-    fields.insert(std::pair("nswap", v[36]));
-    fields.insert(std::pair("processor", v[39]));
-    fclose(f);
-    return fields;
+    return(allowed_string);
+}
+
+/* parsing the fields as defined by https://man7.org/linux/man-pages/man5/proc.5.html
+ * The command name (2) can contain spaces and parentheses, so scanning
+ * starts after the last closing parenthesis, at the state (3). */
+bool parseThreadStat(const char * buf, thread_stat_t& stat) {
+    const char * p = strrchr(buf, ')');
+    if (p == nullptr) { return false; }
+    p = skipSpaces(p + 1);
+    stat.state = *p;
+    int field{3};
+    auto skipTo = [&](int target) {
+        while (field < target) { p = nextField(p); field++; }
+    };
+    auto next = [&](void) { uint64_t v = parseU64(p); p = skipSpaces(p); field++; return v; };
+    skipTo(9);
+    stat.flags = next();
+    stat.minflt = next();
+    skipTo(12);
+    stat.majflt = next();
+    skipTo(14);
+    stat.utime = next();
+    stat.stime = next();
+    // startstack (28), kstkesp (29) and kstkeip (30) are probably
+    // not available without ptrace, always 0
+    skipTo(36);
+    stat.nswap = next();
+    skipTo(39);
+    stat.processor = next();
+    return true;
+}
+
+/* Three numbers: run time and run queue wait time in ns, and timeslices */
+bool parseThreadSchedstat(const char * p, thread_schedstat_t& schedstat) {
+    p = skipSpaces(p);
+    if (*p < '0' || *p > '9') { return false; }
+    schedstat.run_ns = parseU64(p);
+    schedstat.wait_ns = parseU64(p);
+    schedstat.timeslices = parseU64(p);
+    return true;
+}
+
+bool getThreadSchedstat(const char * filename, thread_schedstat_t& schedstat) {
+    auto& buffer = scratchBuffer();
+    if (readFile(filename, buffer) == 0) { return false; }
+    return parseThreadSchedstat(buffer.data(), schedstat);
+}
+
+bool getThreadSchedstat(ProcFile& file, thread_schedstat_t& schedstat) {
+    auto& buffer = scratchBuffer();
+    if (file.read(buffer) == 0) { return false; }
+    return parseThreadSchedstat(buffer.data(), schedstat);
+}
+
+bool getThreadStat(const char * filename, thread_stat_t& stat) {
+    auto& buffer = scratchBuffer();
+    if (readFile(filename, buffer) == 0) { return false; }
+    return parseThreadStat(buffer.data(), stat);
+}
+
+bool getThreadStat(ProcFile& file, thread_stat_t& stat) {
+    auto& buffer = scratchBuffer();
+    if (file.read(buffer) == 0) { return false; }
+    return parseThreadStat(buffer.data(), stat);
 }
 
 // Return true if the thread is running, false otherwise.
@@ -166,102 +413,79 @@ std::map<std::string, std::string> getThreadStat(const char * filename) {
          P      Parked (Linux 3.9 to 3.13 only)
          I      Idle (Linux 4.14 onward)
 */
-bool isRunning(std::map<std::string, std::string>& fields,
-    const char * tid, bool isMain) {
+bool isRunning(const thread_stat_t& stat, uint32_t tid, bool isMain) {
     /* We need a static variable to keep track of the last minor fault value,
        because it's a monotonically increasing value on some systems.
        so we want to see if it has increased in the last time quantum. */
-    static std::unordered_map<std::string, uint64_t> priorMinflt;
+    static std::unordered_map<uint32_t, uint64_t> priorMinflt;
     static bool deadlock{parseBool("ZS_DETECT_DEADLOCK",false)};
     if (!deadlock) {return true;}
-    const std::string state{"state"};
-    const std::string minflt{"minflt"};
-    const std::string utime{"utime"};
-    const std::string running{"R"};
-    const std::string tracingStop{"t"};
-    const std::string zeroFaults{"0"};
-    std::string tmptid(tid);
     /* If the thread state is Running (R), and the minflt value is non-zero, then we are running.
      * Why the minflt? Because MPI will busy wait, which looks like running. But running with
      * no minor faults is highly unlikely.
      * We also check for the tracing stop state (t), because that seems to be related to
      * GPU processing on AMD machines.
      */
-    if (fields.count(state) > 0) {
-        // ok, the thread claims to be running (state == R)
-        if (running.compare(fields[state]) == 0) {
-            // if not the main thread, and it says it's running, it's running.
-            if (!isMain) { return true; }
-            uint64_t newMinflt = atol(fields[minflt].c_str());
-            // have we seen this thread's minflt state before? if not, save it.
-            if (priorMinflt.find(tmptid) == priorMinflt.end()) {
-                priorMinflt[tmptid] = newMinflt;
-                return true;
-            }
-            // a "stuck" thread:
-            // minflt will be 0 for non-monotonically increasing machines,
-            // it will be equal to the previous for monotonically increasing
-            if (newMinflt == 0 || priorMinflt[tmptid] == newMinflt) {
-                priorMinflt[tmptid] = newMinflt;
-                return false;
-            }
-            // assume it's running for reals
-            priorMinflt[tmptid] = newMinflt;
+    // ok, the thread claims to be running (state == R)
+    if (stat.state == 'R') {
+        // if not the main thread, and it says it's running, it's running.
+        if (!isMain) { return true; }
+        uint64_t newMinflt = stat.minflt;
+        // have we seen this thread's minflt state before? if not, save it.
+        auto prior = priorMinflt.find(tid);
+        if (prior == priorMinflt.end()) {
+            priorMinflt[tid] = newMinflt;
             return true;
         }
-        // this is also a "running" state - it's tracing
-        if (tracingStop.compare(fields[state]) == 0) { return true; }
-        // if it occupied the CPU some time in the last period, it's running.
-        if (!isMain && atol(fields[utime].c_str()) > 0) { return true; }
+        // a "stuck" thread:
+        // minflt will be 0 for non-monotonically increasing machines,
+        // it will be equal to the previous for monotonically increasing
+        bool stuck = (newMinflt == 0 || prior->second == newMinflt);
+        // otherwise, assume it's running for reals
+        prior->second = newMinflt;
+        return !stuck;
     }
+    // this is also a "running" state - it's tracing
+    if (stat.state == 't') { return true; }
+    // if it occupied the CPU some time in the last period, it's running.
+    if (!isMain && stat.utime > 0) { return true; }
     // neither running nor tracing? not running.
     return false;
 }
 
-void getThreadStatus(const char * filename, std::map<std::string, std::string>& fields) {
-    //std::cout << std::endl << filename << std::endl;
-    FILE *f = fopen(filename, "r");
-    std::string tmpstr{""};
-    if (!f) { return; }
-    const std::string ctx("voluntary_ctxt_switches");
-    const std::string nvctx("nonvoluntary_ctxt_switches");
-    char line[4097] = {0};
-    while ( fgets( line, 4096, f)) {
-        std::string tmp(line);
-        if (!tmp.compare(0,ctx.size(),ctx)) {
-            const std::regex separator(":");
-            std::sregex_token_iterator token(tmp.begin(),
-                    tmp.end(), separator, -1);
-            std::sregex_token_iterator end;
-            std::string name = *token++;
-            if (token != end) {
-                tmpstr = *token;
-                tmpstr.erase(
-                    std::remove_if(
-                        tmpstr.begin(), tmpstr.end(),
-                        ::isspace),
-                    tmpstr.end());
-            }
-            fields.insert(std::pair(ctx, tmpstr));
-        }
-        if (!tmp.compare(0,nvctx.size(),nvctx)) {
-            const std::regex separator(":");
-            std::sregex_token_iterator token(tmp.begin(),
-                    tmp.end(), separator, -1);
-            std::sregex_token_iterator end;
-            std::string name = *token++;
-            if (token != end) {
-                tmpstr = *token;
-                tmpstr.erase(
-                    std::remove_if(
-                        tmpstr.begin(), tmpstr.end(),
-                        ::isspace),
-                    tmpstr.end());
-            }
-            fields.insert(std::pair(nvctx, tmpstr));
+/* One pass over the status file gets the context switches and the
+ * allowed cpus, so the file only has to be read once per thread. */
+void parseThreadStatus(const char * buf, thread_status_t& status) {
+    const char ctx[] = "voluntary_ctxt_switches:";
+    const char nvctx[] = "nonvoluntary_ctxt_switches:";
+    const char allowed[] = "Cpus_allowed_list:";
+    status.has_cpus_allowed = false;
+    for (const char * p = buf ; *p != '\0' ; p = nextLine(p)) {
+        if (startsWith(p, ctx, sizeof(ctx)-1)) {
+            p += sizeof(ctx)-1;
+            status.voluntary_ctxt_switches = parseU64(p);
+        } else if (startsWith(p, nvctx, sizeof(nvctx)-1)) {
+            p += sizeof(nvctx)-1;
+            status.nonvoluntary_ctxt_switches = parseU64(p);
+        } else if (startsWith(p, allowed, sizeof(allowed)-1)) {
+            p += sizeof(allowed)-1;
+            status.has_cpus_allowed = parseCpuList(p, status.cpus_allowed);
         }
     }
-    fclose(f);
+}
+
+bool getThreadStatus(const char * filename, thread_status_t& status) {
+    auto& buffer = scratchBuffer();
+    if (readFile(filename, buffer) == 0) { return false; }
+    parseThreadStatus(buffer.data(), status);
+    return true;
+}
+
+bool getThreadStatus(ProcFile& file, thread_status_t& status) {
+    auto& buffer = scratchBuffer();
+    if (file.read(buffer) == 0) { return false; }
+    parseThreadStatus(buffer.data(), status);
+    return true;
 }
 
 std::vector<uint32_t> getAffinityList(int tid, int ncpus, int& nhwthr, std::string& tmpstr) {
@@ -291,85 +515,249 @@ std::string toString(std::set<uint32_t> allowed) {
     return outstr;
 }
 
-std::vector<std::map<std::string,std::string>> parseProcStat(void) {
-    std::vector<std::map<std::string,std::string>> fields;
-    FILE * pFile;
-    char line[128];
-    pFile = fopen ("/proc/stat","r");
-    if (pFile == nullptr) {
-        perror ("Error opening file");
-        return fields;
-    }
-        while ( fgets( line, 127, pFile)) {
-            // skip the total line
-            if ( strncmp (line, "cpu ", 4) == 0 ) {
-                continue;
-            } else if ( strncmp (line, "cpu", 3) == 0 ) {
-                std::vector<unsigned int> v;
-                std::string tmp;
-                std::stringstream ss(line);
-                while (getline(ss, tmp, ' ')) {
-                    // store token string in the vector
-                    v.push_back(atol(tmp.c_str()));
-                }
-                // These "corrections" are what htop does...
-                // see https://github.com/htop-dev/htop/blob/4102862d12695cdf003e2d51ef6ce5984b7136d7/linux/LinuxMachine.c#L455
-                v[1] -= v[9]; // user -= guest
-                v[2] -= v[10]; // nice -= guest_nice
-                double idle_all_time = v[4] + v[5]; //idletime + ioWait;
-                double system_all_time = v[3] + v[6] + v[7]; //systemtime + irq + softIrq;
-                double virt_all_time = v[9] + v[10]; //guest + guestnice;
-                double total_time = v[1] + v[2] + system_all_time + idle_all_time + v[8] + virt_all_time; //usertime + nicetime + system_all_time + idle_all_time + steal + virt_all_time;
-                std::map<std::string,std::string> f;
-                f.insert(std::pair("user",std::to_string(v[1])));
-                f.insert(std::pair("nice",std::to_string(v[2])));
-                f.insert(std::pair("system",std::to_string(v[3])));
-                f.insert(std::pair("system_all",std::to_string(system_all_time)));
-                f.insert(std::pair("idle",std::to_string(v[4])));
-                f.insert(std::pair("idle_all",std::to_string(idle_all_time)));
-                f.insert(std::pair("iowait",std::to_string(v[5])));
-                f.insert(std::pair("irq",std::to_string(v[6])));
-                f.insert(std::pair("softirq",std::to_string(v[7])));
-                f.insert(std::pair("steal",std::to_string(v[8])));
-                f.insert(std::pair("guest",std::to_string(v[9])));
-                f.insert(std::pair("virt_all_time",std::to_string(virt_all_time)));
-                f.insert(std::pair("guest_nice",std::to_string(v[10])));
-                f.insert(std::pair("total_time",std::to_string(total_time)));
-                fields.push_back(f);
-            } else {
-                // we're done at this point
-                break;
-            }
+/* Returns the number of cpu lines found. The vector only grows when
+ * more cpus are seen than before. */
+size_t parseProcStat(const char * buf, std::vector<cpu_stat_t>& stats) {
+    size_t index{0};
+    for (const char * p = buf ; *p != '\0' ; p = nextLine(p)) {
+        // skip the total line
+        if ( startsWith(p, "cpu ", 4) ) {
+            continue;
+        } else if ( startsWith(p, "cpu", 3) ) {
+            p += 3;
+            if (index >= stats.size()) { stats.resize(index+1); }
+            cpu_stat_t& s = stats[index++];
+            s.id = parseU64(p);
+            s.user = parseU64(p);
+            s.nice = parseU64(p);
+            s.system = parseU64(p);
+            s.idle = parseU64(p);
+            s.iowait = parseU64(p);
+            s.irq = parseU64(p);
+            s.softirq = parseU64(p);
+            s.steal = parseU64(p);
+            s.guest = parseU64(p);
+            s.guest_nice = parseU64(p);
+            // These "corrections" are what htop does...
+            // see https://github.com/htop-dev/htop/blob/4102862d12695cdf003e2d51ef6ce5984b7136d7/linux/LinuxMachine.c#L455
+            s.user -= std::min(s.user, s.guest);
+            s.nice -= std::min(s.nice, s.guest_nice);
+        } else {
+            // we're done at this point
+            break;
         }
-    fclose (pFile);
-    return fields;
+    }
+    return index;
 }
 
-std::map<std::string,std::string> parseNodeInfo(void) {
-    std::map<std::string,std::string> fields;
-    FILE * pFile;
-    char line[128];
-    pFile = fopen ("/proc/meminfo","r");
-    if (pFile == nullptr) {
-        perror ("Error opening file");
-        return fields;
+size_t parseProcStat(ProcFile& file, std::vector<cpu_stat_t>& stats) {
+    auto& buffer = scratchBuffer();
+    if (file.read(buffer) == 0) {
+        perror ("Error reading /proc/stat");
+        return 0;
     }
-    while ( fgets( line, 128, pFile)) {
-        std::string tmp(line);
-        const std::regex separator(":");
-        std::sregex_token_iterator token(tmp.begin(), tmp.end(),
-            separator, -1);
-        std::sregex_token_iterator end;
-        std::string name = *token++;
-        if (token != end && name.rfind("Mem", 0) == 0) {
-            name += " kB";
-            std::string value = *token;
-            unsigned d1 = strtoul (value.c_str(), nullptr, 0);
-            fields.insert(std::pair<std::string,std::string>(name,std::to_string(d1)));
+    return parseProcStat(buffer.data(), stats);
+}
+
+CounterFile::CounterFile(const std::string& path,
+    const std::vector<std::string>& _filter, bool sequential) :
+    file(path, sequential), filter(_filter) {
+    auto& buffer = scratchBuffer();
+    if (file.read(buffer) > 0) { learn(buffer.data()); }
+}
+
+bool CounterFile::keep(const std::string& name) const {
+    if (filter.empty()) { return true; }
+    for (auto& f : filter) {
+        if (!f.empty() && f.back() == '*') {
+            if (name.compare(0, f.size() - 1, f, 0, f.size() - 1) == 0) { return true; }
+        } else if (name == f) {
+            return true;
         }
     }
-    fclose(pFile);
-    return fields;
+    return false;
+}
+
+/* Skips the "Node <n>" of the sysfs meminfo, and returns the end of the name */
+static const char * counterName(const char *& p) {
+    if (startsWith(p, "Node ", 5)) {
+        p = skipSpaces(p + 5);
+        while (*p >= '0' && *p <= '9') { p++; }
+        p = skipSpaces(p);
+    }
+    const char * end = p;
+    while (*end != '\0' && *end != '\n' && *end != ':' && *end != ' ') { end++; }
+    return end;
+}
+
+void CounterFile::learn(const char * buf) {
+    for (const char * p = buf ; *p != '\0' ; p = nextLine(p)) {
+        const char * end = counterName(p);
+        std::string key(p, end - p);
+        if (*end == ':') { end++; }
+        uint64_t value = parseU64(end);
+        std::string name{key};
+        if (startsWith(skipSpaces(end), "kB", 2)) { name += " kB"; }
+        if (!keep(name)) {
+            lines.push_back(-1);
+            continue;
+        }
+        lines.push_back((int)_names.size());
+        _names.push_back(name);
+        keys.push_back(key);
+        last.push_back(value);
+    }
+}
+
+/* Lines come and go as the counters do (and vmstat has counters that
+ * depend on the kernel config), so map the lines to the names again */
+void CounterFile::index(const char * buf) {
+    lines.clear();
+    for (const char * p = buf ; *p != '\0' ; p = nextLine(p)) {
+        const char * end = counterName(p);
+        auto found = std::find_if(keys.begin(), keys.end(),
+            [&](const std::string& k) {
+                return k.size() == (size_t)(end - p) &&
+                    k.compare(0, k.size(), p, end - p) == 0; });
+        lines.push_back(found == keys.end() ? -1 : (int)(found - keys.begin()));
+    }
+}
+
+/* Fails if a kept line isn't the counter it was */
+bool CounterFile::parse(const char * buf) {
+    size_t line{0};
+    for (const char * p = buf ; *p != '\0' ; p = nextLine(p), line++) {
+        if (line == lines.size()) { return false; }
+        int i = lines[line];
+        if (i < 0) { continue; }
+        const char * end = counterName(p);
+        const std::string& key = keys[i];
+        if (key.size() != (size_t)(end - p) ||
+            key.compare(0, key.size(), p, end - p) != 0) { return false; }
+        if (*end == ':') { end++; }
+        last[i] = parseU64(end);
+    }
+    return line == lines.size();
+}
+
+bool CounterFile::read(std::vector<uint64_t>& values) {
+    if (_names.empty()) { return false; }
+    auto& buffer = scratchBuffer();
+    if (file.read(buffer) == 0) { return false; }
+    if (!parse(buffer.data())) {
+        index(buffer.data());
+        parse(buffer.data());
+    }
+    values.insert(values.end(), last.begin(), last.end());
+    return true;
+}
+
+/* Page faults, swapping, reclaim, THP compaction and NUMA placement, the
+ * memory problems that cost time rather than capacity */
+MemoryFiles::MemoryFiles() {
+    std::vector<std::string> vmstat;
+    std::stringstream ss(parseString("ZS_VMSTAT",
+        "pgfault,pgmajfault,pswpin,pswpout,pgscan_direct,compact_stall,"
+        "numa_miss,numa_foreign,thp_*"));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) { vmstat.push_back(item); }
+    }
+    files.emplace_back("/proc/meminfo");
+    // one counter per record, so it may take more than one pread()
+    if (!vmstat.empty()) { files.emplace_back("/proc/vmstat", vmstat, true); }
+    nodeFiles = files.size();
+    for (auto& f : files) {
+        _nodeNames.insert(_nodeNames.end(), f.names().begin(), f.names().end());
+    }
+    if (!parseBool("ZS_NUMA_MEMORY", true)) { return; }
+    std::string online;
+    std::ifstream in("/sys/devices/system/node/online");
+    cpu_set_t mask;
+    if (!std::getline(in, online) || !parseCpuList(online.c_str(), mask)) { return; }
+    for (auto id : toList(mask)) {
+        std::string dir{"/sys/devices/system/node/node" + std::to_string(id)};
+        CounterFile meminfo(dir + "/meminfo");
+        CounterFile numastat(dir + "/numastat");
+        if (meminfo.names().empty()) { continue; }
+        std::vector<std::string> names{meminfo.names()};
+        names.insert(names.end(), numastat.names().begin(), numastat.names().end());
+        // every node has the same files, skip one that doesn't
+        if (_numaNames.empty()) { _numaNames = names; }
+        if (names != _numaNames) { continue; }
+        files.push_back(std::move(meminfo));
+        files.push_back(std::move(numastat));
+        nodes.push_back(id);
+    }
+}
+
+bool MemoryFiles::read(std::vector<uint64_t>& node, std::vector<uint64_t>& numa) {
+    node.clear();
+    numa.clear();
+    for (size_t i = 0 ; i < nodeFiles ; i++) {
+        if (!files[i].read(node)) { return false; }
+    }
+    for (size_t i = nodeFiles ; i < files.size() ; i++) {
+        if (!files[i].read(numa)) {
+            // the NUMA nodes are optional
+            numa.clear();
+            break;
+        }
+    }
+    return true;
+}
+
+/* One line per mapping, like
+ * "7f1c2000 default anon=3 dirty=3 N0=1 N1=2 kernelpagesize_kB=4"
+ * where the page size comes last, so the node counts wait for it. */
+void parseNumaMaps(const char * buf, numa_maps_t& maps) {
+    std::fill(maps.kB.begin(), maps.kB.end(), 0);
+    std::fill(maps.anon_kB.begin(), maps.anon_kB.end(), 0);
+    std::vector<std::pair<uint32_t, uint64_t>> pages;
+    for (const char * p = buf ; *p != '\0' ; p = nextLine(p)) {
+        pages.clear();
+        bool anon{false};
+        uint64_t pageSize{4};
+        for (const char * t = nextField(p) ; *t != '\0' && *t != '\n' ; t = nextField(t)) {
+            const char * q = t + 1;
+            if (t[0] == 'N' && *q >= '0' && *q <= '9') {
+                uint32_t node = (uint32_t)parseU64(q);
+                if (*q == '=') {
+                    q++;
+                    pages.emplace_back(node, parseU64(q));
+                }
+            } else if (startsWith(t, "anon=", 5)) {
+                anon = true;
+            } else if (startsWith(t, "kernelpagesize_kB=", 18)) {
+                q = t + 18;
+                pageSize = parseU64(q);
+            }
+        }
+        for (auto& n : pages) {
+            if (n.first >= maps.kB.size()) {
+                maps.kB.resize(n.first + 1, 0);
+                maps.anon_kB.resize(n.first + 1, 0);
+            }
+            maps.kB[n.first] += n.second * pageSize;
+            if (anon) { maps.anon_kB[n.first] += n.second * pageSize; }
+        }
+    }
+}
+
+/* numa_maps is read only now and then, so it isn't kept open */
+bool getNumaMaps(const char * filename, numa_maps_t& maps) {
+    auto& buffer = scratchBuffer();
+    if (readFile(filename, buffer) == 0) { return false; }
+    parseNumaMaps(buffer.data(), maps);
+    return true;
+}
+
+bool getNodeCpus(uint32_t node, cpu_set_t& cpus) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%u/cpulist", node);
+    auto& buffer = scratchBuffer();
+    if (readFile(filename, buffer) == 0) { return false; }
+    return parseCpuList(buffer.data(), cpus);
 }
 
 size_t parseMaxPid(void) {
@@ -416,6 +804,18 @@ int parseInt(const char *env, int default_value = 0) {
     return tmp;
 }
 
+/*********************************************************************
+ * Parse a floating point value
+ ********************************************************************/
+double parseDouble(const char *env, double default_value = 0.0) {
+    const char * str = getenv(env);
+    if (str == NULL) { return default_value; }
+    char * end = NULL;
+    double tmp = strtod(str, &end);
+    if (end == str || tmp < 0.0) { return default_value; }
+    return tmp;
+}
+
 /*********************************************************************
  * Parse a string value
  ********************************************************************/
@@ -456,6 +856,22 @@ bool getVerbose(void) {
     return verbose;
 }
 
+/* The sampling period in seconds, which can be fractional down to 1 ms */
+double getPeriod(void) {
+    static double period{std::max(0.001, parseDouble("ZS_PERIOD", 1.0))};
+    return period;
+}
+
+/* A collector's period, ZS_PERIOD_<collector>, rounded to a whole number
+ * of sampling periods, because the collectors run on the sampling ticks */
+double getPeriod(const char * collector, double default_value) {
+    std::string env{"ZS_PERIOD_"};
+    env += collector;
+    double seconds = parseDouble(env.c_str(), default_value);
+    double ticks = std::max(1.0, std::round(seconds / getPeriod()));
+    return ticks * getPeriod();
+}
+
 bool getHeartBeat(void) {
     static bool verbose{parseBool("ZS_HEART_BEAT",false)};
     return verbose;
@@ -27,7 +27,9 @@
 #include <set>
 #include <map>
 #include <vector>
+#include <unordered_map>
 #include <cstdint>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 #define gettid() syscall(SYS_gettid)
@@ -38,20 +40,102 @@
 
 namespace zerosum {
 
+/* Fixed-layout samples filled in by the /proc parsers. The parsers read
+ * into reusable buffers and don't allocate memory per sample. */
+
+/* One cpuN line from /proc/stat, in clock ticks */
+typedef struct cpu_stat {
+    uint32_t id;
+    uint64_t user;
+    uint64_t nice;
+    uint64_t system;
+    uint64_t idle;
+    uint64_t iowait;
+    uint64_t irq;
+    uint64_t softirq;
+    uint64_t steal;
+    uint64_t guest;
+    uint64_t guest_nice;
+} cpu_stat_t;
+
+/* The fields we want from /proc/self/task/<tid>/stat */
+typedef struct thread_stat {
+    char state;
+    uint32_t flags;
+    uint32_t processor;
+    uint64_t minflt;
+    uint64_t majflt;
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t nswap;
+} thread_stat_t;
+
+/* The fields we want from /proc/self/task/<tid>/status */
+typedef struct thread_status {
+    uint64_t voluntary_ctxt_switches;
+    uint64_t nonvoluntary_ctxt_switches;
+    bool has_cpus_allowed;
+    cpu_set_t cpus_allowed;
+} thread_status_t;
+
+/* /proc/self/task/<tid>/schedstat, only with CONFIG_SCHED_INFO */
+typedef struct thread_schedstat {
+    uint64_t run_ns;     // time spent on the cpu
+    uint64_t wait_ns;    // time spent runnable, waiting on a run queue
+    uint64_t timeslices; // times run on a cpu
+} thread_schedstat_t;
+
+/* One thread's reading from a sweep over /proc/self/task */
+typedef struct task_sample {
+    uint32_t tid;
+    bool valid;
+    bool has_schedstat;
+    thread_stat_t stat;
+    thread_status_t status;
+    thread_schedstat_t schedstat;
+} task_sample_t;
+
+/* /proc/self/numa_maps, summarized: the kB of the mapped pages on each
+ * NUMA node, and how many of those are anonymous memory (the heap, the
+ * stacks), indexed by node ID */
+typedef struct numa_maps {
+    std::vector<uint64_t> kB;
+    std::vector<uint64_t> anon_kB;
+} numa_maps_t;
+
+class ProcFile;
+
+size_t readFile(const char * filename, std::vector<char>& buffer);
+size_t parseProcStat(const char * buf, std::vector<cpu_stat_t>& stats);
+bool parseThreadStat(const char * buf, thread_stat_t& stat);
+void parseThreadStatus(const char * buf, thread_status_t& status);
+bool parseThreadSchedstat(const char * buf, thread_schedstat_t& schedstat);
+bool parseCpuList(const char * buf, cpu_set_t& cpus);
+void parseNumaMaps(const char * buf, numa_maps_t& maps);
+bool getNumaMaps(const char * filename, numa_maps_t& maps);
+bool getNodeCpus(uint32_t node, cpu_set_t& cpus);
+std::vector<uint32_t> toList(const cpu_set_t& cpus);
+
 std::vector<uint32_t> parseDiscreteValues(std::string inputString);
 std::string getCpusAllowed(const char * filename);
-std::map<std::string, std::string> getThreadStat(const char * filename);
-void getThreadStatus(const char * filename, std::map<std::string, std::string>& fields);
-bool isRunning(std::map<std::string, std::string>& fields, const char * tid, bool isMain);
+bool getThreadStat(const char * filename, thread_stat_t& stat);
+bool getThreadStat(ProcFile& file, thread_stat_t& stat);
+bool getThreadStatus(const char * filename, thread_status_t& status);
+bool getThreadStatus(ProcFile& file, thread_status_t& status);
+bool getThreadSchedstat(const char * filename, thread_schedstat_t& schedstat);
+bool getThreadSchedstat(ProcFile& file, thread_schedstat_t& schedstat);
+bool isRunning(const thread_stat_t& stat, uint32_t tid, bool isMain);
 std::vector<uint32_t> getAffinityList(int tid, int ncpus, int& nhwthr, std::string& tmpstr);
 std::string toString(std::set<uint32_t> allowed);
-std::vector<std::map<std::string,std::string>> parseProcStat(void);
-std::map<std::string,std::string> parseNodeInfo(void);
+size_t parseProcStat(ProcFile& file, std::vector<cpu_stat_t>& stats);
 void setThreadAffinity(int core);
 bool parseBool(const char * env, bool default_value);
 int parseInt(const char * env, int default_value);
+double parseDouble(const char * env, double default_value);
 std::string parseString(const char * env, std::string default_value);
 bool getVerbose(void);
+double getPeriod(void);
+double getPeriod(const char * collector, double default_value = getPeriod());
 bool getHeartBeat(void);
 size_t parseMaxPid(void);
 std::string getUniqueFilename(void);
@@ -59,6 +143,129 @@ int test_for_MPI_comm_rank(int commrank);
 int test_for_MPI_comm_size(int commsize);
 int test_for_MPI_local_rank(int commrank);
 
+/* A procfs/sysfs file that stays open between periods, and is re-read
+ * from the start with pread(). It is opened on the first read, and closed
+ * on any error so that the next read will try to reopen it. Most files
+ * are generated whole, so one pread() that doesn't fill the buffer is the
+ * whole file. A sequential file (seq_file with one record per call, like
+ * /proc/vmstat) can return less, so it is read until pread() returns 0. */
+class ProcFile {
+public:
+    ProcFile() = default;
+    explicit ProcFile(const std::string& _path, bool _sequential = false) :
+        path(_path), sequential(_sequential) {}
+    ~ProcFile() { close(); }
+    ProcFile(const ProcFile&) = delete;
+    ProcFile& operator=(const ProcFile&) = delete;
+    ProcFile(ProcFile&& other) noexcept : path(std::move(other.path)),
+        sequential(other.sequential), fd(other.fd) {
+        other.fd = -1;
+    }
+    ProcFile& operator=(ProcFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            path = std::move(other.path);
+            sequential = other.sequential;
+            fd = other.fd;
+            other.fd = -1;
+        }
+        return *this;
+    }
+    size_t read(std::vector<char>& buffer);
+    bool open(void);
+    void close(void);
+    bool isOpen(void) const { return fd >= 0; }
+    int descriptor(void) const { return fd; }
+    std::string path;
+private:
+    bool sequential{false};
+    int fd{-1};
+};
+
+/* The stat, status and schedstat files for every thread of this process,
+ * kept open across periods. Threads that aren't seen during a sweep have
+ * exited, so their descriptors are closed at the end of the sweep. Only a
+ * fraction of RLIMIT_NOFILE is used (see ZS_FD_CACHE_LIMIT), threads
+ * beyond that are read with open/read/close. schedstat is only read if
+ * the kernel has it, and ZS_SCHEDSTAT isn't 0. */
+class TaskFileCache {
+public:
+    typedef struct task_files {
+        ProcFile stat;
+        ProcFile status;
+        ProcFile schedstat;
+        uint32_t generation;
+    } task_files_t;
+    TaskFileCache();
+    void beginSweep(void) { generation++; }
+    /* false if the thread has exited, has_schedstat is set separately */
+    bool read(task_sample_t& sample);
+    bool schedstat(void) const { return withSchedstat; }
+    /* The open files for this thread, or nullptr if it can't be cached */
+    task_files_t* acquire(uint32_t tid);
+    void endSweep(void);
+    size_t size(void) const { return files.size(); }
+private:
+    bool readCached(task_files_t& files, task_sample_t& sample);
+    std::unordered_map<uint32_t, task_files_t> files;
+    uint32_t generation{0};
+    size_t limit;
+    bool withSchedstat;
+};
+
+/* A file of "name value" lines, like /proc/meminfo, /proc/vmstat or the
+ * meminfo and numastat of a NUMA node, kept open. The first read finds
+ * the names and maps every line to one of them. The later reads check
+ * each kept line's name against that map, and only find the lines by
+ * name again when counters have come or gone. The "Node <n>" prefix of
+ * the sysfs meminfo is dropped, and values in kB have " kB" in their
+ * name, like "MemFree kB". With a filter, only the names it lists are
+ * kept, and an entry that ends in '*' is a prefix, like "thp_*". */
+class CounterFile {
+public:
+    explicit CounterFile(const std::string& path,
+        const std::vector<std::string>& filter = {}, bool sequential = false);
+    /* Appends the values, in the order of names(). A counter that has
+     * gone from the file keeps its last value. */
+    bool read(std::vector<uint64_t>& values);
+    const std::vector<std::string>& names(void) const { return _names; }
+private:
+    bool keep(const std::string& name) const;
+    void learn(const char * buf);
+    void index(const char * buf);
+    bool parse(const char * buf);
+    ProcFile file;
+    std::vector<std::string> filter;
+    std::vector<std::string> _names;
+    // the names as they appear in the file, without the unit
+    std::vector<std::string> keys;
+    // for every line of the file, the index of its name, or -1
+    std::vector<int> lines;
+    std::vector<uint64_t> last;
+};
+
+/* The memory of the node: all of /proc/meminfo, the /proc/vmstat counters
+ * in ZS_VMSTAT, and the meminfo and numastat of every NUMA node. The
+ * NUMA values are flattened, numaNames() values per node in the order of
+ * numaNodes(). */
+class MemoryFiles {
+public:
+    MemoryFiles();
+    bool read(std::vector<uint64_t>& node, std::vector<uint64_t>& numa);
+    /* meminfo, then the vmstat counters */
+    const std::vector<std::string>& nodeNames(void) const { return _nodeNames; }
+    /* meminfo, then numastat, the same for every NUMA node */
+    const std::vector<std::string>& numaNames(void) const { return _numaNames; }
+    const std::vector<uint32_t>& numaNodes(void) const { return nodes; }
+private:
+    std::vector<CounterFile> files;
+    // meminfo and vmstat first, then two per NUMA node
+    size_t nodeFiles{0};
+    std::vector<uint32_t> nodes;
+    std::vector<std::string> _nodeNames;
+    std::vector<std::string> _numaNames;
+};
+
 class in_zs {
     public:
         static size_t& get() {
@@ -31,6 +31,7 @@
 #include <thread>
 #include <set>
 #include <chrono>
+#include <cmath>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
@@ -41,6 +42,9 @@
 #include "zerosum.h"
 #include "perfstubs.h"
 #include "utils.h"
+#include "records.h"
+#include "record_writer.h"
+#include "output_pipeline.h"
 #ifdef ZEROSUM_STANDALONE
 #include "error_handling.h"
 #ifdef ZEROSUM_USE_STATIC_GLOBAL_CONSTRUCTOR
@@ -85,24 +89,17 @@ void ZeroSum::threadedFunction(void) {
     async_tid = gettid();
     setThreadAffinity(parseInt("ZS_ASYNC_CORE", process.getMaxHWT()));
     bool initialized = false;
-    // We want to measure periodically, ON THE SECOND.
-    // So, we take into consideration how long it takes to do
-    // this measurement.
+    // We want to measure periodically, ON THE SECOND (or the period).
+    // The timer keeps absolute deadlines, so the time it takes to do
+    // this measurement doesn't push the next one back.
     auto prev = std::chrono::steady_clock::now();
-    std::chrono::seconds period{parseInt("ZS_PERIOD", 1)};
     constexpr uint32_t oneYear = 60 * 60 * 24 * 365; // one year in seconds
     std::chrono::seconds timeLimit{parseInt("ZS_TIMELIMIT", oneYear)};
     auto expiration = prev + timeLimit;
 
-#ifdef ZEROSUM_USE_ZEROMQ
-    std::chrono::seconds aggregatorPeriod{parseInt("ZS_AGGREGATOR_PERIOD", 10)};
-    auto then2 = prev + aggregatorPeriod;
-#endif
-
     block_signal();
+    timer.start();
     while (working) {
-        auto then = prev + period;
-        auto stop = then - std::chrono::steady_clock::now();
         // keep trying until MPI is initialized
         while (!initialized && working) {
             initialized = doOnce();
@@ -110,34 +107,16 @@ void ZeroSum::threadedFunction(void) {
         // once initialized, we can do our periodic checks.
         if (initialized) {
             doPeriodic();
-            if (logfile.is_open()) {
-                logfile << process.logThreads() << std::flush;
-            }
         }
-        std::unique_lock<std::mutex> lk(cv_m);
-        if(cv.wait_for(lk, stop, [&]{return !working;}))
+        if (!timer.wait()) {
             return;
-        prev = then;
+        }
         // check for expiration date
         if (std::chrono::steady_clock::now() > expiration) {
+            recordEvent("time limit", std::to_string(timeLimit.count()) + " s");
             finalizeLog();
             pthread_kill(this->process.id, SIGQUIT);
         }
-#ifdef ZEROSUM_USE_ZEROMQ
-        static bool aggregating{parseBool("ZS_WRITE_TO_AGGREGATOR", false)};
-        if (aggregating) {
-            // check for aggregation step
-            if (std::chrono::steady_clock::now() > then2) {
-                // do aggregation
-                std::string data{computeNode.toCSV(process.hwthreads,
-                    process.rank, process.shmrank, lastStepWritten)};
-                data += process.toCSV(lastStepWritten);
-                int rc = writeToLocalAggregator(data);
-                // set a new expiration time
-                then2 = then2 + aggregatorPeriod;
-            }
-        }
-#endif
     }
 }
 
@@ -197,6 +176,7 @@ bool ZeroSum::doOnce(void) {
     getMPIinfo();
     /* Now, see what our rank is on the node */
     int shmrank = test_for_MPI_local_rank((int)process.rank);
+    process.shmrank = shmrank;
 
 #ifdef ZEROSUM_USE_MPI_disabled // won't work with single-threaded MPI! Use above method.
     // disable error handling, if we are using the debugger!
@@ -218,7 +198,11 @@ bool ZeroSum::doOnce(void) {
         logfile << process.toString() << std::flush;
     }
     getgpu();
-    computeNode.updateNodeFields(parseNodeInfo(),step);
+    sampleNodeInfo();
+    shareNode(shmrank);
+    scheduleCollectors();
+    // from here on, the writer thread owns the log file
+    startOutput();
 #ifdef USE_HWLOC
     ScopedHWLOC::validate_hwloc(shmrank);
 #endif
@@ -231,6 +215,7 @@ void ZeroSum::checkForStop(void) {
     if(access("./zerosum.stop", F_OK) == 0) {
         std::cerr << "Stop file detected! Aborting!" << std::endl;
         std::cerr << "Thread " << gettid() << " signalling " << this->process.id << std::endl;
+        recordEvent("stop file", "./zerosum.stop");
         finalizeLog();
         pthread_kill(this->process.id, SIGQUIT);
     }
@@ -248,7 +233,7 @@ void ZeroSum::checkForStop(void) {
             long timeDifference = difftime(currentTime, fileStat.st_mtime);
             if (process.rank == 0) {
                 if (logfile.is_open()) {
-                    logfile << "logfile time freshness: " << timeDifference << " seconds" << std::endl;
+                    periodLog << "logfile time freshness: " << timeDifference << " seconds" << std::endl;
                 }
             }
 
@@ -256,6 +241,8 @@ void ZeroSum::checkForStop(void) {
             if(timeDifference > duration) {
                 std::cerr << "Log file " << logfileName << " went stale! Aborting!" << std::endl;
                 std::cerr << "Thread " << gettid() << " signalling " << this->process.id << std::endl;
+                recordEvent("stale log", logfileName + " not updated for " +
+                    std::to_string(timeDifference) + " s");
                 finalizeLog();
                 pthread_kill(this->process.id, SIGQUIT);
             }
@@ -265,35 +252,191 @@ void ZeroSum::checkForStop(void) {
 
 void ZeroSum::doPeriodic(void) {
     PERFSTUBS_SCOPED_TIMER_FUNC();
+    // the previous step is complete, copy it out for the writer thread
+    auto snapshot = takeSnapshot();
     step++;
-    getpthreads();
-    computeNode.updateFields(parseProcStat(),step);
-    computeNode.updateNodeFields(parseNodeInfo(),step);
-#ifdef ZEROSUM_USE_LM_SENSORS
-    computeNode.updateNodeFields(sensors.read_sensors(),step);
-#endif // ZEROSUM_USE_LM_SENSORS
-    computeNode.updateNodeFields(cray_counters.read_counters(),step);
-    getgpustatus();
-    std::string tmpstr{computeNode.reportMemory()};
-    if (logfile.is_open()) {
-        logfile << tmpstr << std::flush;
+    // the steps are only nominally a period apart, record when this one was
+    computeNode.updateTime(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count(), step);
+    collectors.tick(step, timer.deadline());
+    // the memory only changes when it has been sampled
+    if (collectors.ran(nodeCollector) || collectors.ran(gpuCollector)) {
+        std::string tmpstr{computeNode.reportMemory()};
+        if (logfile.is_open()) {
+            periodLog << tmpstr;
+        }
+        if (process.rank == 0 && getHeartBeat()) {
+            snapshot->console = tmpstr;
+        }
     }
-    if (process.rank == 0 && getHeartBeat()) {
-        std::cout << tmpstr << std::flush;
+    if (logfile.is_open()) {
+        periodLog << process.logThreads();
     }
+    snapshot->log += periodLog.str();
+    periodLog.str("");
+    pipeline->publish(std::move(snapshot));
     checkForStop();
 }
 
+void ZeroSum::sampleProcStat(void) {
+    size_t count = parseProcStat(procStat, cpuStats);
+    computeNode.updateFields(cpuStats, count, step);
+}
+
+void ZeroSum::sampleNodeInfo(void) {
+    if (memoryFiles.read(nodeSample.memory, nodeSample.numa)) {
+        updateMemory(nodeSample);
+    }
+}
+
+/* A sample copied from another rank only fits if it read the same files */
+void ZeroSum::updateMemory(const node_sample_t& sample) {
+    if (memoryIds.empty()) {
+        for (auto& n : memoryFiles.nodeNames()) {
+            memoryIds.push_back(series::Metrics::intern(n));
+        }
+        for (auto& n : memoryFiles.numaNames()) {
+            numaIds.push_back(series::Metrics::intern(n));
+        }
+    }
+    computeNode.updateMemory(memoryIds, sample.memory, step);
+    computeNode.updateNUMA(memoryFiles.numaNodes(), numaIds, sample.numa, step);
+}
+
+/* Every rank on a node would read the same /proc/stat, /proc/meminfo
+ * and node plugins, so local rank 0 shares its samples with the
+ * others. This needs an ID for the job, so ranks of different jobs on a
+ * shared node don't mix. */
+void ZeroSum::shareNode(int shmrank) {
+    static bool sharing{parseBool("ZS_SHARE_NODE", true)};
+    std::string key{parseString("ZS_SHARE_NODE_KEY", NodeShare::jobKey())};
+    if (!sharing || key.empty()) { return; }
+    // a sample from more than two periods ago is stale
+    uint64_t maxAge = (uint64_t)(2.0e9 * getPeriod("NODE"));
+    nodeShare = std::make_unique<NodeShare>(key, shmrank == 0,
+        std::max(cpuStats.size(), (size_t)computeNode.ncpus), maxAge);
+}
+
+/* Each collector runs every ZS_PERIOD_<NAME> seconds, the sampling period
+ * by default, starting ZS_PHASE_<NAME> seconds in. Both are rounded to
+ * whole sampling periods. */
+void ZeroSum::scheduleCollectors(void) {
+    double tick = getPeriod();
+    auto add = [&](const char * name, double period, double phase,
+        CollectorScheduler::collector_t collector, bool optional = false) {
+        std::string env{"ZS_PHASE_"};
+        env += name;
+        phase = parseDouble(env.c_str(), phase);
+        return collectors.add(name, (uint64_t)std::llround(period / tick),
+            (uint64_t)std::llround(phase / tick), collector, optional);
+    };
+    // a percentage of one core for the async thread, 0 for no limit
+    double budget = parseDouble("ZS_OVERHEAD_BUDGET", 0.0);
+    if (budget > 0.0) {
+        collectors.budget(budget, tick, [this](const std::string& message) {
+            if (logfile.is_open()) { periodLog << message; }
+            if (getVerbose()) { std::cerr << "ZeroSum: " << message << std::flush; }
+        });
+    }
+    add("THREADS", getPeriod("THREADS"), 0.0, [this]{ getpthreads(); });
+    // the stacks are drained by the thread sweep
+    double stackHz = parseDouble("ZS_STACK_HZ", 0.0);
+    if (stackHz > 0.0) {
+        stackSampler = std::make_unique<StackSampler>(stackHz, getPeriod("THREADS"));
+        if (!stackSampler->valid()) { stackSampler.reset(); }
+    }
+    if (parseBool("ZS_PERF_COUNTERS", false)) {
+        perfCounters = std::make_unique<PerfCounters>();
+        if (!perfCounters->valid()) {
+            if (getVerbose()) {
+                std::cerr << "ZeroSum: perf counters unavailable: "
+                          << perfCounters->status() << std::endl;
+            }
+            perfCounters.reset();
+        }
+    }
+    nodeCollector = add("NODE", getPeriod("NODE"), 0.0, [this]{ sampleNode(); });
+#ifdef ZEROSUM_USE_MPI
+    add("MPI", getPeriod("MPI"), 0.0, [this]{ sampleMPI(); });
+#endif
+    gpuCollector = add("GPU", getPeriod("GPU"), 0.0, [this]{ getgpustatus(); });
+    if (parseBool("ZS_PROCESS", true)) {
+        add("PROCESS", getPeriod("PROCESS"), 0.0, [this]{ sampleProcess(); });
+    }
+    // numa_maps walks the page tables of every mapping, so not every period
+    if (parseBool("ZS_NUMA_MAPS", memoryFiles.numaNodes().size() > 1)) {
+        double period = getPeriod("NUMA_MAPS", 10.0);
+        add("NUMA_MAPS", period, 0.0, [this]{ sampleNumaMaps(); }, true);
+    }
+    if (doDetails) {
+        // the constructor already looked for them once
+        double period = getPeriod("PROCESSES", 10.0);
+        add("PROCESSES", period, period, [this]{ getOtherProcesses(); }, true);
+    }
+    /* The node plugins are sampled by the node collector, so they can be
+     * shared, the others are collectors of their own. */
+    plugins = Plugin::load();
+    for (auto& p : plugins) {
+        if (logfile.is_open()) {
+            logfile << "Plugin: " << p->name() << (p->node() ? " (node)" : "")
+                    << std::endl;
+        }
+        if (p->node()) { continue; }
+        std::string name{p->name()};
+        for (char& c : name) { c = toupper(c); }
+        Plugin * plugin = p.get();
+        // a series of its own, so it only gets rows when it is sampled
+        series::TimeSeries * data = &(process.pluginData[p->name()]);
+        add(name.c_str(), getPeriod(name.c_str(), p->period() > 0.0 ?
+            p->period() : tick), 0.0, [this, plugin, data]{
+            pluginValues.clear();
+            if (!plugin->sample(pluginValues)) { return; }
+            data->begin(step);
+            for (auto& v : pluginValues) { setPluginValue(*data, v); }
+            data->end();
+        }, true);
+    }
+}
+
+std::string ZeroSum::timerSummary(void) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+        "\nSampling period: %.3f s, %lu deadlines, %lu missed (at most %lu in a row)\n",
+        (double)timer.period() / 1.0e9, timer.deadlines(), timer.missed(), timer.worst());
+    return std::string(buffer);
+}
+
+/* The node-wide samples, either copied from local rank 0 or read here */
+void ZeroSum::sampleNode(void) {
+    node_sample_t& sample = nodeSample;
+    if (nodeShare != nullptr) {
+        // a sample from more than two (possibly stretched) periods ago is stale
+        nodeShare->setMaxAge((uint64_t)(2.0e9 * getPeriod() *
+            (double)collectors.period(nodeCollector)));
+    }
+    if (nodeShare == nullptr || !nodeShare->read(sample)) {
+        sample.ncpus = parseProcStat(procStat, sample.cpus);
+        if (!memoryFiles.read(sample.memory, sample.numa)) {
+            sample.memory.clear();
+            sample.numa.clear();
+        }
+        sample.plugins.clear();
+        for (auto& p : plugins) {
+            if (p->node()) { p->sample(sample.plugins); }
+        }
+        if (nodeShare != nullptr) { nodeShare->publish(sample); }
+    }
+    computeNode.updateFields(sample.cpus, sample.ncpus, step);
+    updateMemory(sample);
+    computeNode.updateNodeFields(sample.plugins, step);
+}
+
 void ZeroSum::getProcStatus() {
     PERFSTUBS_SCOPED_TIMER_FUNC();
     std::string allowed_string = getCpusAllowed("/proc/self/status");
-    std::vector<uint32_t> allowed_list = parseDiscreteValues(allowed_string);
-    std::string filename = "/proc/self/stat";
-    auto fields = getThreadStat(filename.c_str());
-    filename = "/proc/self/status";
-    getThreadStatus(filename.c_str(), fields);
-    fields.insert(std::pair("step",std::to_string(step)));
-    process = software::Process(getpid(), 0, 1, fields, allowed_list);
+    software::LWPSample sample;
+    sample.read("/proc/self/stat", "/proc/self/status");
+    process = software::Process(getpid(), 0, 1, sample);
     process.hwthreads_raw = allowed_string;
     process.computeNode = &computeNode;
     if (doDetails) {
@@ -304,11 +447,7 @@ void ZeroSum::getProcStatus() {
 
 /* The main singleton constructor for the ZeroSum class */
 ZeroSum::ZeroSum(void) : step(0), start(std::chrono::steady_clock::now()),
-    doShutdown(true), mpiFinalize(false)
-#ifdef ZEROSUM_USE_ZEROMQ
-    , lastStepWritten(0)
-#endif
-    {
+    doShutdown(true), mpiFinalize(false) {
     working = true;
     if (parseBool("ZS_SIGNAL_HANDLER", false)) {
         register_signal_handler();
@@ -319,7 +458,7 @@ ZeroSum::ZeroSum(void) : step(0), start(std::chrono::steady_clock::now()),
     /* Important to do this now, before OpenMP is initialized
      * and this thread gets pinned to any cores */
     getProcStatus();
-    computeNode.updateFields(parseProcStat(),step);
+    sampleProcStat();
     /* Make sure we query the node with Hwloc before we launch the thread */
     worker = std::thread{&ZeroSum::threadedFunction, this};
 #ifdef ZEROSUM_USE_OPENMP
@@ -345,14 +484,19 @@ void ZeroSum::handleCrash(void) {
 void ZeroSum::shutdown(void) {
     if (!doShutdown) return;
     working = false;
-    cv.notify_all();
+    timer.stop();
     worker.join();
     if (process.rank == 0) {
         // record end time
         auto end = std::chrono::steady_clock::now();
         std::chrono::duration<double> diff = end - start;
         std::cout << "\nDuration of execution: " << diff.count() << " s\n";
+        char overhead[128];
+        snprintf(overhead, sizeof(overhead),
+            "ZeroSum overhead: %.3f%% of one core\n", collectors.usage());
+        std::cout << overhead;
         std::cout << process.getSummary() << std::endl;
+        std::cout << process.schedSummary();
         if (otherProcesses.size() > 0) {
             std::cout << "Other processes:\n";
             for (auto p : otherProcesses) {
@@ -362,37 +506,169 @@ void ZeroSum::shutdown(void) {
         }
     }
     finalizeLog();
+    // the async thread is done with them
+    plugins.clear();
     PERFSTUBS_FINALIZE();
 }
 
 void ZeroSum::finalizeLog() {
+    if (finalized.exchange(true)) { return; }
+    // the last rows, and whatever is still queued, go out before the summaries
+    startOutput();
+    auto snapshot = takeSnapshot();
+    snapshot->log = periodLog.str();
+    periodLog.str("");
+    pipeline->publish(std::move(snapshot));
+    pipeline->stop();
+    if (getVerbose()) {
+        std::cerr << "ZeroSum: " << pipeline->summary().substr(1);
+        if (!traceName.empty()) {
+            std::cerr << "ZeroSum: wrote " << traceName << std::endl;
+        }
+        if (nodeShare != nullptr) {
+            std::cerr << "ZeroSum: " << nodeShare->summary().substr(1);
+        }
+    }
     if (logfile.is_open()) {
         logfile << process.logThreads(true) << std::flush;
         logfile << computeNode.toString(process.hwthreads) << std::flush;
         logfile << process.toString() << std::flush;
+        logfile << sweepSummary() << std::flush;
+        logfile << process.schedSummary() << std::flush;
+        logfile << contentionSummary() << std::flush;
+#ifdef ZEROSUM_USE_POSIX_IO
+        logfile << ioSummary() << std::flush;
+#endif
+#ifdef ZEROSUM_USE_ALLOCATIONS
+        logfile << allocationSummary() << std::flush;
+#endif
+        if (nodeShare != nullptr) {
+            logfile << nodeShare->summary() << std::flush;
+        }
+        logfile << timerSummary() << std::flush;
+        logfile << collectors.summary(getPeriod()) << std::flush;
+        logfile << pipeline->summary() << std::flush;
+        if (stackSampler != nullptr) {
+            logfile << stackSampler->summary() << std::flush;
+        }
+        if (perfCounters != nullptr) {
+            logfile << perfCounters->summary() << std::flush;
+        }
         logfile.close();
     }
+    writeStacks();
+    if (perfCounters != nullptr) {
+        perfCounters->stop();
+        if (getVerbose()) {
+            std::cerr << "ZeroSum: " << perfCounters->summary().substr(1);
+        }
+    }
+}
+
+/* The data files are appended to every period, so only one period of rows
+ * is ever formatted in memory, and the files are complete up to the last
+ * period if the application crashes. The CSV is written by default with
+ * HWLOC support, which the post-processing scripts need anyway. The binary
+ * file is several times smaller, zs-convert expands it to the CSV.
+ * All of the output is written by the writer thread, ZS_OUTPUT_QUEUE
+ * periods can be waiting for it before ZS_OUTPUT_POLICY applies. */
+void ZeroSum::startOutput(void) {
+    if (pipeline != nullptr) { return; }
 #ifdef USE_HWLOC
-    // open a log file
-    std::string filename{"zs.data."};
-    // prefix the rank with as many zeros as needed to sort correctly.
-    filename += getUniqueFilename() + ".csv";
-    std::ofstream out(filename);
-    out << computeNode.toCSV(process.hwthreads, process.rank, process.shmrank);
-    out << process.toCSV();
-    out.close();
+    static bool csv{parseBool("ZS_CSV", true)};
+#else
+    static bool csv{parseBool("ZS_CSV", false)};
 #endif
+    static bool binary{parseBool("ZS_BINARY", false)};
+    static bool trace{parseBool("ZS_TRACE", false)};
+    // prefix the rank with as many zeros as needed to sort correctly.
+    auto filename = [](const char * suffix) {
+        return "zs.data." + getUniqueFilename() + suffix;
+    };
+    pipeline = std::make_shared<output::Pipeline>(
+        (size_t)std::max(parseInt("ZS_OUTPUT_QUEUE", 4), 1),
+        output::Pipeline::parsePolicy(parseString("ZS_OUTPUT_POLICY", "coalesce")));
+    if (logfile.is_open()) {
+        pipeline->add(std::make_unique<output::LogSink>(logfile));
+    }
+    if (process.rank == 0 && getHeartBeat()) {
+        pipeline->add(std::make_unique<output::ConsoleSink>());
+    }
+    if (csv) {
+        pipeline->add(std::make_unique<output::CsvWriter>(filename(".csv"),
+            computeNode.name, process.rank, process.shmrank));
+    }
+    if (binary) {
+        pipeline->add(std::make_unique<output::ZsbWriter>(filename(".zsb"),
+            computeNode.name, process.rank, process.shmrank));
+    }
+    if (trace) {
+        // the steps are timed from the start, the trace from the epoch
+        auto origin = std::chrono::system_clock::now() -
+            (std::chrono::steady_clock::now() - start);
+        traceName = "zs.trace." + getUniqueFilename() + ".json";
+        pipeline->add(std::make_unique<output::TraceWriter>(traceName,
+            computeNode.name, process.rank, process.shmrank, process.id,
+            (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                origin.time_since_epoch()).count(), getPeriod()));
+    }
 #ifdef ZEROSUM_USE_ZEROMQ
-    std::string data{computeNode.toCSV(process.hwthreads,
-        process.rank, process.shmrank, lastStepWritten)};
-    data += process.toCSV(lastStepWritten);
-    static bool aggregating{parseBool("ZS_WRITE_TO_AGGREGATOR", false)};
-    if (aggregating) {
-        int rc = writeToLocalAggregator(data);
+    if (parseBool("ZS_WRITE_TO_AGGREGATOR", false)) {
+        pipeline->add(aggregatorSink());
     }
 #endif
+    pipeline->start();
+}
+
+/* The rows that are new since the last snapshot, copied out of the series */
+std::unique_ptr<output::Snapshot> ZeroSum::takeSnapshot(void) {
+    auto snapshot = std::make_unique<output::Snapshot>(step);
+    if (!pipeline->records()) {
+        periodEvents.clear();
+        return snapshot;
+    }
+    if (recordSource == nullptr) {
+        recordSource = std::make_shared<output::RecordSource>();
+    }
+    // OMPT callbacks can add threads while we extract them
+    std::unique_lock<std::mutex> lk(software::Process::thread_mtx);
+    recordSource->extract(computeNode, process, process.hwthreads,
+        collectors, *snapshot);
+    output::Record r{};
+    r.resource = "Event";
+    r.type = "Instant";
+    r.kind = series::Kind::State;
+    for (auto& e : periodEvents) {
+        r.index = e.lwp;
+        r.step = e.step;
+        r.metric = e.name;
+        r.text = &(e.detail);
+        (*snapshot)(r);
+    }
+    periodEvents.clear();
+    return snapshot;
+}
+
+/* Something that happened, like a deadlock or the stop file, which is
+ * written with the next snapshot */
+void ZeroSum::recordEvent(const char * name, const std::string& detail, uint32_t lwp) {
+    periodEvents.push_back(event_t{step, series::Metrics::intern(name), lwp, detail});
+}
+
+/* The folded stacks, once the sampling has stopped */
+void ZeroSum::writeStacks(void) {
+    if (stackSampler == nullptr) { return; }
+    stackSampler->stop();
+    std::string filename{"zs.stacks." + getUniqueFilename() + ".folded"};
+    bool written = stackSampler->write(filename);
+    if (getVerbose()) {
+        std::cerr << "ZeroSum: " << stackSampler->summary().substr(1);
+        if (written) { std::cerr << "ZeroSum: wrote " << filename << std::endl; }
+    }
+    stackSampler.reset();
 }
 
+
 std::pair<std::string,std::string> split (const std::string &s) {
     char delim{'='};
     std::vector<std::string> result;
@@ -446,12 +722,32 @@ void ZeroSum::parseEnv(char** envp) {
 
 void ZeroSum::recordSentBytes(int rank, size_t bytes) {
     process.recordSentBytes(rank, bytes);
+    mpiSentBytes.fetch_add(bytes, std::memory_order_relaxed);
+    mpiSends.fetch_add(1, std::memory_order_relaxed);
 }
 
 void ZeroSum::recordRecvBytes(int rank, size_t bytes) {
     process.recordRecvBytes(rank, bytes);
+    mpiRecvBytes.fetch_add(bytes, std::memory_order_relaxed);
+    mpiRecvs.fetch_add(1, std::memory_order_relaxed);
 }
 
+#ifdef ZEROSUM_USE_MPI
+/* The point to point totals, the per-rank maps are only read at the end */
+void ZeroSum::sampleMPI(void) {
+    static const series::metric_id sentBytes{series::Metrics::intern("sent bytes")};
+    static const series::metric_id sends{series::Metrics::intern("sent messages")};
+    static const series::metric_id recvBytes{series::Metrics::intern("recv bytes")};
+    static const series::metric_id recvs{series::Metrics::intern("recv messages")};
+    process.mpiData.begin(step);
+    process.mpiData.set(sentBytes, mpiSentBytes.load(std::memory_order_relaxed));
+    process.mpiData.set(sends, mpiSends.load(std::memory_order_relaxed));
+    process.mpiData.set(recvBytes, mpiRecvBytes.load(std::memory_order_relaxed));
+    process.mpiData.set(recvs, mpiRecvs.load(std::memory_order_relaxed));
+    process.mpiData.end();
+}
+#endif
+
 } // namespace zerosum
 
 #ifdef ZEROSUM_STANDALONE
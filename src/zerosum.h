@@ -24,17 +24,36 @@
 
 #pragma once
 #include <set>
+#include <map>
+#include <unordered_map>
+#include <array>
 #include <thread>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <atomic>
-#include <condition_variable>
+#include <memory>
 #include "topology.h"
-#include "lm_sensor_data.h"
-#include "cray_pm_counters.h"
+#include "plugins.h"
+#include "node_share.h"
+#include "periodic_timer.h"
+#include "collector_scheduler.h"
+#include "registration_queue.h"
+#include "stack_sampler.h"
+#include "perf_counters.h"
+#ifdef ZEROSUM_USE_IO_URING
+#include "uring_reader.h"
+#endif
 
 namespace zerosum {
 
+namespace output {
+class RecordSource;
+class Pipeline;
+class Sink;
+struct Snapshot;
+}
+
 class ZeroSum {
 public:
     static ZeroSum& getInstance() {
@@ -58,6 +77,9 @@ public:
     hardware::ComputeNode getComputeNode(void) { return computeNode; }
     std::ofstream& getLogfile(void) { return logfile; }
     void setMPIFinalize(void) { mpiFinalize = true; }
+    /* Can be called from any thread, it only queues the thread for the
+     * next sweep */
+    void registerThread(uint32_t tid, software::ThreadType type);
 
 private:
     /* Standard singleton definition follows */
@@ -80,21 +102,80 @@ private:
     std::thread worker; // the asynchronous thread
     bool working;
     std::ofstream logfile;
+    // what the async thread logs during a period, the writer thread
+    // appends it to the log file with the period's snapshot
+    std::ostringstream periodLog;
+    // what happened since the last snapshot, for the trace and data files
+    struct event_t {
+        uint32_t step;
+        series::metric_id name;
+        uint32_t lwp; // 0 for the process
+        std::string detail;
+    };
+    std::vector<event_t> periodEvents;
+    // zs.trace.<rank>.json, when one is written
+    std::string traceName;
     software::Process process;
     std::vector<software::Process> otherProcesses;
     hardware::ComputeNode computeNode;
+    // reused every period, so parsing /proc/stat doesn't allocate
+    std::vector<cpu_stat_t> cpuStats;
+    node_sample_t nodeSample;
+    // null unless the node samples are shared with the other local ranks
+    std::unique_ptr<NodeShare> nodeShare;
+    ProcFile procStat{"/proc/stat"};
+    MemoryFiles memoryFiles;
+    // the IDs of the memoryFiles names
+    std::vector<series::metric_id> memoryIds;
+    std::vector<series::metric_id> numaIds;
+    // /proc/self/smaps_rollup, io and status, see sampleProcess
+    std::vector<CounterFile> processFiles;
+    std::vector<series::metric_id> processIds;
+    std::vector<uint64_t> processValues;
+    numa_maps_t numaMaps;
+    // by NUMA node ID, whether any of our cpus are on it
+    std::vector<bool> localNodes;
+    TaskFileCache taskFiles;
+    std::vector<task_sample_t> taskSamples;
+#ifdef ZEROSUM_USE_IO_URING
+    std::unique_ptr<BatchedTaskReader> taskReader;
+#endif
+    // threads that registered themselves, and their types until the sweep
+    RegistrationQueue registrations;
+    std::unordered_map<uint32_t, uint32_t> registeredTypes;
+    uint64_t registered{0};
+    uint64_t maxQueuedUs{0};
+    // how long each sweep over /proc/self/task took
+    series::TimeSeries sweepData;
+    // thread count -> (sweeps, total us, max us), for the whole run
+    std::map<uint64_t, std::array<uint64_t,3>> sweepStats;
     uint32_t async_tid;
     std::atomic<uint32_t> step;
-    std::condition_variable cv;
-    std::mutex cv_m;
+    // wakes the async thread every period, and when shutting down
+    PeriodicTimer timer{getPeriod()};
+    // runs the collectors that are due at each tick of the timer
+    CollectorScheduler collectors;
+    size_t nodeCollector{0};
+    size_t gpuCollector{0};
     std::chrono::time_point<std::chrono::steady_clock> start;
     bool doShutdown;
+    // the async thread can finalize early (stop file, deadlock...), and
+    // then shutdown() must not write the last rows and summaries again
+    std::atomic<bool> finalized{false};
     bool doDetails;
     bool mpiFinalize;
-#ifdef ZEROSUM_USE_LM_SENSORS
-    sensor_data sensors;
-#endif // ZEROSUM_USE_LM_SENSORS
-    cray_pm_counters cray_counters;
+    // updated by the application threads, sampled by the MPI collector
+    std::atomic<uint64_t> mpiSentBytes{0};
+    std::atomic<uint64_t> mpiSends{0};
+    std::atomic<uint64_t> mpiRecvBytes{0};
+    std::atomic<uint64_t> mpiRecvs{0};
+    // the node plugins are sampled with the node, the others on their own
+    std::vector<std::unique_ptr<Plugin>> plugins;
+    // null unless ZS_STACK_HZ is set, samples stacks during the thread sweep
+    std::unique_ptr<StackSampler> stackSampler;
+    // null unless ZS_PERF_COUNTERS is set, read during the thread sweep
+    std::unique_ptr<PerfCounters> perfCounters;
+    std::vector<plugin_value_t> pluginValues;
 
     // Other private member variables and functions...
     void getMPIinfo(void);
@@ -103,13 +184,44 @@ private:
     int getgpustatus(void);
 #ifdef ZEROSUM_USE_ZEROMQ
     int writeToLocalAggregator(const std::string& data);
-    size_t lastStepWritten;
+    std::unique_ptr<output::Sink> aggregatorSink(void);
 #endif
 #ifdef ZEROSUM_USE_OPENMP
     void getopenmp(void);
 #endif
+#ifdef ZEROSUM_USE_ALLOCATIONS
+    void getAllocations(uint32_t lwp, software::LWPSample& sample);
+    std::string allocationSummary(void);
+#endif
+#ifdef ZEROSUM_USE_POSIX_IO
+    void getPosixIO(uint32_t lwp, software::LWPSample& sample);
+    std::string ioSummary(void);
+#endif
+    void getPerfCounters(uint32_t lwp, software::LWPSample& sample);
+    void startOutput(void);
+    std::unique_ptr<output::Snapshot> takeSnapshot(void);
+    void recordEvent(const char * name, const std::string& detail, uint32_t lwp = 0);
+    void writeStacks(void);
+    // shared_ptr, because the output classes are only declared here
+    std::shared_ptr<output::Pipeline> pipeline;
+    std::shared_ptr<output::RecordSource> recordSource;
     int getpthreads(void);
+    void readTasks(void);
+    std::string sweepSummary(void);
+    std::string contentionSummary(void);
+    std::string timerSummary(void);
     void getProcStatus(void);
+    void sampleProcStat(void);
+    void sampleNodeInfo(void);
+    void updateMemory(const node_sample_t& sample);
+    void sampleProcess(void);
+    void sampleNumaMaps(void);
+    void sampleNode(void);
+#ifdef ZEROSUM_USE_MPI
+    void sampleMPI(void);
+#endif
+    void shareNode(int shmrank);
+    void scheduleCollectors(void);
     void threadedFunction(void);
     bool doOnce(void);
     void doPeriodic(void);
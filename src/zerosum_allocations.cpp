@@ -0,0 +1,426 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* The heap allocation wrappers. With ZS_ALLOCATIONS, every thread counts
+ * the bytes it allocates and frees with malloc and friends, and maps and
+ * unmaps with mmap. Frees are credited to the thread that frees, so the
+ * live bytes of a thread are what it allocated less what it freed.
+ * Without ZS_ALLOCATIONS, the wrappers only check one flag and call the
+ * system functions. */
+
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "zerosum.h"
+#include "utils.h"
+#include "global_constructor_destructor.h"
+#include "system_functions.h"
+#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <algorithm>
+
+typedef void* (*malloc_p)(size_t size);
+typedef void* (*calloc_p)(size_t nmemb, size_t size);
+typedef void* (*realloc_p)(void *ptr, size_t size);
+typedef void (*free_p)(void *ptr);
+typedef int (*posix_memalign_p)(void **memptr, size_t alignment, size_t size);
+typedef void* (*aligned_alloc_p)(size_t alignment, size_t size);
+typedef size_t (*malloc_usable_size_p)(void *ptr);
+typedef void* (*mmap_p)(void *addr, size_t length, int prot, int flags,
+    int fd, off_t offset);
+typedef void* (*mmap64_p)(void *addr, size_t length, int prot, int flags,
+    int fd, off64_t offset);
+typedef int (*munmap_p)(void *addr, size_t length);
+
+typedef struct alloc_functions {
+    calloc_p calloc;
+    realloc_p realloc;
+    free_p free;
+    posix_memalign_p posix_memalign;
+    aligned_alloc_p aligned_alloc;
+    malloc_usable_size_p usable_size;
+    mmap_p mmap;
+    mmap64_p mmap64;
+    munmap_p munmap;
+    // set last, it marks the functions as resolved
+    std::atomic<malloc_p> malloc;
+} alloc_functions_t;
+
+/* Not a function-local static like the other wrappers: dlsym() can call
+ * calloc() while the functions are being resolved, and that would re-enter
+ * the static's initialization. */
+static alloc_functions_t sysAlloc;
+static std::atomic<bool> resolving{false};
+
+/* What dlsym() allocates while we resolve the functions. It is never freed
+ * and never reused, so it is all zeros, which calloc() needs. */
+#ifndef ZS_BOOTSTRAP_BYTES
+#define ZS_BOOTSTRAP_BYTES (64*1024)
+#endif
+alignas(64) static char bootstrap[ZS_BOOTSTRAP_BYTES];
+static std::atomic<size_t> bootstrapUsed{0};
+
+/* A nullptr from here would fail in dlsym() or the dynamic loader, far
+ * from the cause, so stop with a message instead. Nothing can be
+ * allocated, so it is written directly. */
+[[noreturn]] static void bootstrapExhausted(void) {
+    static const char message[] = "ZeroSum: the allocation bootstrap buffer "
+        "was exhausted while resolving malloc, rebuild with a larger "
+        "ZS_BOOTSTRAP_BYTES\n";
+    ssize_t rc = write(STDERR_FILENO, message, sizeof(message) - 1);
+    (void)rc;
+    abort();
+}
+
+static void* bootstrapAlloc(size_t size, size_t alignment) {
+    alignment = std::max(alignment, alignof(max_align_t));
+    size_t used = bootstrapUsed.load();
+    size_t begin;
+    do {
+        begin = (used + alignment - 1) & ~(alignment - 1);
+        if (begin + size > ZS_BOOTSTRAP_BYTES) { bootstrapExhausted(); }
+    } while (!bootstrapUsed.compare_exchange_weak(used, begin + size));
+    return bootstrap + begin;
+}
+
+static inline bool isBootstrap(const void* ptr) {
+    return ptr >= (const void*)bootstrap &&
+        ptr < (const void*)(bootstrap + ZS_BOOTSTRAP_BYTES);
+}
+
+static void resolveAllocFunctions(void) {
+    // only one thread resolves, the others (and dlsym) use the bootstrap buffer
+    if (resolving.exchange(true)) { return; }
+    sysAlloc.calloc = (calloc_p)get_system_function_handle("calloc", (void*)calloc);
+    sysAlloc.realloc = (realloc_p)get_system_function_handle("realloc", (void*)realloc);
+    sysAlloc.free = (free_p)get_system_function_handle("free", (void*)free);
+    sysAlloc.posix_memalign = (posix_memalign_p)get_system_function_handle(
+        "posix_memalign", (void*)posix_memalign);
+    sysAlloc.aligned_alloc = (aligned_alloc_p)get_system_function_handle(
+        "aligned_alloc", (void*)aligned_alloc);
+    // not wrapped, so the next one is the only one
+    sysAlloc.usable_size = (malloc_usable_size_p)get_system_function_handle(
+        "malloc_usable_size", nullptr);
+    sysAlloc.mmap = (mmap_p)get_system_function_handle("mmap", (void*)mmap);
+    sysAlloc.mmap64 = (mmap64_p)get_system_function_handle("mmap64", (void*)mmap64);
+    sysAlloc.munmap = (munmap_p)get_system_function_handle("munmap", (void*)munmap);
+    sysAlloc.malloc.store((malloc_p)get_system_function_handle("malloc", (void*)malloc));
+}
+
+static inline bool resolved(void) {
+    if (sysAlloc.malloc.load(std::memory_order_acquire) != nullptr) { return true; }
+    resolveAllocFunctions();
+    return sysAlloc.malloc.load(std::memory_order_acquire) != nullptr;
+}
+
+/* Set by the constructor, so nothing is recorded before it runs. Without
+ * it, the wrappers skip the re-entry guard and go straight to the system
+ * functions. */
+static bool tracking{false};
+
+DEFINE_CONSTRUCTOR(zerosum_resolve_alloc_functions)
+static void zerosum_resolve_alloc_functions(void) {
+    resolved();
+    tracking = zerosum::parseBool("ZS_ALLOCATIONS", false);
+}
+
+/* Requested sizes in log2(bytes) buckets */
+#define ZS_ALLOC_BUCKETS 48
+
+/* Only the owning thread writes its counters, so they are updated with
+ * plain loads and stores, without a locked instruction. The async thread
+ * only reads them. */
+typedef struct alloc_counters {
+    std::atomic<size_t> allocs;
+    std::atomic<size_t> frees;
+    std::atomic<uint64_t> alloc_bytes;
+    std::atomic<uint64_t> free_bytes;
+    std::atomic<uint64_t> mmap_bytes;
+    std::atomic<uint64_t> munmap_bytes;
+    std::array<std::atomic<size_t>, ZS_ALLOC_BUCKETS> histogram;
+} alloc_counters_t;
+
+template<typename T> static inline void bump(std::atomic<T>& counter, T value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+        std::memory_order_relaxed);
+}
+
+std::mutex& allocMapMutex() {
+    static std::mutex mtx;
+    return mtx;
+}
+
+std::unordered_map<uint32_t,alloc_counters_t*>& getAllocCounterMap() {
+    static std::unordered_map<uint32_t,alloc_counters_t*> _theMap;
+    return _theMap;
+}
+
+/* Only locked once per thread, the first time it allocates */
+alloc_counters_t* getAllocCounters(uint32_t tid, bool create) {
+    std::lock_guard l{allocMapMutex()};
+    auto tmp = getAllocCounterMap().find(tid);
+    if (tmp != getAllocCounterMap().end()) { return tmp->second; }
+    if (!create) { return nullptr; }
+    // value-initialized, so the atomics start at zero
+    auto counters = new alloc_counters_t();
+    getAllocCounterMap()[tid] = counters;
+    return counters;
+}
+
+/* A plain pointer, so the thread local needs no initialization guard */
+static thread_local alloc_counters_t* myAllocCounters{nullptr};
+
+static inline alloc_counters_t* getMyAllocCounters() {
+    if (myAllocCounters == nullptr) {
+        myAllocCounters = getAllocCounters(gettid(), true);
+    }
+    return myAllocCounters;
+}
+
+static void recordAlloc(size_t size, void* ptr) {
+    if (ptr == nullptr) { return; }
+    auto c = getMyAllocCounters();
+    bump(c->allocs, (size_t)1);
+    bump(c->alloc_bytes, (uint64_t)sysAlloc.usable_size(ptr));
+    size_t bucket = (size_t)(63 - __builtin_clzll(size | 1));
+    bump(c->histogram[std::min(bucket, (size_t)(ZS_ALLOC_BUCKETS-1))], (size_t)1);
+}
+
+static void recordFree(size_t usable) {
+    auto c = getMyAllocCounters();
+    bump(c->frees, (size_t)1);
+    bump(c->free_bytes, (uint64_t)usable);
+}
+
+namespace zerosum {
+
+/* The cumulative counters of one thread, if it has allocated anything.
+ * The histogram is sampled in four coarse size classes. */
+void ZeroSum::getAllocations(uint32_t lwp, software::LWPSample& sample) {
+    static const series::metric_id allocs{series::Metrics::intern("malloc calls")};
+    static const series::metric_id frees{series::Metrics::intern("free calls")};
+    static const series::metric_id allocBytes{series::Metrics::intern("malloc bytes")};
+    static const series::metric_id freeBytes{series::Metrics::intern("free bytes")};
+    static const series::metric_id liveBytes{series::Metrics::intern("live bytes")};
+    static const series::metric_id mmapBytes{series::Metrics::intern("mmap bytes")};
+    static const series::metric_id munmapBytes{series::Metrics::intern("munmap bytes")};
+    // the first bucket past each class
+    static const std::array<std::pair<size_t, series::metric_id>, 4> classes{
+        std::pair((size_t)8, series::Metrics::intern("malloc <256B")),
+        std::pair((size_t)16, series::Metrics::intern("malloc <64KB")),
+        std::pair((size_t)22, series::Metrics::intern("malloc <4MB")),
+        std::pair((size_t)ZS_ALLOC_BUCKETS, series::Metrics::intern("malloc >=4MB"))};
+    if (!tracking) { return; }
+    auto c = getAllocCounters(lwp, false);
+    if (c == nullptr) { return; }
+    uint64_t allocated = c->alloc_bytes.load();
+    uint64_t freed = c->free_bytes.load();
+    sample.counters.emplace_back(allocs, c->allocs.load());
+    sample.counters.emplace_back(frees, c->frees.load());
+    sample.counters.emplace_back(allocBytes, allocated);
+    sample.counters.emplace_back(freeBytes, freed);
+    // a thread can free more than it allocated, if other threads allocated it
+    // a gauge, so the log shows it shrink when the thread frees
+    sample.gauges.emplace_back(liveBytes, (double)(allocated > freed ? allocated - freed : 0));
+    sample.counters.emplace_back(mmapBytes, c->mmap_bytes.load());
+    sample.counters.emplace_back(munmapBytes, c->munmap_bytes.load());
+    size_t b = 0;
+    for (auto& sc : classes) {
+        size_t count = 0;
+        for ( ; b < sc.first ; b++) { count += c->histogram[b].load(); }
+        sample.counters.emplace_back(sc.second, count);
+    }
+}
+
+/* The requested size histogram of every thread that allocated */
+std::string ZeroSum::allocationSummary(void) {
+    if (!tracking) { return ""; }
+    std::string tmpstr{"\nHeap allocations (requested size, log2 bytes buckets):\n"};
+    char buffer[256];
+    std::lock_guard l{allocMapMutex()};
+    for (auto& t : getAllocCounterMap()) {
+        auto c = t.second;
+        snprintf(buffer, sizeof(buffer),
+            "LWP %u: %lu allocations, %.3f MB, %lu frees, %.3f MB, mmap %.3f MB, munmap %.3f MB\n",
+            t.first, c->allocs.load(), c->alloc_bytes.load() * 1.0e-6,
+            c->frees.load(), c->free_bytes.load() * 1.0e-6,
+            c->mmap_bytes.load() * 1.0e-6, c->munmap_bytes.load() * 1.0e-6);
+        tmpstr += buffer;
+        for (size_t b = 0 ; b < ZS_ALLOC_BUCKETS ; b++) {
+            uint64_t count = c->histogram[b].load();
+            if (count == 0) { continue; }
+            snprintf(buffer, sizeof(buffer), "    >= 2^%-2lu B: %lu\n", b, count);
+            tmpstr += buffer;
+        }
+    }
+    return tmpstr;
+}
+
+} // namespace zerosum
+
+/* Without ZS_ALLOCATIONS, each wrapper calls the system function after
+ * one check of the tracking flag. With it, the call is only recorded if
+ * it isn't nested inside ZeroSum or another wrapper. Until the system
+ * functions are resolved, allocations come from the bootstrap buffer. */
+
+extern "C" {
+
+void* malloc(size_t size) __THROW {
+    if (!resolved()) { return bootstrapAlloc(size, 0); }
+    if (!tracking) { return sysAlloc.malloc.load(std::memory_order_relaxed)(size); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    void* ptr = sysAlloc.malloc.load(std::memory_order_relaxed)(size);
+    if (tracking && prevent_deadlocks.get() == 1) { recordAlloc(size, ptr); }
+    return ptr;
+}
+
+void* calloc(size_t nmemb, size_t size) __THROW {
+    if (!resolved()) {
+        size_t bytes;
+        if (__builtin_mul_overflow(nmemb, size, &bytes)) { return nullptr; }
+        return bootstrapAlloc(bytes, 0);
+    }
+    if (!tracking) { return sysAlloc.calloc(nmemb, size); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    void* ptr = sysAlloc.calloc(nmemb, size);
+    if (tracking && prevent_deadlocks.get() == 1) { recordAlloc(nmemb * size, ptr); }
+    return ptr;
+}
+
+void* realloc(void *ptr, size_t size) __THROW {
+    if (isBootstrap(ptr)) {
+        /* The old size isn't known, so copy up to the end of the buffer.
+         * That can read past the old block, but never past the buffer. */
+        void* tmp = resolved() ? malloc(size) : bootstrapAlloc(size, 0);
+        if (tmp != nullptr) {
+            memcpy(tmp, ptr, std::min(size,
+                (size_t)(bootstrap + ZS_BOOTSTRAP_BYTES - (char*)ptr)));
+        }
+        return tmp;
+    }
+    if (!resolved()) {
+        // nothing but the bootstrap buffer could have allocated ptr yet
+        return ptr == nullptr ? bootstrapAlloc(size, 0) : nullptr;
+    }
+    if (!tracking) { return sysAlloc.realloc(ptr, size); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    bool record{tracking && prevent_deadlocks.get() == 1};
+    size_t old = (record && ptr != nullptr) ? sysAlloc.usable_size(ptr) : 0;
+    void* tmp = sysAlloc.realloc(ptr, size);
+    if (record) {
+        // realloc(ptr, 0) may free ptr and return nothing
+        if (ptr != nullptr && (tmp != nullptr || size == 0)) { recordFree(old); }
+        recordAlloc(size, tmp);
+    }
+    return tmp;
+}
+
+void free(void *ptr) __THROW {
+    if (ptr == nullptr || isBootstrap(ptr)) { return; }
+    if (!resolved()) { return; }
+    if (!tracking) {
+        sysAlloc.free(ptr);
+        return;
+    }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (tracking && prevent_deadlocks.get() == 1) {
+        recordFree(sysAlloc.usable_size(ptr));
+    }
+    sysAlloc.free(ptr);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) __THROW {
+    if (!resolved()) {
+        *memptr = bootstrapAlloc(size, alignment);
+        return 0;
+    }
+    if (!tracking) { return sysAlloc.posix_memalign(memptr, alignment, size); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    int rc = sysAlloc.posix_memalign(memptr, alignment, size);
+    if (rc == 0 && tracking && prevent_deadlocks.get() == 1) {
+        recordAlloc(size, *memptr);
+    }
+    return rc;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) __THROW {
+    if (!resolved()) { return bootstrapAlloc(size, alignment); }
+    if (!tracking) { return sysAlloc.aligned_alloc(alignment, size); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    void* ptr = sysAlloc.aligned_alloc(alignment, size);
+    if (tracking && prevent_deadlocks.get() == 1) { recordAlloc(size, ptr); }
+    return ptr;
+}
+
+void* mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) __THROW {
+    if (!resolved()) {
+        return (void*)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+    }
+    if (!tracking) { return sysAlloc.mmap(addr, length, prot, flags, fd, offset); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    void* ptr = sysAlloc.mmap(addr, length, prot, flags, fd, offset);
+    if (ptr != MAP_FAILED && tracking && prevent_deadlocks.get() == 1) {
+        bump(getMyAllocCounters()->mmap_bytes, (uint64_t)length);
+    }
+    return ptr;
+}
+
+void* mmap64(void *addr, size_t length, int prot, int flags, int fd, off64_t offset) __THROW {
+    if (!resolved()) {
+        return (void*)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+    }
+    if (!tracking) { return sysAlloc.mmap64(addr, length, prot, flags, fd, offset); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    void* ptr = sysAlloc.mmap64(addr, length, prot, flags, fd, offset);
+    if (ptr != MAP_FAILED && tracking && prevent_deadlocks.get() == 1) {
+        bump(getMyAllocCounters()->mmap_bytes, (uint64_t)length);
+    }
+    return ptr;
+}
+
+int munmap(void *addr, size_t length) __THROW {
+    if (!resolved()) { return (int)syscall(SYS_munmap, addr, length); }
+    if (!tracking) { return sysAlloc.munmap(addr, length); }
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    int rc = sysAlloc.munmap(addr, length);
+    if (rc == 0 && tracking && prevent_deadlocks.get() == 1) {
+        bump(getMyAllocCounters()->munmap_bytes, (uint64_t)length);
+    }
+    return rc;
+}
+
+} // extern "C"
@@ -60,20 +60,8 @@ void ZeroSum::getopenmp(void) {
         {
 #pragma omp ordered
             {
-                int nhwthr = 0;
-                std::string tmpstr;
-                auto lwp = gettid();
-                std::vector<uint32_t> allowed_list =
-                    getAffinityList(lwp, computeNode.ncpus, nhwthr, tmpstr);
-                // also want to read /proc/<pid>/task/<tid>/status!
-                std::string filename = "/proc/self/task/";
-                filename += std::to_string(lwp);
-                filename += "/stat";
-                auto fields = getThreadStat(filename.c_str());
-                filename += "us";
-                getThreadStatus(filename.c_str(), fields);
-                //fields.insert(std::pair("step",std::to_string(step)));
-                this->process.add(lwp, allowed_list, fields, software::ThreadType::OpenMP);
+                // the next sweep reads /proc for it
+                registerThread(gettid(), software::ThreadType::OpenMP);
             }
         }
     }
@@ -112,20 +100,10 @@ void zerosum_thread_begin(
         default:
             DEBUG_PRINT("New OpenMP Unknown Thread %lu\n", index++);
     }
-    int nhwthr = 0;
-    std::string tmpstr;
-    auto lwp = gettid();
-    std::vector<uint32_t> allowed_list =
-        zerosum::getAffinityList(lwp, zerosum::ZeroSum::getInstance().getComputeNode().ncpus, nhwthr, tmpstr);
-    // also want to read /proc/<pid>/task/<tid>/status!
-    std::string filename = "/proc/self/task/";
-    filename += std::to_string(lwp);
-    filename += "/stat";
-    auto fields = zerosum::getThreadStat(filename.c_str());
-    filename += "us";
-    zerosum::getThreadStatus(filename.c_str(), fields);
-    //fields.insert(std::pair("step",std::to_string(step)));
-    zerosum::ZeroSum::getInstance().getProcess().add(lwp, allowed_list, fields, zerosum::software::ThreadType::OpenMP);
+    /* No /proc reads or locks on the OpenMP thread, the async thread
+     * samples it at the next sweep */
+    zerosum::ZeroSum::getInstance().registerThread(gettid(),
+        zerosum::software::ThreadType::OpenMP);
 }
 
 // This function is for checking that the function registration worked.
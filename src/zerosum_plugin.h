@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+/* The collector plugin interface. A plugin is a shared library, listed in
+ * ZS_PLUGINS, that exports zerosum_plugin(), returning a description of
+ * the collector. Only C types cross the interface, so plugins can be
+ * built with any compiler, without the ZeroSum sources.
+ *
+ * All the functions are called from the ZeroSum async thread:
+ * init() once, describe() once after a successful init(), sample() every
+ * period of the plugin, and finalize() once at the end. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZEROSUM_PLUGIN_ABI_VERSION 1
+#define ZEROSUM_PLUGIN_ENTRY "zerosum_plugin"
+
+typedef enum zs_plugin_kind {
+    ZS_PLUGIN_UNSIGNED = 0,
+    ZS_PLUGIN_DOUBLE = 1
+} zs_plugin_kind_t;
+
+typedef enum zs_plugin_scope {
+    /* sampled by every process on its own schedule, ZS_PERIOD_<NAME> */
+    ZS_PLUGIN_PROCESS = 0,
+    /* the same for every process on the node, so it is sampled with the
+     * node, and local rank 0 shares the values with the other ranks */
+    ZS_PLUGIN_NODE = 1
+} zs_plugin_scope_t;
+
+typedef struct zs_plugin_metric {
+    const char * name;
+    zs_plugin_kind_t kind;
+} zs_plugin_metric_t;
+
+typedef union zs_plugin_value {
+    uint64_t u;
+    double d;
+} zs_plugin_value_t;
+
+typedef struct zs_plugin {
+    /* ZEROSUM_PLUGIN_ABI_VERSION, when the plugin was built */
+    uint32_t abi_version;
+    /* The name of the collector, letters, digits and underscores */
+    const char * name;
+    zs_plugin_scope_t scope;
+    /* The default period in seconds, 0 for the sampling period */
+    double period;
+    /* Returns 0 if the plugin can sample on this system, and can set a
+     * context that is passed to the other functions. */
+    int (*init)(void ** context);
+    /* Points metrics at the metrics every sample has, in order, and
+     * returns how many there are. They have to stay valid until finalize. */
+    size_t (*describe)(void * context, const zs_plugin_metric_t ** metrics);
+    /* Writes the values, in the order of describe(). The buffer still has
+     * the previous sample, so a value that can't be read can be left as
+     * it is. Returns count, 0 if there is nothing new, or -1 on error. */
+    int (*sample)(void * context, zs_plugin_value_t * values, size_t count);
+    void (*finalize)(void * context);
+} zs_plugin_t;
+
+/* The function every plugin library exports */
+typedef const zs_plugin_t * (*zs_plugin_entry_t)(void);
+
+#ifdef __cplusplus
+}
+#endif
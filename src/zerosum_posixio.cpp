@@ -0,0 +1,564 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* The POSIX I/O wrappers. With ZS_POSIX_IO, every thread counts its calls,
+ * bytes and time in read/write/fsync/open/close, by the kind of file
+ * descriptor (regular file, socket, pipe, other). Without it, the wrappers
+ * only call the system functions. */
+
+// the fortified inline versions of read() and open() would clash with ours
+#undef _FORTIFY_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "zerosum.h"
+#include "utils.h"
+#include "global_constructor_destructor.h"
+#include "system_functions.h"
+#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <algorithm>
+
+typedef ssize_t (*read_p)(int fd, void *buf, size_t count);
+typedef ssize_t (*write_p)(int fd, const void *buf, size_t count);
+typedef ssize_t (*pread_p)(int fd, void *buf, size_t count, off_t offset);
+typedef ssize_t (*pwrite_p)(int fd, const void *buf, size_t count, off_t offset);
+typedef ssize_t (*pread64_p)(int fd, void *buf, size_t count, off64_t offset);
+typedef ssize_t (*pwrite64_p)(int fd, const void *buf, size_t count, off64_t offset);
+typedef ssize_t (*readv_p)(int fd, const struct iovec *iov, int iovcnt);
+typedef ssize_t (*writev_p)(int fd, const struct iovec *iov, int iovcnt);
+typedef int (*fsync_p)(int fd);
+typedef int (*open_p)(const char *pathname, int flags, ...);
+typedef int (*close_p)(int fd);
+typedef int (*socket_p)(int domain, int type, int protocol);
+typedef int (*socketpair_p)(int domain, int type, int protocol, int sv[2]);
+typedef int (*accept_p)(int fd, struct sockaddr *addr, socklen_t *addrlen);
+typedef int (*accept4_p)(int fd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+typedef int (*pipe_p)(int fds[2]);
+typedef int (*pipe2_p)(int fds[2], int flags);
+typedef int (*dup_p)(int fd);
+typedef int (*dup2_p)(int fd, int fd2);
+typedef int (*dup3_p)(int fd, int fd2, int flags);
+
+typedef struct io_functions {
+    read_p read;
+    write_p write;
+    pread_p pread;
+    pwrite_p pwrite;
+    pread64_p pread64;
+    pwrite64_p pwrite64;
+    readv_p readv;
+    writev_p writev;
+    fsync_p fsync;
+    open_p open;
+    open_p open64;
+    close_p close;
+    socket_p socket;
+    socketpair_p socketpair;
+    accept_p accept;
+    accept4_p accept4;
+    pipe_p pipe;
+    pipe2_p pipe2;
+    dup_p dup;
+    dup2_p dup2;
+    dup3_p dup3;
+} io_functions_t;
+
+static io_functions_t resolveIOFunctions(void) {
+    io_functions_t f;
+    f.read = (read_p)get_system_function_handle("read", (void*)read);
+    f.write = (write_p)get_system_function_handle("write", (void*)write);
+    f.pread = (pread_p)get_system_function_handle("pread", (void*)pread);
+    f.pwrite = (pwrite_p)get_system_function_handle("pwrite", (void*)pwrite);
+    f.pread64 = (pread64_p)get_system_function_handle("pread64", (void*)pread64);
+    f.pwrite64 = (pwrite64_p)get_system_function_handle("pwrite64", (void*)pwrite64);
+    f.readv = (readv_p)get_system_function_handle("readv", (void*)readv);
+    f.writev = (writev_p)get_system_function_handle("writev", (void*)writev);
+    f.fsync = (fsync_p)get_system_function_handle("fsync", (void*)fsync);
+    f.open = (open_p)get_system_function_handle("open", (void*)open);
+    f.open64 = (open_p)get_system_function_handle("open64", (void*)open64);
+    f.close = (close_p)get_system_function_handle("close", (void*)close);
+    f.socket = (socket_p)get_system_function_handle("socket", (void*)socket);
+    f.socketpair = (socketpair_p)get_system_function_handle("socketpair", (void*)socketpair);
+    f.accept = (accept_p)get_system_function_handle("accept", (void*)accept);
+    f.accept4 = (accept4_p)get_system_function_handle("accept4", (void*)accept4);
+    f.pipe = (pipe_p)get_system_function_handle("pipe", (void*)pipe);
+    f.pipe2 = (pipe2_p)get_system_function_handle("pipe2", (void*)pipe2);
+    f.dup = (dup_p)get_system_function_handle("dup", (void*)dup);
+    f.dup2 = (dup2_p)get_system_function_handle("dup2", (void*)dup2);
+    f.dup3 = (dup3_p)get_system_function_handle("dup3", (void*)dup3);
+    return f;
+}
+
+/* Resolved by the constructor below, like the pthread functions. */
+static io_functions_t& ioFunctions(void) {
+    static io_functions_t functions{resolveIOFunctions()};
+    return functions;
+}
+
+DEFINE_CONSTRUCTOR(zerosum_resolve_io_functions)
+static void zerosum_resolve_io_functions(void) {
+    ioFunctions();
+}
+
+static bool ioEnabled(void) {
+    static bool enabled{zerosum::parseBool("ZS_POSIX_IO", false)};
+    return enabled;
+}
+
+/* Call time in log2(ns) buckets, the last one holds everything longer */
+#define ZS_IO_BUCKETS 40
+
+enum io_class { IOFile = 0, IOSocket, IOPipe, IOOther, IOClasses };
+static const char * ioClassNames[IOClasses] = {"file", "socket", "pipe", "other"};
+
+typedef struct io_class_counters {
+    std::atomic<size_t> reads;
+    std::atomic<uint64_t> read_bytes;
+    std::atomic<size_t> writes;
+    std::atomic<uint64_t> write_bytes;
+    // open, close and fsync
+    std::atomic<size_t> others;
+    std::atomic<uint64_t> ns;
+    std::array<std::atomic<uint64_t>, ZS_IO_BUCKETS> histogram;
+} io_class_counters_t;
+
+typedef struct io_counters {
+    std::array<io_class_counters_t, IOClasses> classes;
+} io_counters_t;
+
+std::mutex& ioMapMutex() {
+    static std::mutex mtx;
+    return mtx;
+}
+
+std::unordered_map<uint32_t,io_counters_t*>& getIOCounterMap() {
+    static std::unordered_map<uint32_t,io_counters_t*> _theMap;
+    return _theMap;
+}
+
+io_counters_t* getIOCounters(uint32_t tid, bool create) {
+    // lock the map
+    std::lock_guard l{ioMapMutex()};
+    auto tmp = getIOCounterMap().find(tid);
+    if (tmp != getIOCounterMap().end()) { return tmp->second; }
+    if (!create) { return nullptr; }
+    // value-initialized, so the atomics start at zero
+    auto counters = new io_counters_t();
+    getIOCounterMap()[tid] = counters;
+    return counters;
+}
+
+io_counters_t* getMyIOCounters() {
+    static thread_local io_counters_t* counters = getIOCounters(gettid(), true);
+    return counters;
+}
+
+/* The class of each descriptor, found with fstat() the first time it is
+ * used and forgotten when it is closed. The calls that make descriptors
+ * without open() (socket, pipe, accept, dup...) set or forget it too, in
+ * case the number was closed behind our back. Zero is unknown, otherwise
+ * the class plus one. Descriptors past the end of the table are looked up
+ * every time. */
+#define ZS_IO_FD_CACHE 4096
+static std::array<std::atomic<uint8_t>, ZS_IO_FD_CACHE> fdClasses;
+
+static io_class classify(int fd) {
+    if (fd >= 0 && fd < ZS_IO_FD_CACHE) {
+        uint8_t c = fdClasses[fd].load(std::memory_order_relaxed);
+        if (c != 0) { return (io_class)(c - 1); }
+    }
+    struct stat sb;
+    io_class c{IOOther};
+    if (fd >= 0 && fstat(fd, &sb) == 0) {
+        if (S_ISREG(sb.st_mode)) { c = IOFile; }
+        else if (S_ISSOCK(sb.st_mode)) { c = IOSocket; }
+        else if (S_ISFIFO(sb.st_mode)) { c = IOPipe; }
+    }
+    if (fd >= 0 && fd < ZS_IO_FD_CACHE) {
+        fdClasses[fd].store((uint8_t)(c + 1), std::memory_order_relaxed);
+    }
+    return c;
+}
+
+static void forget(int fd) {
+    if (fd >= 0 && fd < ZS_IO_FD_CACHE) {
+        fdClasses[fd].store(0, std::memory_order_relaxed);
+    }
+}
+
+/* A new descriptor from a call that tells us what it is */
+static void remember(int fd, io_class c) {
+    if (fd >= 0 && fd < ZS_IO_FD_CACHE) {
+        fdClasses[fd].store((uint8_t)(c + 1), std::memory_order_relaxed);
+    }
+}
+
+static void recordTime(io_class_counters_t& c, uint64_t ns) {
+    c.ns += ns;
+    size_t bucket = (size_t)(63 - __builtin_clzll(ns | 1));
+    c.histogram[std::min(bucket, (size_t)(ZS_IO_BUCKETS-1))]++;
+}
+
+static void recordRead(int fd, ssize_t rc, uint64_t ns) {
+    auto& c = getMyIOCounters()->classes[classify(fd)];
+    c.reads++;
+    if (rc > 0) { c.read_bytes += (uint64_t)rc; }
+    recordTime(c, ns);
+}
+
+static void recordWrite(int fd, ssize_t rc, uint64_t ns) {
+    auto& c = getMyIOCounters()->classes[classify(fd)];
+    c.writes++;
+    if (rc > 0) { c.write_bytes += (uint64_t)rc; }
+    recordTime(c, ns);
+}
+
+static void recordOther(io_class cls, uint64_t ns) {
+    auto& c = getMyIOCounters()->classes[cls];
+    c.others++;
+    recordTime(c, ns);
+}
+
+namespace zerosum {
+
+/* The cumulative counters of one thread, for each class it has used */
+void ZeroSum::getPosixIO(uint32_t lwp, software::LWPSample& sample) {
+    static std::array<std::array<series::metric_id, 6>, IOClasses> ids = [] {
+        std::array<std::array<series::metric_id, 6>, IOClasses> tmp;
+        for (size_t i = 0 ; i < IOClasses ; i++) {
+            std::string prefix{std::string("io ") + ioClassNames[i]};
+            tmp[i][0] = series::Metrics::intern(prefix + " reads");
+            tmp[i][1] = series::Metrics::intern(prefix + " read bytes");
+            tmp[i][2] = series::Metrics::intern(prefix + " writes");
+            tmp[i][3] = series::Metrics::intern(prefix + " write bytes");
+            tmp[i][4] = series::Metrics::intern(prefix + " other calls");
+            tmp[i][5] = series::Metrics::intern(prefix + " ns");
+        }
+        return tmp;
+    }();
+    if (!ioEnabled()) { return; }
+    auto counters = getIOCounters(lwp, false);
+    if (counters == nullptr) { return; }
+    for (size_t i = 0 ; i < IOClasses ; i++) {
+        auto& c = counters->classes[i];
+        if (c.reads.load() + c.writes.load() + c.others.load() == 0) { continue; }
+        sample.counters.emplace_back(ids[i][0], c.reads.load());
+        sample.counters.emplace_back(ids[i][1], c.read_bytes.load());
+        sample.counters.emplace_back(ids[i][2], c.writes.load());
+        sample.counters.emplace_back(ids[i][3], c.write_bytes.load());
+        sample.counters.emplace_back(ids[i][4], c.others.load());
+        sample.counters.emplace_back(ids[i][5], c.ns.load());
+    }
+}
+
+/* The call time histogram of every thread that did I/O, by descriptor class */
+std::string ZeroSum::ioSummary(void) {
+    if (!ioEnabled()) { return ""; }
+    std::string tmpstr{"\nPOSIX I/O (call time, log2 ns buckets):\n"};
+    char buffer[256];
+    std::lock_guard l{ioMapMutex()};
+    for (auto& t : getIOCounterMap()) {
+        for (size_t i = 0 ; i < IOClasses ; i++) {
+            auto& c = t.second->classes[i];
+            size_t calls = c.reads.load() + c.writes.load() + c.others.load();
+            if (calls == 0) { continue; }
+            snprintf(buffer, sizeof(buffer),
+                "LWP %u %s: %lu reads, %.3f MB, %lu writes, %.3f MB, %lu other, %.3f ms\n",
+                t.first, ioClassNames[i], c.reads.load(), c.read_bytes.load() * 1.0e-6,
+                c.writes.load(), c.write_bytes.load() * 1.0e-6, c.others.load(),
+                c.ns.load() * 1.0e-6);
+            tmpstr += buffer;
+            for (size_t b = 0 ; b < ZS_IO_BUCKETS ; b++) {
+                uint64_t count = c.histogram[b].load();
+                if (count == 0) { continue; }
+                snprintf(buffer, sizeof(buffer), "    >= 2^%-2lu ns: %lu\n", b, count);
+                tmpstr += buffer;
+            }
+        }
+    }
+    return tmpstr;
+}
+
+} // namespace zerosum
+
+/* Each wrapper only records the call if it isn't nested inside ZeroSum
+ * or another wrapper, and ZS_POSIX_IO is set. */
+#define ZS_IO_RECORD (prevent_deadlocks.get() == 1 && ioEnabled())
+
+extern "C" {
+
+ssize_t read(int fd, void *buf, size_t count) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.read(fd, buf, count); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.read(fd, buf, count);
+    int err = errno;
+    recordRead(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.write(fd, buf, count); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.write(fd, buf, count);
+    int err = errno;
+    recordWrite(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.pread(fd, buf, count, offset); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.pread(fd, buf, count, offset);
+    int err = errno;
+    recordRead(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.pwrite(fd, buf, count, offset); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.pwrite(fd, buf, count, offset);
+    int err = errno;
+    recordWrite(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.pread64(fd, buf, count, offset); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.pread64(fd, buf, count, offset);
+    int err = errno;
+    recordRead(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.pwrite64(fd, buf, count, offset); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.pwrite64(fd, buf, count, offset);
+    int err = errno;
+    recordWrite(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.readv(fd, iov, iovcnt); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.readv(fd, iov, iovcnt);
+    int err = errno;
+    recordRead(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.writev(fd, iov, iovcnt); }
+    uint64_t begin = monotonicNs();
+    ssize_t rc = sys.writev(fd, iov, iovcnt);
+    int err = errno;
+    recordWrite(fd, rc, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+int fsync(int fd) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.fsync(fd); }
+    uint64_t begin = monotonicNs();
+    int rc = sys.fsync(fd);
+    int err = errno;
+    recordOther(classify(fd), monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+/* The mode is only passed when the file may be created */
+static mode_t openMode(int flags, va_list args) {
+    if ((flags & O_CREAT) || ((flags & O_TMPFILE) == O_TMPFILE)) {
+        return (mode_t)va_arg(args, int);
+    }
+    return 0;
+}
+
+int open(const char *pathname, int flags, ...) {
+    auto& sys = ioFunctions();
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = openMode(flags, args);
+    va_end(args);
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.open(pathname, flags, mode); }
+    uint64_t begin = monotonicNs();
+    int fd = sys.open(pathname, flags, mode);
+    int err = errno;
+    // a new descriptor, maybe with the number of one closed behind our back
+    forget(fd);
+    recordOther(fd < 0 ? IOFile : classify(fd), monotonicNs() - begin);
+    errno = err;
+    return fd;
+}
+
+int open64(const char *pathname, int flags, ...) {
+    auto& sys = ioFunctions();
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = openMode(flags, args);
+    va_end(args);
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) { return sys.open64(pathname, flags, mode); }
+    uint64_t begin = monotonicNs();
+    int fd = sys.open64(pathname, flags, mode);
+    int err = errno;
+    forget(fd);
+    recordOther(fd < 0 ? IOFile : classify(fd), monotonicNs() - begin);
+    errno = err;
+    return fd;
+}
+
+int close(int fd) {
+    auto& sys = ioFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (!ZS_IO_RECORD) {
+        forget(fd);
+        return sys.close(fd);
+    }
+    // classify before the descriptor goes away
+    io_class cls = classify(fd);
+    forget(fd);
+    uint64_t begin = monotonicNs();
+    int rc = sys.close(fd);
+    int err = errno;
+    recordOther(cls, monotonicNs() - begin);
+    errno = err;
+    return rc;
+}
+
+/* These only keep the descriptor classes right, they aren't timed */
+int socket(int domain, int type, int protocol) {
+    int fd = ioFunctions().socket(domain, type, protocol);
+    remember(fd, IOSocket);
+    return fd;
+}
+
+int socketpair(int domain, int type, int protocol, int sv[2]) {
+    int rc = ioFunctions().socketpair(domain, type, protocol, sv);
+    if (rc == 0) {
+        remember(sv[0], IOSocket);
+        remember(sv[1], IOSocket);
+    }
+    return rc;
+}
+
+int accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    int rc = ioFunctions().accept(fd, addr, addrlen);
+    remember(rc, IOSocket);
+    return rc;
+}
+
+int accept4(int fd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    int rc = ioFunctions().accept4(fd, addr, addrlen, flags);
+    remember(rc, IOSocket);
+    return rc;
+}
+
+int pipe(int fds[2]) {
+    int rc = ioFunctions().pipe(fds);
+    if (rc == 0) {
+        remember(fds[0], IOPipe);
+        remember(fds[1], IOPipe);
+    }
+    return rc;
+}
+
+int pipe2(int fds[2], int flags) {
+    int rc = ioFunctions().pipe2(fds, flags);
+    if (rc == 0) {
+        remember(fds[0], IOPipe);
+        remember(fds[1], IOPipe);
+    }
+    return rc;
+}
+
+/* The copy is whatever the original is, the next use looks it up */
+int dup(int fd) {
+    int rc = ioFunctions().dup(fd);
+    forget(rc);
+    return rc;
+}
+
+int dup2(int fd, int fd2) {
+    int rc = ioFunctions().dup2(fd, fd2);
+    forget(rc);
+    return rc;
+}
+
+int dup3(int fd, int fd2, int flags) {
+    int rc = ioFunctions().dup3(fd, fd2, flags);
+    forget(rc);
+    return rc;
+}
+
+} // extern "C"
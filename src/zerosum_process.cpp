@@ -45,6 +45,85 @@ void ZeroSum::getProcStatus(const int rank, const int size) {
 }
 */
 
+/* The process's own memory and I/O: the RSS and PSS from smaps_rollup,
+ * the bytes read and written from io, and the sizes and high-water marks
+ * from the Vm* lines of status. A file the kernel doesn't have (io needs
+ * task I/O accounting) is left out. */
+void ZeroSum::sampleProcess(void) {
+    if (processIds.empty()) {
+        processFiles.emplace_back("/proc/self/smaps_rollup", std::vector<std::string>{
+            "Rss kB", "Pss kB", "Pss_Anon kB", "Pss_File kB", "Pss_Shmem kB",
+            "Shared_Clean kB", "Shared_Dirty kB", "Private_Clean kB",
+            "Private_Dirty kB", "Anonymous kB", "AnonHugePages kB", "Swap kB",
+            "SwapPss kB", "Locked kB"});
+        processFiles.emplace_back("/proc/self/io");
+        processFiles.emplace_back("/proc/self/status",
+            std::vector<std::string>{"Vm*", "RssAnon kB", "RssFile kB", "RssShmem kB"});
+        processFiles.erase(std::remove_if(processFiles.begin(), processFiles.end(),
+            [](const CounterFile& f) { return f.names().empty(); }), processFiles.end());
+        for (auto& f : processFiles) {
+            for (auto& n : f.names()) {
+                processIds.push_back(series::Metrics::intern(n));
+            }
+        }
+        if (processIds.empty()) { return; }
+    }
+    processValues.clear();
+    for (auto& f : processFiles) {
+        if (!f.read(processValues)) { return; }
+    }
+    process.data.begin(step);
+    for (size_t i = 0 ; i < processIds.size() ; i++) {
+        process.data.set(processIds[i], processValues[i]);
+    }
+    process.data.end();
+}
+
+/* Where the pages are, by NUMA node, and how much of it is on nodes that
+ * none of our cpus are on, which is usually memory that another thread
+ * touched first, or that spilled from a full node */
+void ZeroSum::sampleNumaMaps(void) {
+    static const series::metric_id mapped{series::Metrics::intern("numa mapped kB")};
+    static const series::metric_id remote{series::Metrics::intern("numa remote kB")};
+    static const series::metric_id remoteAnon{series::Metrics::intern("numa remote anon kB")};
+    static std::vector<std::pair<series::metric_id, series::metric_id>> ids;
+    const auto& nodes = memoryFiles.numaNodes();
+    if (ids.empty()) {
+        for (auto n : nodes) {
+            std::string prefix{"numa node " + std::to_string(n)};
+            ids.emplace_back(series::Metrics::intern(prefix + " kB"),
+                series::Metrics::intern(prefix + " anon kB"));
+            cpu_set_t cpus;
+            if (localNodes.size() <= n) { localNodes.resize(n + 1, false); }
+            if (!getNodeCpus(n, cpus)) { continue; }
+            for (auto c : toList(cpus)) {
+                if (process.hwthreads.count(c) > 0) { localNodes[n] = true; }
+            }
+        }
+    }
+    if (!getNumaMaps("/proc/self/numa_maps", numaMaps)) { return; }
+    uint64_t total{0};
+    uint64_t remoteKB{0};
+    uint64_t remoteAnonKB{0};
+    process.numaMaps.begin(step);
+    for (size_t i = 0 ; i < nodes.size() ; i++) {
+        uint32_t n = nodes[i];
+        uint64_t kB = n < numaMaps.kB.size() ? numaMaps.kB[n] : 0;
+        uint64_t anon = n < numaMaps.anon_kB.size() ? numaMaps.anon_kB[n] : 0;
+        process.numaMaps.set(ids[i].first, kB);
+        process.numaMaps.set(ids[i].second, anon);
+        total += kB;
+        if (!localNodes[n]) {
+            remoteKB += kB;
+            remoteAnonKB += anon;
+        }
+    }
+    process.numaMaps.set(mapped, total);
+    process.numaMaps.set(remote, remoteKB);
+    process.numaMaps.set(remoteAnon, remoteAnonKB);
+    process.numaMaps.end();
+}
+
 /* This function will find any other processes that are running on our assigned resources */
 int ZeroSum::getOtherProcesses(void) {
     std::string tmpstr;
@@ -75,10 +154,16 @@ int ZeroSum::getOtherProcesses(void) {
             }
             if (overlap) {
                 std::string filename = "/proc/" + pid + "/stat";
-                auto fields = getThreadStat(filename.c_str());
-                filename = "/proc/" + pid + "/status";
-                getThreadStatus(filename.c_str(), fields);
-                otherProcesses.push_back(software::Process(stol(pid), 0, 1, fields, allowed_list));
+                software::LWPSample sample;
+                if (!sample.read(filename.c_str(), statfile.c_str())) { continue; }
+                // after the first look, this is run periodically
+                auto p = std::find_if(otherProcesses.begin(), otherProcesses.end(),
+                    [&](const software::Process& o) { return o.id == stol(pid); });
+                if (p == otherProcesses.end()) {
+                    otherProcesses.push_back(software::Process(stol(pid), 0, 1, sample));
+                } else {
+                    p->add(p->id, sample, step, software::Main);
+                }
             }
         }
         (void) closedir (dp);
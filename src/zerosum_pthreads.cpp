@@ -23,60 +23,113 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <dirent.h>
 #include <signal.h>
+#include <semaphore.h>
 #include "zerosum.h"
 #include "utils.h"
-#include <dlfcn.h>
+#include "global_constructor_destructor.h"
+#include "system_functions.h"
+#include "output_pipeline.h"
 #include <unordered_map>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 typedef int (*pthread_mutex_lock_p)(pthread_mutex_t *mutex);
 typedef int (*pthread_mutex_trylock_p)(pthread_mutex_t *mutex);
 typedef int (*pthread_cond_wait_p)(pthread_cond_t *cond, pthread_mutex_t *mutex);
 typedef int (*pthread_cond_timedwait_p)(pthread_cond_t *cond,
     pthread_mutex_t *mutex, const struct timespec *abstime);
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 30)
+/* libstdc++ waits with it for the steady_clock timeouts of
+ * std::condition_variable */
+#define ZS_HAVE_COND_CLOCKWAIT
+typedef int (*pthread_cond_clockwait_p)(pthread_cond_t *cond,
+    pthread_mutex_t *mutex, clockid_t clock, const struct timespec *abstime);
+#endif
+typedef int (*pthread_barrier_wait_p)(pthread_barrier_t *barrier);
+typedef int (*sem_wait_p)(sem_t *sem);
+typedef int (*sem_timedwait_p)(sem_t *sem, const struct timespec *abstime);
+
+typedef struct system_functions {
+    pthread_mutex_lock_p mutex_lock;
+    pthread_mutex_trylock_p mutex_trylock;
+    pthread_cond_wait_p cond_wait;
+    pthread_cond_timedwait_p cond_timedwait;
+#ifdef ZS_HAVE_COND_CLOCKWAIT
+    pthread_cond_clockwait_p cond_clockwait;
+#endif
+    pthread_barrier_wait_p barrier_wait;
+    sem_wait_p sem_wait;
+    sem_timedwait_p sem_timedwait;
+} system_functions_t;
 
-#define RESET_DLERROR() dlerror()
-#define CHECK_DLERROR() { \
-  char const * err = dlerror(); \
-  if (err) { \
-    printf("Error getting %s handle: %s\n", name, err); \
-    fflush(stdout); \
-    exit(1); \
-  } \
-}
-
-static void * get_system_function_handle(char const * name, void * caller) {
-    void * handle;
-    // Reset error pointer
-    RESET_DLERROR();
-    // Attempt to get the function handle
-    handle = dlsym(RTLD_NEXT, name);
-    // Detect errors
-    CHECK_DLERROR();
-    // Prevent recursion if more than one wrapping approach has been loaded.
-    // This happens because we support wrapping pthreads three ways at once:
-    // #defines in Profiler.h, -Wl,-wrap on the link line, and LD_PRELOAD.
-    if (handle == caller) {
-        RESET_DLERROR();
-        void * syms = dlopen(NULL, RTLD_NOW);
-        CHECK_DLERROR();
-        do {
-            RESET_DLERROR();
-            handle = dlsym(syms, name);
-            CHECK_DLERROR();
-        } while (handle == caller);
-    }
-    return handle;
+static system_functions_t resolveSystemFunctions(void) {
+    system_functions_t f;
+    f.mutex_lock = (pthread_mutex_lock_p)get_system_function_handle(
+        "pthread_mutex_lock", (void*)pthread_mutex_lock);
+    f.mutex_trylock = (pthread_mutex_trylock_p)get_system_function_handle(
+        "pthread_mutex_trylock", (void*)pthread_mutex_trylock);
+    f.cond_wait = (pthread_cond_wait_p)get_versioned_function_handle(
+        "pthread_cond_wait", "GLIBC_2.3.2", (void*)pthread_cond_wait);
+    f.cond_timedwait = (pthread_cond_timedwait_p)get_versioned_function_handle(
+        "pthread_cond_timedwait", "GLIBC_2.3.2", (void*)pthread_cond_timedwait);
+#ifdef ZS_HAVE_COND_CLOCKWAIT
+    f.cond_clockwait = (pthread_cond_clockwait_p)get_system_function_handle(
+        "pthread_cond_clockwait", (void*)pthread_cond_clockwait);
+#endif
+    f.barrier_wait = (pthread_barrier_wait_p)get_system_function_handle(
+        "pthread_barrier_wait", (void*)pthread_barrier_wait);
+    f.sem_wait = (sem_wait_p)get_system_function_handle(
+        "sem_wait", (void*)sem_wait);
+    f.sem_timedwait = (sem_timedwait_p)get_system_function_handle(
+        "sem_timedwait", (void*)sem_timedwait);
+    return f;
 }
 
+/* Resolved by the constructor below, so a wrapper never calls dlsym()
+ * (and the locks and allocations inside it) while a waiter holds a mutex.
+ * Only wrappers called from another library's constructor, before ours,
+ * resolve them on first use. */
+static system_functions_t& systemFunctions(void) {
+    static system_functions_t functions{resolveSystemFunctions()};
+    return functions;
+}
+
+DEFINE_CONSTRUCTOR(zerosum_resolve_system_functions)
+static void zerosum_resolve_system_functions(void) {
+    systemFunctions();
+}
+
+/* Blocked time in log2(ns) buckets, the last one holds everything longer */
+#define ZS_WAIT_BUCKETS 40
+
 typedef struct thread_counters {
     std::atomic<size_t> locks;
     std::atomic<size_t> trylocks;
     std::atomic<size_t> waits;
     std::atomic<size_t> timedwaits;
+    std::atomic<uint64_t> cond_ns;
+    std::atomic<size_t> barrier_waits;
+    std::atomic<uint64_t> barrier_ns;
+    std::atomic<size_t> sem_waits;
+    std::atomic<uint64_t> sem_ns;
+    // only updated with ZS_MUTEX_CONTENTION
+    std::atomic<size_t> contended;
+    std::atomic<uint64_t> blocked_ns;
+    std::array<std::atomic<uint64_t>, ZS_WAIT_BUCKETS> histogram;
 } thread_counters_t;
 
+typedef struct mutex_contention {
+    size_t contended{0};
+    uint64_t blocked_ns{0};
+    uint64_t max_ns{0};
+} mutex_contention_t;
+
 std::mutex& mapMutex() {
     static std::mutex mtx;
     return mtx;
@@ -92,7 +145,8 @@ thread_counters_t* getCounters(uint32_t tid) {
     std::lock_guard l{mapMutex()};
     auto tmp = getCounterMap().find(tid);
     if (tmp == getCounterMap().end()) {
-        getCounterMap()[tid] = new thread_counters_t;
+        // value-initialized, so the atomics start at zero
+        getCounterMap()[tid] = new thread_counters_t();
     }
     return getCounterMap()[tid];
 }
@@ -102,69 +156,225 @@ thread_counters_t* getMyCounters() {
     return counters;
 }
 
+/* The contended mutexes by address, with ZS_MUTEX_ADDRESSES */
+std::mutex& contentionMutex() {
+    static std::mutex mtx;
+    return mtx;
+}
+
+std::unordered_map<const void*,mutex_contention_t>& getContentionMap() {
+    static std::unordered_map<const void*,mutex_contention_t> _theMap;
+    return _theMap;
+}
+
+/* Only called after a failed trylock, so the uncontended path never gets here */
+void recordContention(thread_counters_t* counters, const void* mutex, uint64_t ns) {
+    static bool byAddress{zerosum::parseBool("ZS_MUTEX_ADDRESSES", false)};
+    counters->contended++;
+    counters->blocked_ns += ns;
+    size_t bucket = (size_t)(63 - __builtin_clzll(ns | 1));
+    counters->histogram[std::min(bucket, (size_t)(ZS_WAIT_BUCKETS-1))]++;
+    if (byAddress) {
+        // re-entry from this lock is prevented by the caller
+        std::lock_guard l{contentionMutex()};
+        auto& m = getContentionMap()[mutex];
+        m.contended++;
+        m.blocked_ns += ns;
+        m.max_ns = std::max(m.max_ns, ns);
+    }
+}
+
 namespace zerosum {
 
+/* PF_IO_WORKER from the kernel's linux/sched.h, which isn't exported.
+ * io_uring's worker threads show up in /proc/self/task with this flag. */
+#define ZS_PF_IO_WORKER 0x00000010
+
+/* Read the stat and status of every thread, either with io_uring
+ * (ZS_IO_URING=1) or with one pread() per file. */
+void ZeroSum::readTasks(void) {
+    taskFiles.beginSweep();
+#ifdef ZEROSUM_USE_IO_URING
+    static bool useUring{parseBool("ZS_IO_URING", false)};
+    if (useUring && taskReader == nullptr) {
+        taskReader = std::make_unique<BatchedTaskReader>();
+        if (!taskReader->valid()) {
+            if (logfile.is_open()) {
+                periodLog << "io_uring unavailable, using pread for thread sampling" << std::endl;
+            }
+            useUring = false;
+            taskReader.reset();
+        }
+    }
+    if (taskReader != nullptr && taskReader->valid()) {
+        taskReader->read(taskFiles, taskSamples);
+        /* Kept, its buffers may have been the target of the reads that
+         * were in flight when the ring failed */
+        if (!taskReader->valid() && logfile.is_open()) {
+            periodLog << "io_uring failed, using pread for thread sampling" << std::endl;
+        }
+    } else
+#endif
+    {
+        for (auto& t : taskSamples) {
+            t.valid = taskFiles.read(t);
+        }
+    }
+    taskFiles.endSweep();
+}
+
+void ZeroSum::registerThread(uint32_t tid, software::ThreadType type) {
+    registrations.push(thread_registration_t{tid, (uint32_t)type, series::now()});
+}
+
 int ZeroSum::getpthreads() {
-    std::string tmpstr;
     DIR *dp;
     struct dirent *ep;
     dp = opendir ("/proc/self/task");
     static bool verbose{getVerbose()};
     static bool deadlock{parseBool("ZS_DETECT_DEADLOCK",false)};
     static int deadlock_duration{parseInt("ZS_DEADLOCK_DURATION",5)};
-    static int deadlock_detected_seconds = 0;
+    // the sweeps are one THREADS period apart, which can be well under a
+    // second, so the time all threads have been asleep is measured
+    static double all_sleeping_seconds{0.0};
+    static auto previous_sweep{std::chrono::steady_clock::now()};
+    static const series::metric_id lockCalls{series::Metrics::intern("pthread lock calls")};
+    static const series::metric_id trylockCalls{series::Metrics::intern("pthread trylock calls")};
+    static const series::metric_id contendedLocks{series::Metrics::intern("pthread contended locks")};
+    static const series::metric_id blockedTime{series::Metrics::intern("pthread blocked ns")};
+    static const series::metric_id condWaits{series::Metrics::intern("pthread cond waits")};
+    static const series::metric_id condBlocked{series::Metrics::intern("pthread cond blocked ns")};
+    static const series::metric_id barrierWaits{series::Metrics::intern("pthread barrier waits")};
+    static const series::metric_id barrierBlocked{series::Metrics::intern("pthread barrier blocked ns")};
+    static const series::metric_id semWaits{series::Metrics::intern("sem waits")};
+    static const series::metric_id semBlocked{series::Metrics::intern("sem blocked ns")};
+    static bool contention{parseBool("ZS_MUTEX_CONTENTION", false)};
+    static const series::metric_id schedRun{series::Metrics::intern("sched run ns")};
+    static const series::metric_id schedWait{series::Metrics::intern("sched wait ns")};
+    static const series::metric_id schedSlices{series::Metrics::intern("sched timeslices")};
+    static const series::metric_id runDelay{series::Metrics::intern("run queue delay us")};
+    static const series::metric_id sweepThreads{series::Metrics::intern("threads")};
+    static const series::metric_id sweepLatency{series::Metrics::intern("latency us")};
+    static software::LWPSample sample;
+    // the threads that registered since the last sweep, to give them a type
+    thread_registration_t r;
+    while (registrations.pop(r)) {
+        registeredTypes[r.tid] = r.type;
+        registered++;
+        uint64_t now = series::now();
+        if (now > r.timestamp) {
+            maxQueuedUs = std::max(maxQueuedUs, (now - r.timestamp) / 1000);
+        }
+    }
     if (dp != NULL)
     {
-        size_t running = 0;
+        auto start = std::chrono::steady_clock::now();
+        taskSamples.clear();
         while ((ep = readdir (dp)) != NULL) {
             if (strncmp(ep->d_name, ".", 1) == 0) continue;
-            if (tmpstr.size() > 0) { tmpstr = tmpstr + ","; }
-            tmpstr = tmpstr + ep->d_name;
-            uint32_t lwp = atol(ep->d_name);
-            int nhwthr = 0;
-            std::string tmpstr2;
-            std::vector<uint32_t> allowed_list_posix =
-                getAffinityList(lwp, computeNode.ncpus, nhwthr, tmpstr2);
-            // also want to read /proc/<pid>/task/<tid>/status!
-            std::string filename = "/proc/self/task/";
-            filename += ep->d_name;
-            filename += "/stat";
-            auto fields = getThreadStat(filename.c_str());
-            bool isMain{atol(ep->d_name) == process.id};
-            if (isRunning(fields, ep->d_name, isMain)) { running++; }
-            filename += "us";
-            std::string allowed_string = getCpusAllowed(filename.c_str());
-            std::vector<uint32_t> allowed_list = parseDiscreteValues(allowed_string);
-            getThreadStatus(filename.c_str(), fields);
-            //std::cout << filename << " : " << allowed_string << std::endl;
+            task_sample_t t;
+            t.tid = atol(ep->d_name);
+            t.valid = false;
+            t.has_schedstat = false;
+            taskSamples.push_back(t);
+        }
+        (void) closedir (dp);
+        readTasks();
+        if (stackSampler != nullptr) { stackSampler->beginSweep(); }
+        if (perfCounters != nullptr) { perfCounters->beginSweep(); }
+        size_t running = 0;
+        for (auto& t : taskSamples) {
+            // the thread may have exited since we read the directory
+            if (!t.valid) { continue; }
+            // and io_uring's worker threads aren't the application's
+            if (t.stat.flags & ZS_PF_IO_WORKER) { continue; }
+            uint32_t lwp = t.tid;
+            sample.stat = t.stat;
+            sample.status = t.status;
+            sample.counters.clear();
+            sample.gauges.clear();
+            bool isMain{lwp == process.id};
+            if (isRunning(sample.stat, lwp, isMain)) { running++; }
             auto counters = getCounters(lwp);
-            fields.insert(std::pair("pthread lock calls",std::to_string(counters->locks)));
-            fields.insert(std::pair("pthread trylock calls",std::to_string(counters->trylocks)));
-            //fields.insert(std::pair("pthread wait calls",std::to_string(counters->waits)));
-            //fields.insert(std::pair("pthread timedwait calls",std::to_string(counters->timedwaits)));
-            if (lwp == async_tid) {
-                this->process.add(lwp, allowed_list, fields, step, software::ThreadType::ZeroSum);
+            sample.counters.emplace_back(lockCalls, counters->locks.load());
+            sample.counters.emplace_back(trylockCalls, counters->trylocks.load());
+            if (contention) {
+                sample.counters.emplace_back(contendedLocks, counters->contended.load());
+                sample.counters.emplace_back(blockedTime, counters->blocked_ns.load());
+            }
+            // the waits are cumulative, so only threads that have waited get columns
+            size_t cond = counters->waits.load() + counters->timedwaits.load();
+            if (cond > 0) {
+                sample.counters.emplace_back(condWaits, cond);
+                sample.counters.emplace_back(condBlocked, counters->cond_ns.load());
+            }
+            if (counters->barrier_waits.load() > 0) {
+                sample.counters.emplace_back(barrierWaits, counters->barrier_waits.load());
+                sample.counters.emplace_back(barrierBlocked, counters->barrier_ns.load());
+            }
+            if (counters->sem_waits.load() > 0) {
+                sample.counters.emplace_back(semWaits, counters->sem_waits.load());
+                sample.counters.emplace_back(semBlocked, counters->sem_ns.load());
+            }
+            if (t.has_schedstat) {
+                sample.counters.emplace_back(schedRun, t.schedstat.run_ns);
+                sample.counters.emplace_back(schedWait, t.schedstat.wait_ns);
+                sample.counters.emplace_back(schedSlices, t.schedstat.timeslices);
+                sample.gauges.emplace_back(runDelay, (double)process.schedDelay(lwp, t.schedstat) * 1.0e-3);
+            }
+            if (perfCounters != nullptr) { getPerfCounters(lwp, sample); }
+#ifdef ZEROSUM_USE_POSIX_IO
+            getPosixIO(lwp, sample);
+#endif
+#ifdef ZEROSUM_USE_ALLOCATIONS
+            getAllocations(lwp, sample);
+#endif
+            if (lwp == async_tid || (pipeline != nullptr && lwp == pipeline->tid())) {
+                this->process.add(lwp, sample, step, software::ThreadType::ZeroSum);
             } else {
-                this->process.add(lwp, allowed_list, fields, step);
+                if (stackSampler != nullptr) { stackSampler->track(lwp); }
+                auto type = registeredTypes.find(lwp);
+                this->process.add(lwp, sample, step, type == registeredTypes.end() ?
+                    software::ThreadType::Other : (software::ThreadType)type->second);
             }
         }
-        (void) closedir (dp);
+        if (stackSampler != nullptr) { stackSampler->endSweep(); }
+        if (perfCounters != nullptr) { perfCounters->endSweep(); }
+        // a registered thread that wasn't found has exited, and its ID can be reused
+        registeredTypes.clear();
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        sweepData.begin(step);
+        sweepData.set(sweepThreads, (uint64_t)taskSamples.size());
+        sweepData.set(sweepLatency, (uint64_t)latency);
+        sweepData.end();
+        auto& entry = sweepStats[taskSamples.size()];
+        entry[0]++;
+        entry[1] += latency;
+        entry[2] = std::max(entry[2], (uint64_t)latency);
+        if (verbose && logfile.is_open()) {
+            periodLog << "Sampled " << taskSamples.size() << " threads in "
+                    << latency << " us" << std::endl;
+        }
         // if there is only one running thread (this one, belonging to ZS), be concerned...
         if (deadlock) {
+            std::chrono::duration<double> since{start - previous_sweep};
+            previous_sweep = start;
             if (verbose) {
-                ZeroSum::getInstance().getLogfile() << running << " threads running" << std::endl;
+                periodLog << running << " threads running" << std::endl;
             }
             if (running <= 1) {
-                static int period{parseInt("ZS_PERIOD", 1)};
-                deadlock_detected_seconds++;
-                ZeroSum::getInstance().getLogfile() << "All threads sleeping for " <<
-                    deadlock_detected_seconds*period << " seconds...?" << std::endl;
+                all_sleeping_seconds += since.count();
+                periodLog << "All threads sleeping for " <<
+                    all_sleeping_seconds << " seconds...?" << std::endl;
             } else {
-                deadlock_detected_seconds = 0;
+                all_sleeping_seconds = 0.0;
             }
-            if (deadlock_detected_seconds >= deadlock_duration) {
-                ZeroSum::getInstance().getLogfile() << "Deadlock detected! Aborting!" << std::endl;
-                ZeroSum::getInstance().getLogfile() << "Thread " << gettid() << " signalling " << this->process.id << std::endl;
+            if (all_sleeping_seconds >= deadlock_duration) {
+                periodLog << "Deadlock detected! Aborting!" << std::endl;
+                periodLog << "Thread " << gettid() << " signalling " << this->process.id << std::endl;
+                recordEvent("deadlock", "all threads sleeping for " + std::to_string(
+                    std::lround(all_sleeping_seconds)) + " seconds");
                 finalizeLog();
                 pthread_kill(this->process.id, SIGQUIT);
             }
@@ -173,28 +383,142 @@ int ZeroSum::getpthreads() {
     return 0;
 }
 
+/* The perf counts are cumulative, like the /proc counters, and the rates
+ * are over the time since the thread's last read. The task clock's rate
+ * is the fraction of a cpu the thread used. */
+void ZeroSum::getPerfCounters(uint32_t lwp, software::LWPSample& sample) {
+    static const series::metric_id ipc{series::Metrics::intern("perf ipc")};
+    static std::vector<series::metric_id> counts;
+    static std::vector<series::metric_id> rates;
+    static int instructions{-1};
+    static int cycles{-1};
+    static std::vector<uint64_t> values;
+    static std::vector<uint64_t> deltas;
+    const auto& events = perfCounters->counted();
+    if (counts.empty()) {
+        for (size_t i = 0 ; i < events.size() ; i++) {
+            counts.push_back(series::Metrics::intern(events[i].name));
+            rates.push_back(series::Metrics::intern(events[i].rate));
+            if (strcmp(events[i].name, "perf instructions") == 0) { instructions = (int)i; }
+            if (strcmp(events[i].name, "perf cycles") == 0) { cycles = (int)i; }
+        }
+    }
+    uint64_t elapsed_ns{0};
+    if (!perfCounters->read(lwp, values, deltas, elapsed_ns)) { return; }
+    for (size_t i = 0 ; i < values.size() ; i++) {
+        sample.counters.emplace_back(counts[i], values[i]);
+    }
+    if (elapsed_ns == 0) { return; }
+    // the task clock leads the group, and is in ns already
+    sample.gauges.emplace_back(rates[0], (double)deltas[0] / (double)elapsed_ns);
+    for (size_t i = 1 ; i < deltas.size() ; i++) {
+        sample.gauges.emplace_back(rates[i], (double)deltas[i] * 1.0e9 / (double)elapsed_ns);
+    }
+    // the gauges are logged as recorded, so a thread that didn't run gets
+    // an IPC of 0 rather than keeping the one from when it last ran
+    if (instructions >= 0 && cycles >= 0) {
+        sample.gauges.emplace_back(ipc, deltas[cycles] > 0 ?
+            (double)deltas[instructions] / (double)deltas[cycles] : 0.0);
+    }
+}
+
+/* Sweep latency versus thread count, one line per distinct thread count */
+std::string ZeroSum::sweepSummary(void) {
+    if (sweepStats.empty()) { return ""; }
+    std::string tmpstr{"\nThread sweep latency ("};
+#ifdef ZEROSUM_USE_IO_URING
+    tmpstr += (taskReader != nullptr && taskReader->valid()) ? "io_uring" : "pread";
+#else
+    tmpstr += "pread";
+#endif
+    tmpstr += "):\n";
+    char buffer[256];
+    for (auto& c : sweepStats) {
+        double mean = (double)c.second[1] / (double)c.second[0];
+        snprintf(buffer, sizeof(buffer),
+            "%6lu threads: %5lu sweeps, mean %10.1f us, max %8lu us, %7.2f us/thread\n",
+            c.first, c.second[0], mean, c.second[2], mean / (double)std::max(c.first, 1UL));
+        tmpstr += buffer;
+    }
+    snprintf(buffer, sizeof(buffer),
+        "Thread registrations: %lu, %lu dropped, max queued %lu us\n",
+        registered, registrations.dropped(), maxQueuedUs);
+    tmpstr += buffer;
+    return tmpstr;
+}
+
+/* The blocked time histogram of every thread that waited for a mutex,
+ * and the most contended mutexes if they were recorded by address. */
+std::string ZeroSum::contentionSummary(void) {
+    static bool contention{parseBool("ZS_MUTEX_CONTENTION", false)};
+    if (!contention) { return ""; }
+    std::string tmpstr{"\nMutex contention (blocked time, log2 ns buckets):\n"};
+    char buffer[256];
+    {
+        std::lock_guard l{mapMutex()};
+        for (auto& t : getCounterMap()) {
+            size_t contended = t.second->contended.load();
+            if (contended == 0) { continue; }
+            snprintf(buffer, sizeof(buffer),
+                "LWP %u: %lu of %lu locks contended, %.3f ms blocked\n", t.first,
+                contended, t.second->locks.load(), t.second->blocked_ns.load() * 1.0e-6);
+            tmpstr += buffer;
+            for (size_t b = 0 ; b < ZS_WAIT_BUCKETS ; b++) {
+                uint64_t count = t.second->histogram[b].load();
+                if (count == 0) { continue; }
+                snprintf(buffer, sizeof(buffer), "    >= 2^%-2lu ns: %lu\n", b, count);
+                tmpstr += buffer;
+            }
+        }
+    }
+    std::vector<std::pair<const void*,mutex_contention_t>> mutexes;
+    {
+        std::lock_guard l{contentionMutex()};
+        mutexes.assign(getContentionMap().begin(), getContentionMap().end());
+    }
+    if (mutexes.empty()) { return tmpstr; }
+    std::sort(mutexes.begin(), mutexes.end(), [](const auto& a, const auto& b) {
+        return a.second.blocked_ns > b.second.blocked_ns; });
+    tmpstr += "Most contended mutexes:\n";
+    for (size_t i = 0 ; i < std::min(mutexes.size(), (size_t)10) ; i++) {
+        auto& m = mutexes[i];
+        snprintf(buffer, sizeof(buffer),
+            "%18p: %8lu contended, %10.3f ms blocked, max %10.3f ms\n", m.first,
+            m.second.contended, m.second.blocked_ns * 1.0e-6, m.second.max_ns * 1.0e-6);
+        tmpstr += buffer;
+    }
+    return tmpstr;
+}
+
 } // namespace zerosum
 
 extern "C" {
 
 int pthread_mutex_lock(pthread_mutex_t *mutex) {
-    static pthread_mutex_lock_p _pthread_mutex_lock =
-        (pthread_mutex_lock_p)get_system_function_handle(
-        "pthread_mutex_lock", (void*)pthread_mutex_lock);
+    auto& sys = systemFunctions();
+    static bool contention{zerosum::parseBool("ZS_MUTEX_CONTENTION", false)};
     // prevent re-entry, so we don't crash or lock
     zerosum::in_zs prevent_deadlocks;
     if (prevent_deadlocks.get() == 1) {
         // do the work to increment the counter
         thread_counters_t* counters = getMyCounters();
         counters->locks++;
+        if (contention) {
+            /* Only time the acquire if the lock is held. Anything but EBUSY
+             * (acquired, owner died, bad mutex) is what lock would return. */
+            int rc = sys.mutex_trylock(mutex);
+            if (rc != EBUSY) { return rc; }
+            uint64_t begin = monotonicNs();
+            rc = sys.mutex_lock(mutex);
+            recordContention(counters, mutex, monotonicNs() - begin);
+            return rc;
+        }
     }
-    return _pthread_mutex_lock(mutex);
+    return sys.mutex_lock(mutex);
 }
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex) {
-    static pthread_mutex_trylock_p _pthread_mutex_trylock =
-        (pthread_mutex_trylock_p)get_system_function_handle(
-        "pthread_mutex_trylock", (void*)pthread_mutex_trylock);
+    auto& sys = systemFunctions();
     // prevent re-entry
     zerosum::in_zs prevent_deadlocks;
     if (prevent_deadlocks.get() == 1) {
@@ -202,42 +526,94 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex) {
         thread_counters_t* counters = getMyCounters();
         counters->trylocks++;
     }
-    return _pthread_mutex_trylock(mutex);
+    return sys.mutex_trylock(mutex);
 }
 
-/* There are deadlock issues with the pthread_cond_wait wrapper,
- * so disabled for now.
- */
+/* The wait wrappers only count and time the wait. The counters are looked
+ * up before waiting, so nothing but the clock is called while the caller's
+ * mutex is released, and nested calls (from inside ZeroSum or the runtime)
+ * go straight to the system function. */
 
-#if 0
 int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
-    static pthread_cond_wait_p _pthread_cond_wait =
-        (pthread_cond_wait_p)get_system_function_handle(
-        "pthread_cond_wait", (void*)pthread_cond_wait);
+    auto& sys = systemFunctions();
     // prevent re-entry
     zerosum::in_zs prevent_deadlocks;
-    if (prevent_deadlocks.get() == 1) {
-        // do the work to increment the counter
-        thread_counters_t* counters = getMyCounters();
-        counters->waits++;
-    }
-    return _pthread_cond_wait(cond, mutex);
+    if (prevent_deadlocks.get() != 1) { return sys.cond_wait(cond, mutex); }
+    thread_counters_t* counters = getMyCounters();
+    uint64_t begin = monotonicNs();
+    int rc = sys.cond_wait(cond, mutex);
+    counters->cond_ns += monotonicNs() - begin;
+    counters->waits++;
+    return rc;
 }
 
 int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
     const struct timespec *abstime) {
-    static pthread_cond_timedwait_p _pthread_cond_timedwait =
-        (pthread_cond_timedwait_p)get_system_function_handle(
-        "pthread_cond_timedwait", (void*)pthread_cond_timedwait);
+    auto& sys = systemFunctions();
     // prevent re-entry
     zerosum::in_zs prevent_deadlocks;
-    if (prevent_deadlocks.get() == 1) {
-        // do the work to increment the counter
-        thread_counters_t* counters = getMyCounters();
-        counters->timedwaits++;
-    }
-    return _pthread_cond_timedwait(cond, mutex, abstime);
+    if (prevent_deadlocks.get() != 1) { return sys.cond_timedwait(cond, mutex, abstime); }
+    thread_counters_t* counters = getMyCounters();
+    uint64_t begin = monotonicNs();
+    int rc = sys.cond_timedwait(cond, mutex, abstime);
+    counters->cond_ns += monotonicNs() - begin;
+    counters->timedwaits++;
+    return rc;
+}
+
+#ifdef ZS_HAVE_COND_CLOCKWAIT
+int pthread_cond_clockwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+    clockid_t clock, const struct timespec *abstime) {
+    auto& sys = systemFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (prevent_deadlocks.get() != 1) { return sys.cond_clockwait(cond, mutex, clock, abstime); }
+    thread_counters_t* counters = getMyCounters();
+    uint64_t begin = monotonicNs();
+    int rc = sys.cond_clockwait(cond, mutex, clock, abstime);
+    counters->cond_ns += monotonicNs() - begin;
+    counters->timedwaits++;
+    return rc;
 }
 #endif
 
+int pthread_barrier_wait(pthread_barrier_t *barrier) {
+    auto& sys = systemFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (prevent_deadlocks.get() != 1) { return sys.barrier_wait(barrier); }
+    thread_counters_t* counters = getMyCounters();
+    uint64_t begin = monotonicNs();
+    int rc = sys.barrier_wait(barrier);
+    counters->barrier_ns += monotonicNs() - begin;
+    counters->barrier_waits++;
+    return rc;
+}
+
+int sem_wait(sem_t *sem) {
+    auto& sys = systemFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (prevent_deadlocks.get() != 1) { return sys.sem_wait(sem); }
+    thread_counters_t* counters = getMyCounters();
+    uint64_t begin = monotonicNs();
+    int rc = sys.sem_wait(sem);
+    counters->sem_ns += monotonicNs() - begin;
+    counters->sem_waits++;
+    return rc;
+}
+
+int sem_timedwait(sem_t *sem, const struct timespec *abstime) {
+    auto& sys = systemFunctions();
+    // prevent re-entry
+    zerosum::in_zs prevent_deadlocks;
+    if (prevent_deadlocks.get() != 1) { return sys.sem_timedwait(sem, abstime); }
+    thread_counters_t* counters = getMyCounters();
+    uint64_t begin = monotonicNs();
+    int rc = sys.sem_timedwait(sem, abstime);
+    counters->sem_ns += monotonicNs() - begin;
+    counters->sem_waits++;
+    return rc;
+}
+
 } // extern "C"
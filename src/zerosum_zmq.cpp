@@ -23,6 +23,9 @@
  */
 
 #include "zerosum.h"
+#include "utils.h"
+#include "output_pipeline.h"
+#include "csv_format.h"
 #include <cstdio>
 #include <regex>
 #include <iostream>
@@ -30,6 +33,8 @@
 #include <string>
 #include <zmq.hpp>
 #include <sys/time.h>
+#include <chrono>
+#include <functional>
 
 namespace zerosum {
 
@@ -82,4 +87,41 @@ int ZeroSum::writeToLocalAggregator(const std::string& data) {
     return 0;
 }
 
+/* Sends the CSV rows of the snapshots to the local aggregator every
+ * ZS_AGGREGATOR_PERIOD seconds, from the writer thread */
+class AggregatorSink : public output::Sink {
+public:
+    typedef std::function<int(const std::string&)> send_t;
+    AggregatorSink(send_t sender, const std::string& hostname, uint32_t rank,
+        uint32_t shmrank) : sender(sender), csv(hostname, rank, shmrank),
+        period(parseInt("ZS_AGGREGATOR_PERIOD", 10)),
+        due(std::chrono::steady_clock::now() + period) {
+        csv.header();
+    }
+    void write(const output::Snapshot& snapshot) override {
+        for (auto& r : snapshot.records) { csv(r); }
+        if (std::chrono::steady_clock::now() > due) {
+            send();
+            due = due + period;
+        }
+    }
+    void finish(void) override { send(); }
+private:
+    void send(void) {
+        sender(csv.str());
+        csv.clear();
+        csv.header();
+    }
+    send_t sender;
+    output::CsvFormatter csv;
+    std::chrono::seconds period;
+    std::chrono::time_point<std::chrono::steady_clock> due;
+};
+
+std::unique_ptr<output::Sink> ZeroSum::aggregatorSink(void) {
+    return std::make_unique<AggregatorSink>(
+        [this](const std::string& data) { return writeToLocalAggregator(data); },
+        computeNode.name, process.rank, process.shmrank);
+}
+
 }
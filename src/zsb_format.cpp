@@ -0,0 +1,361 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include "zsb_format.h"
+
+namespace zerosum {
+
+namespace output {
+
+namespace {
+
+constexpr uint32_t unset{UINT32_MAX};
+
+inline uint64_t zigzag(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+inline uint64_t unzigzag(uint64_t v) {
+    return (v >> 1) ^ (uint64_t)(-(int64_t)(v & 1));
+}
+
+inline uint64_t bits(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+inline double real(uint64_t u) {
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+} // anonymous namespace
+
+ZsbEncoder::ZsbEncoder(const std::string& _hostname, uint32_t _rank,
+    uint32_t _shmrank) : hostname(_hostname), rank(_rank), shmrank(_shmrank),
+    buffer(64*1024) {
+}
+
+void ZsbEncoder::reserve(size_t n) {
+    if (buffer.size() - used < n) {
+        buffer.resize(std::max(buffer.size() * 2, used + n));
+    }
+}
+
+void ZsbEncoder::varint(uint64_t v) {
+    reserve(10);
+    while (v >= 0x80) {
+        byte((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    byte((uint8_t)v);
+}
+
+void ZsbEncoder::header(void) {
+    reserve(sizeof(zsb::magic) + 1);
+    for (char c : zsb::magic) { byte(c); }
+    byte(zsb::version);
+    varint(hostname.size());
+    reserve(hostname.size());
+    memcpy(buffer.data() + used, hostname.data(), hostname.size());
+    used += hostname.size();
+    varint(rank);
+    varint(shmrank);
+}
+
+/* Strings are written to the dictionary the first time they are used,
+ * so this has to be called before the block using them is started */
+uint32_t ZsbEncoder::string(const std::string& s) {
+    auto found = strings.find(s);
+    if (found != strings.end()) { return found->second; }
+    uint32_t id = strings.size();
+    strings.emplace(s, id);
+    reserve(1);
+    byte(zsb::String);
+    varint(s.size());
+    reserve(s.size());
+    memcpy(buffer.data() + used, s.data(), s.size());
+    used += s.size();
+    return id;
+}
+
+uint32_t ZsbEncoder::literal(const char * s) {
+    auto found = literals.find(s);
+    if (found != literals.end()) { return found->second; }
+    uint32_t id = literals.size();
+    literals.emplace(s, id);
+    return id;
+}
+
+uint32_t ZsbEncoder::name(series::metric_id id) {
+    if (id >= names.size()) { names.resize(id + 1, unset); }
+    if (names[id] == unset) {
+        names[id] = string(series::Metrics::name(id));
+    }
+    return names[id];
+}
+
+ZsbEncoder::SeriesState& ZsbEncoder::lookup(const Record& r) {
+    uint64_t key = ((uint64_t)literal(r.resource) << 48) |
+        ((uint64_t)literal(r.type) << 32) | r.index;
+    auto found = seriesStates.find(key);
+    if (found != seriesStates.end()) { return found->second; }
+    uint32_t resource = string(r.resource);
+    uint32_t type = string(r.type);
+    SeriesState& s = seriesStates[key];
+    s.id = seriesCount++;
+    reserve(1);
+    byte(zsb::Series);
+    varint(resource);
+    varint(type);
+    varint(r.index);
+    return s;
+}
+
+void ZsbEncoder::operator()(const Record& r) {
+    if (r.text != nullptr) {
+        finish();
+        SeriesState& s = lookup(r);
+        uint32_t metric = name(r.metric);
+        uint32_t text = string(*(r.text));
+        reserve(1);
+        byte(zsb::Text);
+        varint(s.id);
+        varint(r.step);
+        varint(metric);
+        varint(text);
+        return;
+    }
+    if (current == nullptr || r.step != currentStep || r.index != currentIndex ||
+        r.resource != currentResource || r.type != currentType) {
+        finish();
+        current = &(lookup(r));
+        currentStep = r.step;
+        currentIndex = r.index;
+        currentResource = r.resource;
+        currentType = r.type;
+    }
+    row.push_back(Pending{r.metric, r.kind, r.value});
+}
+
+void ZsbEncoder::finish(void) {
+    if (current == nullptr) { return; }
+    encodeRow();
+    row.clear();
+    current = nullptr;
+}
+
+void ZsbEncoder::encodeRow(void) {
+    SeriesState& s = *current;
+    bool same = row.size() == s.columns.size();
+    for (size_t i = 0 ; same && i < row.size() ; i++) {
+        same = row[i].metric == s.columns[i].metric &&
+            row[i].kind == s.columns[i].kind;
+    }
+    if (!same) {
+        std::vector<uint32_t> ids;
+        ids.reserve(row.size());
+        for (auto& v : row) { ids.push_back(name(v.metric)); }
+        reserve(1);
+        byte(zsb::Layout);
+        varint(s.id);
+        varint(row.size());
+        s.columns.clear();
+        for (size_t i = 0 ; i < row.size() ; i++) {
+            varint(ids[i]);
+            reserve(1);
+            byte((uint8_t)row[i].kind);
+            series::Value zero;
+            zero.u = 0;
+            s.columns.push_back(Column{row[i].metric, row[i].kind, zero});
+        }
+    }
+    reserve(1);
+    byte(zsb::Row);
+    varint(s.id);
+    varint(zigzag((uint64_t)currentStep - s.step));
+    s.step = currentStep;
+    for (size_t i = 0 ; i < row.size() ; i++) {
+        Column& c = s.columns[i];
+        const series::Value& v = row[i].value;
+        switch (c.kind) {
+            case series::Kind::Double:
+                varint(__builtin_bswap64(bits(v.d) ^ bits(c.previous.d)));
+                break;
+            case series::Kind::State:
+                varint(v.u);
+                break;
+            case series::Kind::Unsigned:
+            default:
+                varint(zigzag(v.u - c.previous.u));
+                break;
+        }
+        c.previous = v;
+    }
+}
+
+bool ZsbDecoder::varint(uint64_t& v) {
+    v = 0;
+    for (int shift = 0 ; shift < 64 && p < end ; shift += 7) {
+        uint8_t b = (uint8_t)(*p++);
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) { return true; }
+    }
+    return false;
+}
+
+bool ZsbDecoder::readId(uint32_t& id, size_t count) {
+    uint64_t v;
+    if (!varint(v) || v >= count) { return false; }
+    id = (uint32_t)v;
+    return true;
+}
+
+bool ZsbDecoder::header(void) {
+    if ((size_t)(end - p) < sizeof(zsb::magic) + 1 ||
+        memcmp(p, zsb::magic, sizeof(zsb::magic)) != 0 ||
+        (uint8_t)(p[sizeof(zsb::magic)]) != zsb::version) {
+        return false;
+    }
+    p += sizeof(zsb::magic) + 1;
+    uint64_t length, r, s;
+    if (!varint(length) || length > (uint64_t)(end - p)) { return false; }
+    host.assign(p, length);
+    p += length;
+    if (!varint(r) || !varint(s)) { return false; }
+    rankId = (uint32_t)r;
+    shmrankId = (uint32_t)s;
+    return true;
+}
+
+bool ZsbDecoder::readString(void) {
+    uint64_t length;
+    if (!varint(length) || length > (uint64_t)(end - p)) { return false; }
+    dictionary.emplace_back(p, length);
+    metrics.push_back(unset);
+    p += length;
+    return true;
+}
+
+bool ZsbDecoder::readSeries(void) {
+    SeriesState s;
+    uint64_t index;
+    if (!readId(s.resource, dictionary.size()) ||
+        !readId(s.type, dictionary.size()) || !varint(index)) {
+        return false;
+    }
+    s.index = (uint32_t)index;
+    seriesStates.push_back(s);
+    return true;
+}
+
+series::metric_id ZsbDecoder::metric(uint32_t name) {
+    if (metrics[name] == unset) {
+        metrics[name] = series::Metrics::intern(dictionary[name]);
+    }
+    return metrics[name];
+}
+
+bool ZsbDecoder::readLayout(void) {
+    uint32_t id;
+    uint64_t count;
+    // every column takes at least two bytes
+    if (!readId(id, seriesStates.size()) || !varint(count) ||
+        count > (uint64_t)(end - p) / 2) {
+        return false;
+    }
+    std::vector<Column> columns;
+    columns.reserve(count);
+    for (uint64_t i = 0 ; i < count ; i++) {
+        uint32_t name;
+        if (!readId(name, dictionary.size()) || p >= end ||
+            (uint8_t)(*p) > (uint8_t)series::Kind::State) {
+            return false;
+        }
+        series::Value zero;
+        zero.u = 0;
+        columns.push_back(Column{metric(name), (series::Kind)(*p++), zero});
+    }
+    seriesStates[id].columns.swap(columns);
+    return true;
+}
+
+ZsbDecoder::SeriesState * ZsbDecoder::decodeRow(void) {
+    uint32_t id;
+    uint64_t delta;
+    if (!readId(id, seriesStates.size()) || !varint(delta)) { return nullptr; }
+    SeriesState& s = seriesStates[id];
+    // decode the whole row before any of it is used
+    scratch.resize(s.columns.size());
+    for (size_t i = 0 ; i < s.columns.size() ; i++) {
+        const Column& c = s.columns[i];
+        uint64_t v;
+        if (!varint(v)) { return nullptr; }
+        switch (c.kind) {
+            case series::Kind::Double:
+                scratch[i].d = real(__builtin_bswap64(v) ^ bits(c.previous.d));
+                break;
+            case series::Kind::State:
+                scratch[i].u = v;
+                break;
+            case series::Kind::Unsigned:
+            default:
+                scratch[i].u = c.previous.u + unzigzag(v);
+                break;
+        }
+    }
+    s.step += (uint32_t)unzigzag(delta);
+    for (size_t i = 0 ; i < s.columns.size() ; i++) {
+        s.columns[i].previous = scratch[i];
+    }
+    return &s;
+}
+
+bool ZsbDecoder::decodeText(uint32_t& id, uint32_t& step, uint32_t& name,
+    uint32_t& text) {
+    uint64_t v;
+    if (!readId(id, seriesStates.size()) || !varint(v) ||
+        !readId(name, dictionary.size()) || !readId(text, dictionary.size())) {
+        return false;
+    }
+    step = (uint32_t)v;
+    metric(name);
+    return true;
+}
+
+void ZsbDecoder::fill(Record& r, const SeriesState& s) {
+    r.resource = dictionary[s.resource].c_str();
+    r.type = dictionary[s.type].c_str();
+    r.index = s.index;
+    r.step = s.step;
+}
+
+} // namespace output
+
+} // namespace zerosum
@@ -0,0 +1,211 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023-2025 University of Oregon, Kevin Huck
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include "output_record.h"
+
+namespace zerosum {
+
+namespace output {
+
+/* zs.data.<rank>.zsb is a compact, self-describing version of the CSV file.
+ * After the header ("ZSB", a version byte, the hostname, rank and shmrank)
+ * the file is a sequence of blocks, each starting with a tag byte. All
+ * integers are LEB128 varints, and IDs are implicit, in order of definition:
+ *   String: length, bytes - the dictionary of names and text values
+ *   Series: resource, type (string IDs), index
+ *   Layout: series, count, (name string ID, kind) per column
+ *   Row:    series, step (zigzag delta), one value per column
+ *   Text:   series, step, name, value (string IDs)
+ * The values of a row are deltas from the previous row of the series:
+ * unsigned values as zigzag varints, doubles as the XOR of their bits,
+ * byte swapped so the usually zero low mantissa bits are dropped, and
+ * states as is. A new layout resets the previous values to zero.
+ * Blocks are only written whole, so a file cut short by a crash can still
+ * be read up to the last complete block. */
+namespace zsb {
+constexpr char magic[3] = {'Z','S','B'};
+constexpr uint8_t version{1};
+enum Tag : uint8_t { String = 1, Series = 2, Layout = 3, Row = 4, Text = 5 };
+} // namespace zsb
+
+class ZsbEncoder {
+public:
+    ZsbEncoder(const std::string& hostname, uint32_t rank, uint32_t shmrank);
+    void header(void);
+    void operator()(const Record& r);
+    /* Records arrive one value at a time, the row they belong to is
+     * encoded when the next row starts, or here. */
+    void finish(void);
+    void close(void) { finish(); }
+    const char * data(void) const { return buffer.data(); }
+    size_t size(void) const { return used; }
+    void clear(void) { used = 0; }
+private:
+    struct Column {
+        series::metric_id metric;
+        series::Kind kind;
+        series::Value previous;
+    };
+    struct SeriesState {
+        uint32_t id;
+        uint32_t step{0};
+        std::vector<Column> columns;
+    };
+    struct Pending {
+        series::metric_id metric;
+        series::Kind kind;
+        series::Value value;
+    };
+    void reserve(size_t n);
+    void byte(uint8_t b) { buffer[used++] = (char)b; }
+    void varint(uint64_t v);
+    uint32_t string(const std::string& s);
+    uint32_t literal(const char * s);
+    uint32_t name(series::metric_id id);
+    SeriesState& lookup(const Record& r);
+    void encodeRow(void);
+    std::string hostname;
+    uint32_t rank;
+    uint32_t shmrank;
+    std::vector<char> buffer;
+    size_t used{0};
+    std::unordered_map<std::string, uint32_t> strings;
+    // the resource and type names are literals, looked up by address
+    std::unordered_map<const char*, uint32_t> literals;
+    std::vector<uint32_t> names;
+    std::unordered_map<uint64_t, SeriesState> seriesStates;
+    uint32_t seriesCount{0};
+    // the row being collected
+    SeriesState * current{nullptr};
+    const char * currentResource{nullptr};
+    const char * currentType{nullptr};
+    uint32_t currentIndex{0};
+    uint32_t currentStep{0};
+    std::vector<Pending> row;
+};
+
+/* Reads a whole .zsb file from memory and hands every record to the sink,
+ * in the order they were written. */
+class ZsbDecoder {
+public:
+    ZsbDecoder(const char * data, size_t size) : p(data), end(data + size) {}
+    /* false if this is not a .zsb file */
+    bool header(void);
+    const std::string& hostname(void) const { return host; }
+    uint32_t rank(void) const { return rankId; }
+    uint32_t shmrank(void) const { return shmrankId; }
+    /* false if the file is truncated or corrupt, after the complete blocks
+     * have been read */
+    template<typename Sink>
+    bool records(Sink& sink) {
+        Record r{};
+        while (p < end) {
+            const char * start = p;
+            bool ok{false};
+            switch ((uint8_t)(*p++)) {
+                case zsb::String: ok = readString(); break;
+                case zsb::Series: ok = readSeries(); break;
+                case zsb::Layout: ok = readLayout(); break;
+                case zsb::Row: ok = readRow(r, sink); break;
+                case zsb::Text: ok = readText(r, sink); break;
+                default: break;
+            }
+            if (!ok) { p = start; return false; }
+        }
+        return true;
+    }
+private:
+    struct Column {
+        series::metric_id metric;
+        series::Kind kind;
+        series::Value previous;
+    };
+    struct SeriesState {
+        uint32_t resource;
+        uint32_t type;
+        uint32_t index;
+        uint32_t step{0};
+        std::vector<Column> columns;
+    };
+    bool varint(uint64_t& v);
+    bool readId(uint32_t& id, size_t count);
+    bool readString(void);
+    bool readSeries(void);
+    bool readLayout(void);
+    /* Decode the next row into the previous values of its series */
+    SeriesState * decodeRow(void);
+    bool decodeText(uint32_t& id, uint32_t& step, uint32_t& name, uint32_t& text);
+    series::metric_id metric(uint32_t name);
+    void fill(Record& r, const SeriesState& s);
+    template<typename Sink>
+    bool readRow(Record& r, Sink& sink) {
+        SeriesState * s = decodeRow();
+        if (s == nullptr) { return false; }
+        fill(r, *s);
+        for (auto& c : s->columns) {
+            r.metric = c.metric;
+            r.kind = c.kind;
+            r.value = c.previous;
+            sink(r);
+        }
+        return true;
+    }
+    template<typename Sink>
+    bool readText(Record& r, Sink& sink) {
+        uint32_t id, step, name, text;
+        if (!decodeText(id, step, name, text)) { return false; }
+        fill(r, seriesStates[id]);
+        r.step = step;
+        r.metric = metrics[name];
+        r.kind = series::Kind::State;
+        r.value.u = 0;
+        r.text = &(dictionary[text]);
+        sink(r);
+        r.text = nullptr;
+        return true;
+    }
+    const char * p;
+    const char * end;
+    std::string host;
+    uint32_t rankId{0};
+    uint32_t shmrankId{0};
+    // a deque, so the records can point at the strings
+    std::deque<std::string> dictionary;
+    // the metric ID of every string, interned when first used as a name
+    std::vector<series::metric_id> metrics;
+    std::vector<SeriesState> seriesStates;
+    std::vector<series::Value> scratch;
+};
+
+} // namespace output
+
+} // namespace zerosum